@@ -0,0 +1,138 @@
+#ifndef KAORI_BLOCK_BUFFER_HPP
+#define KAORI_BLOCK_BUFFER_HPP
+
+#include <cctype>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @file BlockBuffer.hpp
+ *
+ * @brief Buffered input for the sequence readers.
+ */
+
+namespace kaori {
+
+/**
+ * @cond
+ */
+inline const char* find_newline(const char* start, const char* end) {
+#if defined(__AVX2__)
+    const __m256i newline32 = _mm256_set1_epi8('\n');
+    while (end - start >= 32) {
+        auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(start));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline32));
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+        start += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i newline16 = _mm_set1_epi8('\n');
+    while (end - start >= 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(start));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline16));
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+        start += 16;
+    }
+#endif
+    auto found = std::memchr(start, '\n', end - start);
+    return (found == NULL ? end : static_cast<const char*>(found));
+}
+
+// Block-wise buffering of a byte source, with bulk extraction of lines.
+template<typename Pointer_>
+class BlockBuffer {
+public:
+    BlockBuffer(Pointer_ source, std::size_t buffer_size) :
+        my_source(std::move(source)),
+        my_buffer(std::max(buffer_size, static_cast<std::size_t>(1)))
+    {}
+
+private:
+    Pointer_ my_source;
+    std::vector<char> my_buffer;
+    std::size_t my_current = 0; // position of the next unconsumed byte in the buffer.
+    std::size_t my_available = 0; // number of valid bytes in the buffer.
+    unsigned long long my_consumed = 0; // number of bytes from the stream that precede the buffer.
+    bool my_finished = false;
+
+public:
+    // Returns true if at least one unconsumed byte is present in the buffer, refilling it if necessary.
+    bool available() {
+        if (my_current < my_available) {
+            return true;
+        }
+        if (my_finished) {
+            return false;
+        }
+
+        my_consumed += my_available;
+        my_current = 0;
+        my_available = my_source->read(reinterpret_cast<unsigned char*>(my_buffer.data()), my_buffer.size());
+        my_finished = (my_available < my_buffer.size());
+        return my_available > 0;
+    }
+
+    // Whether the next call to available() would refill the buffer, invalidating all pointers into it.
+    bool exhausted() const {
+        return my_current >= my_available;
+    }
+
+    // These should only be used after available() returns true.
+    char get() const {
+        return my_buffer[my_current];
+    }
+
+    const char* begin() const {
+        return my_buffer.data() + my_current;
+    }
+
+    const char* end() const {
+        return my_buffer.data() + my_available;
+    }
+
+    void advance(std::size_t n) {
+        my_current += n;
+    }
+
+    // Consumes bytes up to and including the next newline, appending all bytes before the newline to 'dest' (if not NULL).
+    // Returns false if the end of the stream was reached before a newline was found.
+    bool read_line(std::vector<char>* dest) {
+        while (available()) {
+            const char* ptr = begin();
+            const char* last = end();
+            const char* newline = find_newline(ptr, last);
+            if (dest) {
+                dest->insert(dest->end(), ptr, newline);
+            }
+            if (newline != last) {
+                my_current += newline - ptr + 1;
+                return true;
+            }
+            my_current = my_available;
+        }
+        return false;
+    }
+
+    unsigned long long position() const {
+        return my_consumed + my_current;
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
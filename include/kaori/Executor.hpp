@@ -0,0 +1,375 @@
+#ifndef KAORI_EXECUTOR_HPP
+#define KAORI_EXECUTOR_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <exception>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * @file Executor.hpp
+ *
+ * @brief Interface for running tasks on worker threads.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Interface for running tasks on worker threads.
+ *
+ * This allows **kaori** to run its parallel sections on a caller-provided scheduler, e.g., an existing thread pool, TBB or OpenMP.
+ * Each task is a self-contained job (usually the processing of a chunk of reads) that does not throw and does not wait on other tasks.
+ * Any synchronization required to merge the results is handled by the caller of `submit()`.
+ */
+class Executor {
+public:
+    /**
+     * @cond
+     */
+    virtual ~Executor() = default;
+    /**
+     * @endcond
+     */
+
+    /**
+     * Schedule a task for execution on a worker thread.
+     * This method should not block until the task is complete, i.e., the task should be executed asynchronously from the calling thread.
+     * It will only be called from one thread at a time.
+     *
+     * @param task Task to be executed.
+     */
+    virtual void submit(std::function<void()> task) = 0;
+
+    /**
+     * Schedule a task with a preferred "home" worker.
+     * Tasks with the same `home` usually operate on the same data, so running them on the same worker (or at least the same NUMA node) improves memory locality.
+     * This is only a hint and may be ignored; by default, it just calls `submit()`.
+     *
+     * @param home Arbitrary non-negative integer identifying the preferred worker.
+     * Implementations may take the remainder after dividing by their number of workers.
+     * @param task Task to be executed.
+     */
+    virtual void submit_to(std::size_t home, std::function<void()> task) {
+        (void)home;
+        submit(std::move(task));
+    }
+
+    /**
+     * Block until all tasks that were previously passed to `submit()` on this instance have completed.
+     * Tasks submitted to the same scheduler by other instances or by other parts of the application do not need to be considered.
+     */
+    virtual void wait() = 0;
+};
+
+/**
+ * @brief Options for `DefaultExecutor`.
+ */
+struct DefaultExecutorOptions {
+    /**
+     * CPUs to which the worker threads should be pinned, where worker `t` is pinned to `cpus[t % cpus.size()]`.
+     * On multi-socket machines, this keeps each worker (and the memory that it first touches) on the same NUMA node.
+     * If empty, threads are not pinned.
+     * Pinning is only supported on Linux and this option is ignored on other platforms.
+     */
+    std::vector<int> cpus;
+
+    /**
+     * Time in seconds that an idle worker waits before stealing a task from the queue of another idle worker.
+     * This gives the owner of the queue a chance to wake up and run the task itself, which preserves the locality of `submit_to()`.
+     * Tasks in the queue of a busy worker are always stolen immediately.
+     */
+    double steal_delay = 0.001;
+};
+
+/**
+ * @brief Default executor that runs tasks on its own threads.
+ *
+ * This spawns a fixed number of `std::thread`s, each of which has its own queue of tasks.
+ * Tasks submitted with `submit_to()` are placed in the queue of the corresponding worker, while those from `submit()` are distributed in a round-robin manner.
+ * Each worker processes tasks from its own queue in order of submission, and only that worker is woken up if it is idle.
+ * A worker with an empty queue steals tasks from a busy worker's queue immediately, or from an idle worker's queue after `DefaultExecutorOptions::steal_delay`.
+ * This is used by `process_single_end_data()` and friends when no other `Executor` is supplied.
+ */
+class DefaultExecutor final : public Executor {
+public:
+    /**
+     * @param num_threads Number of worker threads to spawn.
+     * Values less than 1 are treated as 1.
+     * @param options Further options.
+     */
+    DefaultExecutor(int num_threads, const DefaultExecutorOptions& options = DefaultExecutorOptions()) :
+        my_steal_delay(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(options.steal_delay, 0.0))))
+    {
+        if (num_threads < 1) {
+            num_threads = 1;
+        }
+        my_queues.resize(num_threads);
+        my_idle.resize(num_threads);
+        my_busy.resize(num_threads);
+        my_task_cvs = std::vector<std::condition_variable>(num_threads);
+        my_working.resize(num_threads);
+        my_sleeping.resize(num_threads);
+
+        my_threads.reserve(num_threads);
+        for (int t = 0; t < num_threads; ++t) {
+            bool do_pin = !options.cpus.empty();
+            int cpu = (do_pin ? options.cpus[t % options.cpus.size()] : 0);
+            my_threads.emplace_back([this](std::size_t home, bool do_pin, int cpu) -> void {
+                // Pinning from inside the thread so that it applies before we run any task.
+                bool pinned = !do_pin || pin(cpu);
+                std::unique_lock lck(my_mut);
+                ++my_num_started;
+                my_pin_failed = my_pin_failed || !pinned;
+                my_wait_cv.notify_all();
+                run_worker(lck, home);
+            }, t, do_pin, cpu);
+        }
+
+        std::unique_lock lck(my_mut);
+        my_wait_cv.wait(lck, [&]() -> bool { return my_num_started == my_threads.size(); });
+        if (my_pin_failed) {
+            lck.unlock();
+            shutdown();
+            throw std::runtime_error("failed to pin worker threads to the requested CPUs");
+        }
+    }
+
+    /**
+     * @cond
+     */
+    DefaultExecutor(const DefaultExecutor&) = delete;
+    DefaultExecutor& operator=(const DefaultExecutor&) = delete;
+
+    ~DefaultExecutor() {
+        shutdown();
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    std::vector<std::thread> my_threads;
+    std::chrono::steady_clock::duration my_steal_delay;
+
+    // All of the members below are protected by 'my_mut'.
+    std::mutex my_mut;
+    std::vector<std::condition_variable> my_task_cvs; // one per worker, so that we can wake up the owner of a queue.
+    std::condition_variable my_wait_cv;
+    std::vector<std::deque<std::function<void()> > > my_queues;
+    std::vector<char> my_working; // whether each worker is running a task.
+    std::vector<char> my_sleeping; // whether each worker is waiting for a task and has not yet been notified.
+    std::size_t my_num_queued = 0;
+    std::size_t my_pending = 0;
+    std::size_t my_next_home = 0;
+    std::size_t my_num_started = 0;
+    bool my_pin_failed = false;
+    bool my_terminated = false;
+    std::vector<double> my_idle, my_busy;
+
+    // Returns the queue to take the next task from, or the number of queues if there is no suitable task.
+    std::size_t choose_queue(std::size_t home, bool steal_from_idle) const {
+        std::size_t nqueues = my_queues.size();
+        if (!my_queues[home].empty()) {
+            return home;
+        }
+        for (std::size_t i = 1; i < nqueues; ++i) {
+            auto other = (home + i) % nqueues;
+            if (!my_queues[other].empty() && (my_working[other] || steal_from_idle)) {
+                return other;
+            }
+        }
+        return nqueues;
+    }
+
+    // Should only be called while holding the lock.
+    void wake_sleeper() {
+        for (std::size_t w = 0, nqueues = my_queues.size(); w < nqueues; ++w) {
+            if (my_sleeping[w]) {
+                my_sleeping[w] = false;
+                my_task_cvs[w].notify_one();
+                return;
+            }
+        }
+    }
+
+    void run_worker(std::unique_lock<std::mutex>& lck, std::size_t home) {
+        std::size_t nqueues = my_queues.size();
+        auto& task_cv = my_task_cvs[home];
+
+        while (1) {
+            auto start = std::chrono::steady_clock::now();
+            std::size_t chosen;
+            while (1) {
+                // Once the executor is terminated, all remaining tasks are fair game.
+                bool steal_from_idle = my_terminated || (std::chrono::steady_clock::now() - start >= my_steal_delay);
+                chosen = choose_queue(home, steal_from_idle);
+                if (chosen != nqueues) {
+                    break;
+                }
+                if (my_terminated && my_num_queued == 0) {
+                    return;
+                }
+
+                my_sleeping[home] = true;
+                if (my_num_queued > 0) {
+                    // Tasks are waiting for idle owners, so we check again after the delay in case they don't wake up in time.
+                    task_cv.wait_for(lck, my_steal_delay);
+                } else {
+                    task_cv.wait(lck);
+                }
+                my_sleeping[home] = false;
+            }
+
+            auto task_start = std::chrono::steady_clock::now();
+            my_idle[home] += std::chrono::duration<double>(task_start - start).count();
+
+            auto& queue = my_queues[chosen];
+            auto task = std::move(queue.front());
+            queue.pop_front();
+            --my_num_queued;
+            my_working[home] = true;
+
+            // If our own queue still has tasks, another worker should steal them while we're busy.
+            if (!my_queues[home].empty()) {
+                wake_sleeper();
+            }
+
+            lck.unlock();
+            task();
+            lck.lock();
+            my_working[home] = false;
+            my_busy[home] += std::chrono::duration<double>(std::chrono::steady_clock::now() - task_start).count();
+
+            --my_pending;
+            if (my_pending == 0) {
+                my_wait_cv.notify_all();
+            }
+        }
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard lck(my_mut);
+            my_terminated = true;
+        }
+        for (auto& cv : my_task_cvs) {
+            cv.notify_all();
+        }
+        for (auto& thread : my_threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    static bool pin(int cpu) {
+#if defined(__linux__)
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#else
+        (void)cpu;
+        return true;
+#endif
+    }
+
+    void enqueue(std::size_t home, std::function<void()> task) {
+        std::condition_variable* target = NULL;
+        {
+            std::lock_guard lck(my_mut);
+            home %= my_queues.size();
+            my_queues[home].push_back(std::move(task));
+            ++my_num_queued;
+            ++my_pending;
+
+            // Waking up the owner if it's idle. Otherwise, we wake up another idle worker to steal the task.
+            if (!my_working[home]) {
+                target = &(my_task_cvs[home]);
+            } else {
+                wake_sleeper();
+            }
+        }
+        if (target) {
+            target->notify_one();
+        }
+    }
+
+public:
+    /**
+     * @param task Task to be executed.
+     */
+    void submit(std::function<void()> task) {
+        enqueue(my_next_home++, std::move(task));
+    }
+
+    /**
+     * @param home Index of the preferred worker, modulo the number of threads.
+     * @param task Task to be executed.
+     */
+    void submit_to(std::size_t home, std::function<void()> task) {
+        enqueue(home, std::move(task));
+    }
+
+    /**
+     * Block until all submitted tasks are complete.
+     */
+    void wait() {
+        std::unique_lock lck(my_mut);
+        my_wait_cv.wait(lck, [&]() -> bool { return my_pending == 0; });
+    }
+
+    /**
+     * @return Number of worker threads.
+     */
+    int num_threads() const {
+        return my_threads.size();
+    }
+
+    /**
+     * @return Total time in seconds that the worker threads spent waiting for tasks, summed across all threads.
+     * Only waits that ended with the receipt of a new task are counted.
+     * This should only be called after `wait()`.
+     */
+    double idle_time() const {
+        double total = 0;
+        for (auto x : my_idle) {
+            total += x;
+        }
+        return total;
+    }
+
+    /**
+     * @return Time in seconds that each worker thread spent waiting for tasks, as described for `idle_time()`.
+     * This should only be called after `wait()`.
+     */
+    const std::vector<double>& idle_times() const {
+        return my_idle;
+    }
+
+    /**
+     * @return Time in seconds that each worker thread spent executing tasks.
+     * This should only be called after `wait()`.
+     */
+    const std::vector<double>& busy_times() const {
+        return my_busy;
+    }
+};
+
+}
+
+#endif
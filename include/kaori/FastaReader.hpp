@@ -0,0 +1,138 @@
+#ifndef KAORI_FASTA_READER_HPP
+#define KAORI_FASTA_READER_HPP
+
+#include <cctype>
+#include <vector>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "byteme/byteme.hpp"
+
+#include "BlockBuffer.hpp"
+
+/**
+ * @file FastaReader.hpp
+ *
+ * @brief Defines the `FastaReader` class.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Stream reads from a FASTA file.
+ *
+ * This provides the same interface as `FastqReader` for inputs that do not contain quality strings.
+ * Each record starts with a `>` line containing the name, followed by any number of sequence lines.
+ * Multi-line sequences are concatenated, and the name of each read is only considered up to the first whitespace.
+ *
+ * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
+ * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization.
+ * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object.
+ */
+template<typename Pointer_>
+class FastaReader {
+public:
+    /**
+     * @param p Pointer to a text stream containing a FASTA file.
+     * @param buffer_size Size of the buffer size for parsing the FASTA file.
+     * Larger values improve speed at the cost of increased memory usage.
+     */
+    FastaReader(Pointer_ p, std::size_t buffer_size = 65536) : my_buffer(std::move(p), buffer_size) {
+        my_sequence.reserve(200);
+        my_name.reserve(200);
+        my_okay = my_buffer.available();
+    }
+
+    /**
+     * Extract details for the next read in the file.
+     *
+     * @return Whether or not a record was successfully extracted.
+     * If `true`, `get_sequence()` and `get_name()` may be used.
+     * If `false`, the end of the file was reached.
+     */
+    bool operator()() {
+        if (!my_okay) {
+            return false;
+        }
+
+        if (my_buffer.get() != '>') {
+            throw std::runtime_error("read name should start with '>' (starting line " + std::to_string(my_line_count + 1) + ")");
+        }
+        my_buffer.advance(1);
+
+        // The name may run to the end of the file, in which case the sequence is empty (see below).
+        my_name.clear();
+        while (my_buffer.available()) {
+            const char* ptr = my_buffer.begin();
+            const char* end = my_buffer.end();
+            const char* stop = ptr;
+            while (stop != end && !std::isspace(*stop)) {
+                ++stop;
+            }
+            my_name.insert(my_name.end(), ptr, stop);
+            my_buffer.advance(stop - ptr);
+            if (stop != end) {
+                break;
+            }
+        }
+
+        // A name line without a terminating newline means that the sequence is empty.
+        my_sequence.clear();
+        bool more = my_buffer.read_line(NULL);
+        ++my_line_count;
+
+        // Sequence lines continue until the next line starting with '>' or the end of the file.
+        while (more) {
+            if (!my_buffer.available()) {
+                more = false;
+                break;
+            }
+            if (my_buffer.get() == '>') {
+                break;
+            }
+            my_buffer.read_line(&my_sequence);
+            ++my_line_count;
+        }
+
+        my_okay = more;
+        return true;
+    }
+
+private:
+    BlockBuffer<Pointer_> my_buffer;
+    std::vector<char> my_sequence;
+    std::vector<char> my_name;
+    bool my_okay;
+    unsigned long long my_line_count = 0;
+
+public:
+    /**
+     * @return Vector containing the sequence for the current read.
+     * This should only be called if `operator()` returns true.
+     */
+    const std::vector<char>& get_sequence() const {
+        return my_sequence;
+    }
+
+    /**
+     * @return Vector containing the name for the current read.
+     * Note that the name is considered to end at the first whitespace on the line.
+     * This should only be called if `operator()` returns true.
+     */
+    const std::vector<char>& get_name() const {
+        return my_name;
+    }
+
+    /**
+     * @return Number of bytes consumed from the input stream.
+     * After a successful call to `operator()`, this is equal to the offset of the start of the next record, or the total length of the stream if no more records are available.
+     */
+    unsigned long long position() const {
+        return my_buffer.position();
+    }
+};
+
+}
+
+#endif
@@ -4,10 +4,12 @@
 #include <cctype>
 #include <vector>
 #include <stdexcept>
+#include <utility>
 
 #include "byteme/byteme.hpp"
 
 #include "utils.hpp"
+#include "BlockBuffer.hpp"
 
 /**
  * @file FastqReader.hpp
@@ -24,6 +26,11 @@ namespace kaori {
  * Multi-line sequence and quality strings are supported.
  * The name of each read is only considered up to the first whitespace.
  *
+ * Line boundaries are located in bulk within each block of buffered input, using SIMD instructions where available (SSE2 or AVX2) and `memchr()` otherwise.
+ * Single-line sequences and names that lie within a block are reported directly from the buffer by `get_sequence_view()` and `get_name_view()`.
+ * They are only copied out when a record spans multiple lines or blocks, or if `get_sequence()` or `get_name()` has ever been called on this instance
+ * (in which case, the returned vectors are updated on every call to `operator()`, as before).
+ *
  * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
  * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization. 
  * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object. 
@@ -40,11 +47,11 @@ public:
         Pointer_ p,
         std::size_t buffer_size = 65536 /* default for back-compatibility */
     ) :
-        my_pb(p, buffer_size)
+        my_buffer(std::move(p), buffer_size)
     {
         my_sequence.reserve(200);
         my_name.reserve(200);
-        my_okay = my_pb.valid();
+        my_okay = my_buffer.available();
     }
 
     /**
@@ -61,60 +68,105 @@ public:
         }
 
         auto init_line = my_line_count;
+        my_name_in_block = false;
+        my_sequence_in_block = false;
 
         // Processing the name. This should be on a single line, hopefully.
-        my_name.clear();
-        char val = my_pb.get();
-        if (val != '@') {
+        if (my_buffer.get() != '@') {
             throw std::runtime_error("read name should start with '@' (starting line " + std::to_string(init_line + 1) + ")");
         }
+        my_buffer.advance(1);
 
-        val = advance_and_check();
-        while (!std::isspace(val)) {
-            my_name.push_back(val);
-            val = advance_and_check();
+        my_name.clear();
+        require();
+        {
+            const char* ptr = my_buffer.begin();
+            const char* end = my_buffer.end();
+            const char* stop = find_space(ptr, end);
+            my_buffer.advance(stop - ptr);
+            if (stop != end) {
+                my_name_view = std::make_pair(ptr, stop);
+                my_name_in_block = true;
+            } else {
+                my_name.insert(my_name.end(), ptr, stop);
+                while (1) {
+                    require();
+                    ptr = my_buffer.begin();
+                    end = my_buffer.end();
+                    stop = find_space(ptr, end);
+                    my_name.insert(my_name.end(), ptr, stop);
+                    my_buffer.advance(stop - ptr);
+                    if (stop != end) {
+                        break;
+                    }
+                }
+                my_name_view = to_view(my_name);
+            }
         }
 
-        while (val != '\n') {
-            val = advance_and_check();
-        }
+        skip_line();
         ++my_line_count;
 
-        // Processing the sequence itself until we get to a '+'.
+        // Processing the sequence itself until we get to a line starting with '+'.
+        // The first line is always part of the sequence, even if it is empty.
+        // If it lies within the current block, we just point to it; we only copy it if it spans multiple blocks or lines.
         my_sequence.clear();
-        val = advance_and_check();
-        while (1) {
-            if (val == '\n') {
-                val = advance_and_check();
-                if (val == '+') {
-                    break;
+        require();
+        {
+            const char* ptr = my_buffer.begin();
+            const char* end = my_buffer.end();
+            const char* newline = find_newline(ptr, end);
+            if (newline != end) {
+                my_sequence_view = std::make_pair(ptr, newline);
+                my_sequence_in_block = true;
+                my_buffer.advance(newline - ptr + 1);
+            } else {
+                my_sequence.insert(my_sequence.end(), ptr, end);
+                my_buffer.advance(end - ptr);
+                if (!read_line(&my_sequence)) {
+                    throw_premature();
                 }
             }
-            my_sequence.push_back(val);
-            val = advance_and_check();
+        }
+        while (1) {
+            require();
+            if (my_buffer.get() == '+') {
+                break;
+            }
+            release_sequence();
+            if (!read_line(&my_sequence)) {
+                throw_premature();
+            }
+        }
+        if (!my_sequence_in_block) {
+            my_sequence_view = to_view(my_sequence);
         }
         ++my_line_count;
 
         // Line 3 should be a single line; starting with '+' is implicit from above.
-        val = advance_and_check();
-        while (val != '\n') {
-            val = advance_and_check();
-        } 
+        skip_line();
         ++my_line_count;
 
         // Processing the qualities. Extraction is allowed to fail if we're at
         // the end of the file. Note that we can't check for '@' as a
         // delimitor, as this can be a valid score, so instead we check at each
         // newline whether we've reached the specified length, and quit if so.
-        SeqLength seq_length = my_sequence.size(), qual_length = 0;
+        SeqLength seq_length = my_sequence_view.second - my_sequence_view.first, qual_length = 0;
         my_okay = false;
 
-        while (my_pb.advance()) {
-            val = my_pb.get();
-            if (val != '\n') {
-                ++qual_length;
-            } else if (qual_length >= seq_length) {
-                my_okay = my_pb.advance(); // sneak past the newline.
+        while (available()) {
+            const char* ptr = my_buffer.begin();
+            const char* end = my_buffer.end();
+            const char* newline = find_newline(ptr, end);
+            qual_length += newline - ptr;
+            if (newline == end) {
+                my_buffer.advance(end - ptr);
+                continue;
+            }
+
+            my_buffer.advance(newline - ptr + 1); // sneak past the newline.
+            if (qual_length >= seq_length) {
+                my_okay = available();
                 break;
             }
         }
@@ -126,23 +178,98 @@ public:
             throw std::runtime_error("non-equal lengths for quality and sequence strings (starting line " + std::to_string(init_line + 1) + ")");
         }
 
+        // Once a caller has asked for the vectors, we keep them up to date as they might be holding a reference.
+        if (my_copy_name) {
+            release_name();
+        }
+        if (my_copy_sequence) {
+            release_sequence();
+        }
+
         ++my_line_count;
         return true;
     }
 
 private:
-    byteme::SerialBufferedReader<char, Pointer_> my_pb;
+    BlockBuffer<Pointer_> my_buffer;
+
+    static std::pair<const char*, const char*> to_view(const std::vector<char>& x) {
+        return std::make_pair(x.data(), x.data() + x.size());
+    }
+
+    static const char* find_space(const char* ptr, const char* end) {
+        while (ptr != end && !std::isspace(*ptr)) {
+            ++ptr;
+        }
+        return ptr;
+    }
+
+    void throw_premature() const {
+        throw std::runtime_error("premature end of the file at line " + std::to_string(my_line_count + 1));
+    }
 
-    char advance_and_check() {
-        if (!my_pb.advance()) {
-            throw std::runtime_error("premature end of the file at line " + std::to_string(my_line_count + 1));
+    // Any views into the current block must be copied out before the block is refilled.
+    bool available() {
+        if (my_buffer.exhausted()) {
+            release_name();
+            release_sequence();
+        }
+        return my_buffer.available();
+    }
+
+    void require() {
+        if (!available()) {
+            throw_premature();
+        }
+    }
+
+    bool read_line(std::vector<char>* dest) {
+        while (available()) {
+            const char* ptr = my_buffer.begin();
+            const char* end = my_buffer.end();
+            const char* newline = find_newline(ptr, end);
+            if (dest) {
+                dest->insert(dest->end(), ptr, newline);
+            }
+            if (newline != end) {
+                my_buffer.advance(newline - ptr + 1);
+                return true;
+            }
+            my_buffer.advance(end - ptr);
+        }
+        return false;
+    }
+
+    void skip_line() {
+        if (!read_line(NULL)) {
+            throw_premature();
+        }
+    }
+
+    void release_name() const {
+        if (my_name_in_block) {
+            my_name.assign(my_name_view.first, my_name_view.second);
+            my_name_view = to_view(my_name);
+            my_name_in_block = false;
+        }
+    }
+
+    void release_sequence() const {
+        if (my_sequence_in_block) {
+            my_sequence.assign(my_sequence_view.first, my_sequence_view.second);
+            my_sequence_view = to_view(my_sequence);
+            my_sequence_in_block = false;
         }
-        return my_pb.get();
     }
 
 private:
-    std::vector<char> my_sequence;
-    std::vector<char> my_name;
+    // These are mutable as the copies from the block are only made after the first call to get_sequence() or get_name().
+    mutable std::vector<char> my_sequence;
+    mutable std::vector<char> my_name;
+    mutable std::pair<const char*, const char*> my_sequence_view, my_name_view;
+    mutable bool my_sequence_in_block = false, my_name_in_block = false;
+    mutable bool my_copy_sequence = false, my_copy_name = false;
+
     bool my_okay;
     unsigned long long my_line_count = 0; // guarantee at least 64 bits for the line counter.
 
@@ -152,6 +279,8 @@ public:
      * This should only be called if `load()` returns true.
      */
     const std::vector<char>& get_sequence() const {
+        my_copy_sequence = true;
+        release_sequence();
         return my_sequence;
     }
 
@@ -161,8 +290,38 @@ public:
      * This should only be called if `load()` returns true.
      */
     const std::vector<char>& get_name() const {
+        my_copy_name = true;
+        release_name();
         return my_name;
     }
+
+    /**
+     * @return Pointers to the start and end of the sequence for the current read.
+     * For single-line sequences that do not span multiple blocks of the buffer, this points directly into the buffer so no copy is made;
+     * otherwise, it points to the same storage as `get_sequence()`.
+     * In either case, the pointers are only valid until the next call to `operator()`.
+     * This should only be called if `load()` returns true.
+     */
+    std::pair<const char*, const char*> get_sequence_view() const {
+        return my_sequence_view;
+    }
+
+    /**
+     * @return Pointers to the start and end of the name for the current read, see `get_sequence_view()` for details.
+     * This should only be called if `load()` returns true.
+     */
+    std::pair<const char*, const char*> get_name_view() const {
+        return my_name_view;
+    }
+
+    /**
+     * @return Number of bytes consumed from the input stream.
+     * After a successful call to `operator()`, this is equal to the offset of the start of the next record, or the total length of the stream if no more records are available.
+     * Before the first call, this is equal to zero.
+     */
+    unsigned long long position() const {
+        return my_buffer.position();
+    }
 };
 
 }
@@ -0,0 +1,98 @@
+#ifndef KAORI_LINE_SEQUENCE_READER_HPP
+#define KAORI_LINE_SEQUENCE_READER_HPP
+
+#include <vector>
+#include <string>
+#include <utility>
+
+#include "byteme/byteme.hpp"
+
+#include "BlockBuffer.hpp"
+
+/**
+ * @file LineSequenceReader.hpp
+ *
+ * @brief Defines the `LineSequenceReader` class.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Stream reads from a file with one sequence per line.
+ *
+ * This provides the same interface as `FastqReader` for plain-text inputs where each line contains the sequence of a single read.
+ * As no names are available, the name of each read is defined as its 1-based position in the file, e.g., `"1"`, `"2"` and so on.
+ * The last line does not need to be terminated by a newline.
+ *
+ * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
+ * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization.
+ * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object.
+ */
+template<typename Pointer_>
+class LineSequenceReader {
+public:
+    /**
+     * @param p Pointer to a text stream with one sequence per line.
+     * @param buffer_size Size of the buffer size for parsing the file.
+     * Larger values improve speed at the cost of increased memory usage.
+     */
+    LineSequenceReader(Pointer_ p, std::size_t buffer_size = 65536) : my_buffer(std::move(p), buffer_size) {
+        my_sequence.reserve(200);
+    }
+
+    /**
+     * Extract details for the next read in the file.
+     *
+     * @return Whether or not a record was successfully extracted.
+     * If `true`, `get_sequence()` and `get_name()` may be used.
+     * If `false`, the end of the file was reached.
+     */
+    bool operator()() {
+        if (!my_buffer.available()) {
+            return false;
+        }
+
+        my_sequence.clear();
+        my_buffer.read_line(&my_sequence);
+        ++my_line_count;
+
+        auto name = std::to_string(my_line_count);
+        my_name.assign(name.begin(), name.end());
+        return true;
+    }
+
+private:
+    BlockBuffer<Pointer_> my_buffer;
+    std::vector<char> my_sequence;
+    std::vector<char> my_name;
+    unsigned long long my_line_count = 0;
+
+public:
+    /**
+     * @return Vector containing the sequence for the current read.
+     * This should only be called if `operator()` returns true.
+     */
+    const std::vector<char>& get_sequence() const {
+        return my_sequence;
+    }
+
+    /**
+     * @return Vector containing the name for the current read, i.e., its 1-based line number.
+     * This should only be called if `operator()` returns true.
+     */
+    const std::vector<char>& get_name() const {
+        return my_name;
+    }
+
+    /**
+     * @return Number of bytes consumed from the input stream.
+     * After a successful call to `operator()`, this is equal to the offset of the start of the next line, or the total length of the stream if no more lines are available.
+     */
+    unsigned long long position() const {
+        return my_buffer.position();
+    }
+};
+
+}
+
+#endif
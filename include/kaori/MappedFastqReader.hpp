@@ -0,0 +1,231 @@
+#ifndef KAORI_MAPPED_FASTQ_READER_HPP
+#define KAORI_MAPPED_FASTQ_READER_HPP
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @file MappedFastqReader.hpp
+ *
+ * @brief Defines the `MappedFastqReader` class.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Stream reads from a memory-mapped FASTQ file.
+ *
+ * This provides the same parsing behavior as `FastqReader`, but operates directly on a memory mapping of an uncompressed FASTQ file.
+ * The sequence and name of each read are reported as pointers into the mapping, so no copies are made for single-line records.
+ * For multi-line records, the sequence lines are compacted in place within a private (copy-on-write) mapping, so the file itself is never modified.
+ * Thus, the pointers returned by `get_sequence()` and `get_name()` remain valid for the lifetime of the `MappedFastqReader` instance,
+ * which allows `process_single_end_data()` and `process_paired_end_data()` to use them without any copying.
+ *
+ * This class requires POSIX support for `mmap()`.
+ */
+class MappedFastqReader {
+public:
+    /**
+     * @param path Path to an uncompressed FASTQ file.
+     */
+    MappedFastqReader(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open file at '" + std::string(path) + "'");
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to inspect file at '" + std::string(path) + "'");
+        }
+        my_length = info.st_size;
+
+        if (my_length) {
+            // Private mapping allows us to compact multi-line records in place without touching the file.
+            void* mapped = ::mmap(NULL, my_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("failed to map file at '" + std::string(path) + "'");
+            }
+            my_data = static_cast<char*>(mapped);
+            ::madvise(mapped, my_length, MADV_SEQUENTIAL);
+        }
+
+        ::close(fd); // mapping remains valid after the file descriptor is closed.
+    }
+
+    /**
+     * @cond
+     */
+    MappedFastqReader(const MappedFastqReader&) = delete;
+    MappedFastqReader& operator=(const MappedFastqReader&) = delete;
+
+    ~MappedFastqReader() {
+        if (my_data) {
+            ::munmap(my_data, my_length);
+        }
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    char* my_data = NULL;
+    std::size_t my_length = 0;
+    std::size_t my_position = 0;
+    unsigned long long my_line_count = 0; // guarantee at least 64 bits for the line counter.
+
+    std::pair<const char*, const char*> my_sequence, my_name;
+
+    std::size_t find_newline(std::size_t from) const {
+        auto found = std::memchr(my_data + from, '\n', my_length - from);
+        if (found == NULL) {
+            return my_length;
+        }
+        return static_cast<const char*>(found) - my_data;
+    }
+
+    void check_premature(std::size_t pos) const {
+        if (pos >= my_length) {
+            throw std::runtime_error("premature end of the file at line " + std::to_string(my_line_count + 1));
+        }
+    }
+
+public:
+    /**
+     * Extract details for the next read in the file.
+     *
+     * @return Whether or not a record was successfully extracted.
+     * If `true`, `get_sequence()` and `get_name()` may be used.
+     * If `false`, the end of the file was reached.
+     */
+    bool operator()() {
+        if (my_position >= my_length) {
+            return false;
+        }
+
+        auto init_line = my_line_count;
+
+        // Processing the name, which ends at the first whitespace.
+        std::size_t pos = my_position;
+        if (my_data[pos] != '@') {
+            throw std::runtime_error("read name should start with '@' (starting line " + std::to_string(init_line + 1) + ")");
+        }
+        ++pos;
+        std::size_t name_start = pos;
+        while (pos < my_length && !std::isspace(my_data[pos])) {
+            ++pos;
+        }
+        check_premature(pos);
+        my_name.first = my_data + name_start;
+        my_name.second = my_data + pos;
+
+        pos = find_newline(pos);
+        check_premature(pos);
+        ++my_line_count;
+
+        // Processing the sequence until we get to a line starting with '+'.
+        // Multi-line sequences are compacted in place so that the sequence is contiguous.
+        ++pos;
+        check_premature(pos);
+        std::size_t seq_start = pos, seq_end = pos;
+        while (1) {
+            auto newline = find_newline(pos);
+            check_premature(newline + 1);
+
+            if (seq_end != pos) {
+                std::memmove(my_data + seq_end, my_data + pos, newline - pos);
+            }
+            seq_end += newline - pos;
+
+            pos = newline + 1;
+            if (my_data[pos] == '+') {
+                break;
+            }
+        }
+        my_sequence.first = my_data + seq_start;
+        my_sequence.second = my_data + seq_end;
+        ++my_line_count;
+
+        // Line 3 should be a single line; starting with '+' is implicit from above.
+        pos = find_newline(pos);
+        check_premature(pos);
+        ++my_line_count;
+
+        // Processing the qualities, checking at each newline whether we've reached the sequence length.
+        std::size_t seq_length = seq_end - seq_start, qual_length = 0;
+        ++pos;
+        while (pos < my_length) {
+            auto newline = find_newline(pos);
+            qual_length += newline - pos;
+            pos = newline + 1;
+            if (qual_length >= seq_length) {
+                break;
+            }
+        }
+
+        if (qual_length != seq_length) {
+            throw std::runtime_error("non-equal lengths for quality and sequence strings (starting line " + std::to_string(init_line + 1) + ")");
+        }
+
+        ++my_line_count;
+        my_position = (pos < my_length ? pos : my_length);
+        return true;
+    }
+
+public:
+    /**
+     * @return Pointers to the start and one-past-the-end of the sequence for the current read.
+     * This should only be called if `operator()` returns true.
+     * The pointers remain valid for the lifetime of this `MappedFastqReader` instance.
+     */
+    std::pair<const char*, const char*> get_sequence() const {
+        return my_sequence;
+    }
+
+    /**
+     * @return Pointers to the start and one-past-the-end of the name for the current read.
+     * Note that the name is considered to end at the first whitespace on the line.
+     * This should only be called if `operator()` returns true.
+     * The pointers remain valid for the lifetime of this `MappedFastqReader` instance.
+     */
+    std::pair<const char*, const char*> get_name() const {
+        return my_name;
+    }
+
+    /**
+     * @return Number of bytes consumed from the file.
+     * After a successful call to `operator()`, this is equal to the offset of the start of the next record, or the total length of the file if no more records are available.
+     */
+    unsigned long long position() const {
+        return my_position;
+    }
+
+    /**
+     * Move to an offset in the file, typically one that was previously reported by `position()`, e.g., when resuming from a `ProcessDataCheckpoint`.
+     * The next call to `operator()` will then extract the record starting at `offset`.
+     * Line numbers in subsequent error messages are counted from `offset`.
+     *
+     * @param offset Offset of the start of a record, or the length of the file.
+     */
+    void seek(unsigned long long offset) {
+        if (offset > my_length) {
+            throw std::runtime_error("offset is beyond the end of the file");
+        }
+        my_position = offset;
+        my_line_count = 0;
+    }
+};
+
+}
+
+#endif
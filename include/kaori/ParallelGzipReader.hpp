@@ -0,0 +1,502 @@
+#ifndef KAORI_PARALLEL_GZIP_READER_HPP
+#define KAORI_PARALLEL_GZIP_READER_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <stdexcept>
+#include <exception>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+
+#include "zlib.h"
+
+#include "byteme/byteme.hpp"
+
+#include "Executor.hpp"
+
+/**
+ * @file ParallelGzipReader.hpp
+ *
+ * @brief Defines the `ParallelGzipReader` class.
+ *
+ * This header is not included by `kaori.hpp` as it requires linking to Zlib.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Options for `ParallelGzipReader`.
+ */
+struct ParallelGzipReaderOptions {
+    /**
+     * Number of threads to use for decompressing members.
+     * If `executor` is provided, this should be set to the number of tasks that it can run concurrently.
+     */
+    int num_threads = 1;
+
+    /**
+     * Pointer to an `Executor` that runs the decompression tasks, e.g., to use an existing thread pool in the caller's application.
+     * This should not be used by any other thread while `ParallelGzipReader::read()` is running, as `Executor::submit()` must only be called from one thread at a time.
+     * If `NULL` and `num_threads > 1`, a `DefaultExecutor` with `num_threads` threads is created upon the first parallel decompression and reused for the lifetime of the reader.
+     */
+    Executor* executor = NULL;
+
+    /**
+     * Size of each window of compressed data, in bytes.
+     * Members within each window are decompressed in parallel.
+     * Larger values improve parallelization at the cost of memory usage, as the decompressed contents of each window are held in memory.
+     * Members that do not fit into a window are decompressed serially.
+     */
+    std::size_t window_size = 16777216;
+
+    /**
+     * Size of the buffer for reading compressed data when decompressing a member serially.
+     */
+    std::size_t buffer_size = 65536;
+};
+
+/**
+ * @brief Decompress a multi-member Gzip file in parallel.
+ *
+ * Many pipelines produce Gzip files that consist of multiple concatenated members, e.g., BGZF files or the output of `cat`-ing several Gzip files.
+ * Each member can be decompressed independently, allowing us to parallelize the decompression across threads.
+ * The decompressed contents are returned in their original order, so this class can be used as a drop-in byte source for `FastqReader`, `process_single_end_data()`, etc.
+ *
+ * The file is processed in windows of compressed bytes.
+ * In each window, we identify the start of each member by following the block sizes in the BGZF headers, if present.
+ * Otherwise, we scan for the Gzip magic bytes to identify candidate member starts.
+ * Candidates are speculatively decompressed in parallel, a few at a time per thread, and we check that each member ends exactly at the start of the next member;
+ * false candidates are thus ignored, guaranteeing that the output is the same as that of a serial decompression.
+ * If a member does not fit in a window, or if the window only contains a single non-BGZF member (e.g., a file consisting of a single large member), it is decompressed serially.
+ * Parallel decompression is performed by tasks on a `ParallelGzipReaderOptions::executor`, or on a pool of worker threads that is reused for all windows.
+ *
+ * The output buffer for each member is sized from the `ISIZE` field of its BGZF footer, if available, and is otherwise grown as needed.
+ * Thus, the memory usage is roughly equal to the decompressed size of one window.
+ * As with `gzip`, any trailing bytes after the last member that do not form a Gzip header (e.g., zero padding) are ignored.
+ */
+class ParallelGzipReader final : public byteme::Reader {
+public:
+    /**
+     * @param path Path to a Gzip-compressed file.
+     * @param options Further options.
+     */
+    ParallelGzipReader(const char* path, const ParallelGzipReaderOptions& options) :
+        my_file(path, std::ios::binary),
+        my_num_threads(std::max(options.num_threads, 1)),
+        my_executor(options.executor),
+        my_window_size(std::min<std::size_t>(std::max<std::size_t>(options.window_size, 1), std::numeric_limits<uInt>::max())),
+        my_buffer_size(std::min<std::size_t>(std::max<std::size_t>(options.buffer_size, 1), std::numeric_limits<uInt>::max()))
+    {
+        if (!my_file) {
+            throw std::runtime_error("failed to open file at '" + std::string(path) + "'");
+        }
+        my_file.seekg(0, std::ios::end);
+        my_file_size = my_file.tellg();
+    }
+
+    /**
+     * @cond
+     */
+    ParallelGzipReader(const ParallelGzipReader&) = delete;
+    ParallelGzipReader& operator=(const ParallelGzipReader&) = delete;
+
+    ~ParallelGzipReader() {
+        if (my_serial) {
+            inflateEnd(&my_zstream);
+        }
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    std::ifstream my_file;
+    unsigned long long my_file_size = 0;
+    unsigned long long my_offset = 0; // start of the next member to be decompressed.
+
+    int my_num_threads;
+    Executor* my_executor;
+    std::unique_ptr<DefaultExecutor> my_own_executor;
+    std::size_t my_window_size;
+    std::size_t my_buffer_size;
+
+    // Decompressed members from the current window.
+    std::vector<std::vector<unsigned char> > my_outputs;
+    std::size_t my_output_index = 0;
+    std::size_t my_output_offset = 0;
+
+    // Serial decompression of a member that does not fit in a window.
+    bool my_serial = false;
+    z_stream my_zstream;
+    unsigned long long my_serial_start = 0;
+    std::vector<unsigned char> my_serial_input;
+
+    std::size_t my_peak_buffered = 0;
+
+    enum class MemberStatus : char { COMPLETE, INCOMPLETE, ERROR };
+
+    struct MemberResult {
+        MemberStatus status = MemberStatus::ERROR;
+        std::size_t consumed = 0;
+        std::vector<unsigned char> output;
+    };
+
+private:
+    static bool is_gzip_header(const unsigned char* ptr, std::size_t available) {
+        // Magic bytes, DEFLATE compression, and reserved flag bits must be zero.
+        return available >= 10 && ptr[0] == 0x1f && ptr[1] == 0x8b && ptr[2] == 8 && (ptr[3] & 0xe0) == 0;
+    }
+
+    static std::size_t bgzf_block_size(const unsigned char* ptr, std::size_t available) {
+        if (!is_gzip_header(ptr, available) || (ptr[3] & 0x04) == 0 || available < 12) {
+            return 0;
+        }
+
+        std::size_t xlen = ptr[10] | (static_cast<std::size_t>(ptr[11]) << 8);
+        std::size_t pos = 12, end = 12 + xlen;
+        if (end > available) {
+            return 0;
+        }
+
+        while (pos + 4 <= end) {
+            std::size_t slen = ptr[pos + 2] | (static_cast<std::size_t>(ptr[pos + 3]) << 8);
+            if (ptr[pos] == 'B' && ptr[pos + 1] == 'C' && slen == 2 && pos + 6 <= end) {
+                return (ptr[pos + 4] | (static_cast<std::size_t>(ptr[pos + 5]) << 8)) + 1;
+            }
+            pos += 4 + slen;
+        }
+
+        return 0;
+    }
+
+    static std::size_t guess_output_size(const unsigned char* start, std::size_t available) {
+        // Using the ISIZE from the footer of a BGZF member, capped by the maximum compression ratio of DEFLATE in case it is corrupted.
+        auto bsize = bgzf_block_size(start, available);
+        if (bsize >= 26 && bsize <= available) {
+            const unsigned char* footer = start + bsize - 4;
+            std::size_t isize = footer[0] | (static_cast<std::size_t>(footer[1]) << 8) | (static_cast<std::size_t>(footer[2]) << 16) | (static_cast<std::size_t>(footer[3]) << 24);
+            return std::max<std::size_t>(std::min(isize, bsize * 1032), 1);
+        }
+
+        // Otherwise, starting small and growing as needed, as most candidates will be short members or false starts.
+        return std::min<std::size_t>(std::max<std::size_t>(available * 4, 1024), 65536);
+    }
+
+    static void inflate_member(const unsigned char* start, std::size_t available, MemberResult& result) {
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.next_in = const_cast<Bytef*>(start);
+        strm.avail_in = available;
+        if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("failed to initialize Gzip decompression");
+        }
+
+        auto& output = result.output;
+        output.resize(guess_output_size(start, available));
+        strm.next_out = output.data();
+        strm.avail_out = output.size();
+
+        while (1) {
+            int ret = inflate(&strm, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                result.status = MemberStatus::COMPLETE;
+                break;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                result.status = MemberStatus::ERROR;
+                break;
+            }
+
+            if (strm.avail_out == 0) {
+                auto used = output.size();
+                output.resize(used * 2);
+                strm.next_out = output.data() + used;
+                strm.avail_out = output.size() - used;
+            } else if (strm.avail_in == 0) {
+                result.status = MemberStatus::INCOMPLETE;
+                break;
+            }
+        }
+
+        result.consumed = strm.total_in;
+        inflateEnd(&strm);
+
+        if (result.status == MemberStatus::COMPLETE) {
+            output.resize(strm.total_out);
+            output.shrink_to_fit();
+        } else {
+            std::vector<unsigned char>().swap(output); // not needed, so we might as well release the memory now.
+        }
+    }
+
+    void inflate_batch(const unsigned char* wptr, std::size_t window_length, const std::vector<std::size_t>& candidates, std::size_t first, std::vector<MemberResult>& results) {
+        std::size_t nbatch = results.size();
+        auto run = [&](std::size_t t) -> void {
+            for (std::size_t b = t; b < nbatch; b += my_num_threads) {
+                auto start = candidates[first + b];
+                inflate_member(wptr + start, window_length - start, results[b]);
+            }
+        };
+
+        std::size_t nthreads = std::min<std::size_t>(my_num_threads, nbatch);
+        if (nthreads == 1 && !my_executor) {
+            run(0);
+            return;
+        }
+
+        if (!my_executor) {
+            my_own_executor.reset(new DefaultExecutor(my_num_threads));
+            my_executor = my_own_executor.get();
+        }
+
+        // Counting our own tasks instead of using Executor::wait(), in case the executor is also running tasks for other parts of the application.
+        std::mutex mut;
+        std::condition_variable cv;
+        std::size_t remaining = nthreads;
+        std::vector<std::exception_ptr> errors(nthreads);
+        for (std::size_t t = 0; t < nthreads; ++t) {
+            my_executor->submit_to(t, [&,t]() -> void {
+                try {
+                    run(t);
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                }
+                std::lock_guard lck(mut);
+                --remaining;
+                if (remaining == 0) {
+                    cv.notify_one();
+                }
+            });
+        }
+
+        {
+            std::unique_lock lck(mut);
+            cv.wait(lck, [&]() -> bool { return remaining == 0; });
+        }
+        for (auto& err : errors) {
+            if (err) {
+                std::rethrow_exception(err);
+            }
+        }
+    }
+
+    void load_window() {
+        std::size_t window_length = std::min<unsigned long long>(my_window_size, my_file_size - my_offset);
+        std::vector<unsigned char> window(window_length);
+        my_file.clear();
+        my_file.seekg(my_offset);
+        my_file.read(reinterpret_cast<char*>(window.data()), window_length);
+        if (static_cast<std::size_t>(my_file.gcount()) != window_length) {
+            throw std::runtime_error("failed to read compressed data from the file");
+        }
+
+        const unsigned char* wptr = window.data();
+        if (!is_gzip_header(wptr, window_length)) {
+            // Following gzip in ignoring trailing garbage or padding after the last member.
+            if (my_offset > 0) {
+                my_offset = my_file_size;
+                return;
+            }
+            throw std::runtime_error("invalid Gzip header at byte " + std::to_string(my_offset));
+        }
+
+        // Identifying candidate member starts. The first candidate is always a
+        // true member start, and we can follow the BGZF block sizes from there.
+        // Otherwise, we fall back to scanning for the magic bytes.
+        std::vector<std::size_t> candidates(1, 0);
+        std::size_t current = 0;
+        while (1) {
+            auto bsize = bgzf_block_size(wptr + current, window_length - current);
+            if (bsize == 0) {
+                for (std::size_t i = current + 1; i < window_length; ++i) {
+                    if (is_gzip_header(wptr + i, window_length - i)) {
+                        candidates.push_back(i);
+                    }
+                }
+                break;
+            }
+
+            current += bsize;
+            if (current >= window_length || !is_gzip_header(wptr + current, window_length - current)) {
+                break;
+            }
+            candidates.push_back(current);
+        }
+
+        my_outputs.clear();
+        my_output_index = 0;
+        my_output_offset = 0;
+
+        // No point speculating if there's only one member of unknown size, e.g., a single-member file.
+        std::size_t ncandidates = candidates.size();
+        if (ncandidates == 1 && bgzf_block_size(wptr, window_length) == 0) {
+            start_serial();
+            return;
+        }
+
+        // Decompressing candidates in batches and walking along the chain of
+        // true members, starting from the first candidate. This limits the
+        // number of speculative outputs that are held in memory at once.
+        std::size_t batch_size = static_cast<std::size_t>(my_num_threads) * 4;
+        std::vector<MemberResult> results;
+        std::size_t position = 0, c = 0;
+
+        while (1) {
+            // Skipping false candidates inside the previous member. If the
+            // next candidate is not at the end of the previous member, we
+            // must be looking at trailing garbage, so we stop here and let the
+            // next window deal with it.
+            while (c < ncandidates && candidates[c] < position) {
+                ++c;
+            }
+            if (c == ncandidates || candidates[c] != position) {
+                break;
+            }
+
+            std::size_t first = c;
+            results.clear();
+            results.resize(std::min(batch_size, ncandidates - first));
+            inflate_batch(wptr, window_length, candidates, first, results);
+
+            std::size_t buffered = 0;
+            for (const auto& out : my_outputs) {
+                buffered += out.capacity();
+            }
+            for (const auto& res : results) {
+                buffered += res.output.capacity();
+            }
+            my_peak_buffered = std::max(my_peak_buffered, buffered);
+
+            std::size_t last = first + results.size();
+            bool incomplete = false;
+            for (; c < last; ++c) {
+                if (candidates[c] != position) {
+                    if (candidates[c] > position) {
+                        break;
+                    }
+                    continue;
+                }
+
+                auto& res = results[c - first];
+                if (res.status == MemberStatus::ERROR) {
+                    throw std::runtime_error("failed to decompress Gzip member at byte " + std::to_string(my_offset + position));
+                } else if (res.status == MemberStatus::INCOMPLETE) {
+                    incomplete = true;
+                    break;
+                }
+
+                my_outputs.push_back(std::move(res.output));
+                position += res.consumed;
+            }
+
+            if (incomplete) {
+                break;
+            }
+        }
+
+        if (position == 0) {
+            start_serial();
+        } else {
+            my_offset += position;
+        }
+    }
+
+    void start_serial() {
+        my_zstream.zalloc = Z_NULL;
+        my_zstream.zfree = Z_NULL;
+        my_zstream.opaque = Z_NULL;
+        my_zstream.next_in = Z_NULL;
+        my_zstream.avail_in = 0;
+        if (inflateInit2(&my_zstream, 16 + MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("failed to initialize Gzip decompression");
+        }
+
+        my_serial = true;
+        my_serial_start = my_offset;
+        my_serial_input.resize(my_buffer_size);
+        my_file.clear();
+        my_file.seekg(my_offset);
+    }
+
+    std::size_t read_serial(unsigned char* buffer, std::size_t n) {
+        my_zstream.next_out = buffer;
+        my_zstream.avail_out = n;
+
+        while (my_zstream.avail_out > 0) {
+            if (my_zstream.avail_in == 0) {
+                my_file.read(reinterpret_cast<char*>(my_serial_input.data()), my_serial_input.size());
+                std::size_t got = my_file.gcount();
+                if (got == 0) {
+                    throw std::runtime_error("premature end of the Gzip member at byte " + std::to_string(my_serial_start));
+                }
+                my_zstream.next_in = my_serial_input.data();
+                my_zstream.avail_in = got;
+            }
+
+            int ret = inflate(&my_zstream, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                my_offset = my_serial_start + my_zstream.total_in;
+                inflateEnd(&my_zstream);
+                my_serial = false;
+                break;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                throw std::runtime_error("failed to decompress Gzip member at byte " + std::to_string(my_serial_start));
+            }
+        }
+
+        return n - my_zstream.avail_out;
+    }
+
+public:
+    /**
+     * @return Peak number of bytes allocated for the decompressed members of a window, including speculative outputs for false candidates.
+     * This does not include serial decompression of members that do not fit in a window, which only uses the buffer supplied to `read()`.
+     */
+    std::size_t peak_buffered() const {
+        return my_peak_buffered;
+    }
+
+    /**
+     * @param[out] buffer Pointer to an array of length at least `n`, to be filled with decompressed bytes.
+     * @param n Number of bytes to read.
+     * @return Number of bytes that were filled in `buffer`.
+     * This is less than `n` if the end of the file was reached.
+     */
+    std::size_t read(unsigned char* buffer, std::size_t n) {
+        std::size_t copied = 0;
+
+        while (copied < n) {
+            if (my_output_index < my_outputs.size()) {
+                const auto& current = my_outputs[my_output_index];
+                auto to_copy = std::min(n - copied, current.size() - my_output_offset);
+                std::copy_n(current.data() + my_output_offset, to_copy, buffer + copied);
+                copied += to_copy;
+                my_output_offset += to_copy;
+                if (my_output_offset == current.size()) {
+                    ++my_output_index;
+                    my_output_offset = 0;
+                }
+            } else if (my_serial) {
+                copied += read_serial(buffer + copied, n - copied);
+            } else if (my_offset < my_file_size) {
+                load_window();
+            } else {
+                break;
+            }
+        }
+
+        return copied;
+    }
+};
+
+}
+
+#endif
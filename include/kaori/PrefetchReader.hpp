@@ -0,0 +1,189 @@
+#ifndef KAORI_PREFETCH_READER_HPP
+#define KAORI_PREFETCH_READER_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+#include "byteme/byteme.hpp"
+
+/**
+ * @file PrefetchReader.hpp
+ *
+ * @brief Defines the `PrefetchReader` class.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Read ahead from a byte source on a dedicated thread.
+ *
+ * This wraps an existing byte source, calling its `read()` method on a separate thread to fill a ring of blocks ahead of the consumer.
+ * The main use case is to overlap the decompression of Gzip-compressed FASTQ files with the parsing and processing of reads.
+ * The consumer (usually a `FastqReader`) then only needs to copy bytes out of the already-filled blocks.
+ *
+ * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
+ * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization.
+ * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object.
+ */
+template<typename Pointer_>
+class PrefetchReader final : public byteme::Reader {
+public:
+    /**
+     * @param source Pointer to the underlying source of input bytes.
+     * This should not be used by the caller while this `PrefetchReader` instance exists.
+     * @param block_size Size of each block, in bytes.
+     * @param num_blocks Number of blocks in the ring.
+     * Larger values allow the reading thread to get further ahead of the consumer, at the cost of increased memory usage.
+     */
+    PrefetchReader(Pointer_ source, std::size_t block_size, std::size_t num_blocks) :
+        my_source(std::move(source)),
+        my_blocks(std::max(num_blocks, static_cast<std::size_t>(1)), std::vector<unsigned char>(std::max(block_size, static_cast<std::size_t>(1)))),
+        my_filled(my_blocks.size())
+    {
+        my_thread = std::thread([this]() -> void { produce(); });
+    }
+
+    /**
+     * @cond
+     */
+    PrefetchReader(const PrefetchReader&) = delete;
+    PrefetchReader& operator=(const PrefetchReader&) = delete;
+
+    ~PrefetchReader() {
+        {
+            std::lock_guard lck(my_mut);
+            my_terminated = true;
+        }
+        my_cv.notify_all();
+        my_thread.join();
+    }
+    /**
+     * @endcond
+     */
+
+private:
+    Pointer_ my_source;
+    std::vector<std::vector<unsigned char> > my_blocks;
+    std::vector<std::size_t> my_filled;
+
+    std::mutex my_mut;
+    std::condition_variable my_cv;
+    std::size_t my_num_ready = 0; // number of filled blocks that are yet to be (fully) consumed.
+    bool my_finished = false;
+    bool my_terminated = false;
+    std::exception_ptr my_error;
+    std::thread my_thread;
+
+    // Only accessed by the consumer.
+    std::size_t my_read_block = 0;
+    std::size_t my_read_offset = 0;
+
+    void produce() {
+        std::size_t write_block = 0, nblocks = my_blocks.size();
+
+        while (1) {
+            {
+                std::unique_lock lck(my_mut);
+                my_cv.wait(lck, [&]() -> bool { return my_terminated || my_num_ready < nblocks; });
+                if (my_terminated) {
+                    return;
+                }
+            }
+
+            // We can safely fill the block without holding the lock, as the consumer won't touch it until it is marked as ready.
+            auto& block = my_blocks[write_block];
+            std::size_t filled = 0;
+            std::exception_ptr error;
+            try {
+                filled = my_source->read(block.data(), block.size());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            my_filled[write_block] = filled;
+
+            bool done = (error || filled < block.size());
+            {
+                std::lock_guard lck(my_mut);
+                ++my_num_ready;
+                if (done) {
+                    my_finished = true;
+                    my_error = error;
+                }
+            }
+            my_cv.notify_all();
+            if (done) {
+                return;
+            }
+
+            ++write_block;
+            if (write_block == nblocks) {
+                write_block = 0;
+            }
+        }
+    }
+
+public:
+    /**
+     * @param[out] buffer Pointer to an array of length at least `n`, to be filled with bytes from the source.
+     * @param n Number of bytes to read.
+     * @return Number of bytes that were filled in `buffer`.
+     * This is less than `n` if the end of the source was reached.
+     */
+    std::size_t read(unsigned char* buffer, std::size_t n) {
+        std::size_t copied = 0, nblocks = my_blocks.size();
+
+        while (copied < n) {
+            {
+                std::unique_lock lck(my_mut);
+                my_cv.wait(lck, [&]() -> bool { return my_num_ready > 0 || my_finished; });
+                if (my_num_ready == 0) {
+                    if (my_error) {
+                        std::rethrow_exception(my_error);
+                    }
+                    break;
+                }
+            }
+
+            const auto& block = my_blocks[my_read_block];
+            auto available = my_filled[my_read_block];
+            auto to_copy = std::min(n - copied, available - my_read_offset);
+            std::copy_n(block.data() + my_read_offset, to_copy, buffer + copied);
+            copied += to_copy;
+            my_read_offset += to_copy;
+
+            if (my_read_offset == available) {
+                my_read_offset = 0;
+                ++my_read_block;
+                if (my_read_block == nblocks) {
+                    my_read_block = 0;
+                }
+
+                bool last = false;
+                {
+                    std::lock_guard lck(my_mut);
+                    --my_num_ready;
+                    last = (my_finished && my_num_ready == 0);
+                }
+                my_cv.notify_all();
+
+                if (last) {
+                    if (my_error) {
+                        std::rethrow_exception(my_error);
+                    }
+                    break;
+                }
+            }
+        }
+
+        return copied;
+    }
+};
+
+}
+
+#endif
@@ -3,8 +3,14 @@
 
 #include <bitset>
 #include <vector>
+#include <array>
 #include <stdexcept>
 #include <string>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
 
 #include "utils.hpp"
 
@@ -28,16 +34,90 @@ namespace kaori {
  * Multiple locations on the read may match the template, provided `next()` is called repeatedly.
  * For efficiency, the search itself is done after converting all base sequences into a bit encoding.
  * The maximum size of this encoding is determined at compile-time by the `max_length` template parameter.
+ * Templates of up to 16 or 32 bases fit into one or two 64-bit words, respectively, which allows each position to be checked with a few shifts and popcounts.
+ *
+ * If `max_size_` is zero, the maximum size of the template is instead determined at runtime from the template sequence.
+ * This avoids the need to instantiate the class (and any handlers that use it) for a range of sizes when the template is not known at compile time.
+ * Templates of up to 32 bases are still checked with the same unrolled one- or two-word loops as the compile-time sizes,
+ * provided that the loop over positions is run inside `with_next()` so that the loop is only chosen once per read.
+ * Longer templates are stored on the heap, so callers should reuse a `State` across reads with the corresponding `initialize()` overload.
  *
  * Once a match is found, the sequence of the read at each variable region can be matched against a pool of known barcode sequences.
  * See other classes like `SimpleBarcodeSearch` and `SegmentedBarcodeSearch` for details.
  *
  * @tparam max_size_ Maximum length of the template sequence.
+ * This may be zero to determine the maximum length at runtime.
  */
 template<SeqLength max_size_>
 class ScanTemplate { 
 private:
     static constexpr SeqLength N = max_size_ * 4;
+    static constexpr bool runtime_size = (max_size_ == 0);
+
+    // Each base is one-hot encoded into 4 bits, so each word holds 16 bases.
+    // The least significant bits of the first word contain the most recent base.
+    typedef std::uint64_t Word;
+    static constexpr SeqLength bases_per_word = 16;
+    static constexpr SeqLength num_words = (max_size_ + bases_per_word - 1) / bases_per_word;
+
+    // For runtime-sized templates, hashes of up to two words are stored in-place to avoid allocations for short templates.
+    class RuntimeHash {
+    public:
+        RuntimeHash() = default;
+        RuntimeHash(SeqLength nwords) : my_large(nwords > small_words ? nwords : 0) {}
+
+        // Zeroes all words, reusing any existing heap storage.
+        void reset(SeqLength nwords) {
+            my_small.fill(0);
+            if (nwords > small_words) {
+                my_large.assign(nwords, 0);
+            } else {
+                my_large.clear();
+            }
+        }
+
+        Word* data() {
+            return (my_large.empty() ? my_small.data() : my_large.data());
+        }
+        const Word* data() const {
+            return (my_large.empty() ? my_small.data() : my_large.data());
+        }
+
+        // Direct access to the storage for a known number of words, where zero indicates that more than 'small_words' are in use.
+        // This avoids a branch in the inner loops and allows the compiler to assume that the heap storage does not alias the in-place storage.
+        template<SeqLength fixed_words_>
+        Word* fixed_data() {
+            if constexpr(fixed_words_ > 0) {
+                static_assert(fixed_words_ <= small_words);
+                return my_small.data();
+            } else {
+                return my_large.data();
+            }
+        }
+        template<SeqLength fixed_words_>
+        const Word* fixed_data() const {
+            if constexpr(fixed_words_ > 0) {
+                static_assert(fixed_words_ <= small_words);
+                return my_small.data();
+            } else {
+                return my_large.data();
+            }
+        }
+
+        Word& operator[](SeqLength i) {
+            return data()[i];
+        }
+        const Word& operator[](SeqLength i) const {
+            return data()[i];
+        }
+
+    private:
+        static constexpr SeqLength small_words = 2;
+        std::array<Word, small_words> my_small{};
+        std::vector<Word> my_large;
+    };
+
+    typedef typename std::conditional<runtime_size, RuntimeHash, std::array<Word, num_words> >::type Hash;
 
 public:
     /**
@@ -51,7 +131,7 @@ public:
      * Constant sequences should only contain `A`, `C`, `G` or `T` (or their lower-case equivalents).
      * Variable regions should be marked with `-`.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be positive and less than or equal to `max_size_`.
+     * This should be positive and less than or equal to `max_size_` (if the latter is non-zero).
      * @param strand Strand(s) of the read sequence to search.
      */
     ScanTemplate(const char* template_seq, SeqLength template_length, SearchStrand strand) :
@@ -59,20 +139,36 @@ public:
         my_forward(search_forward(strand)),
         my_reverse(search_reverse(strand))
     {
-        if (my_length > max_size_) {
-            throw std::runtime_error("maximum template size should be " + std::to_string(max_size_) + " bp");
+        if constexpr(!runtime_size) {
+            if (my_length > max_size_) {
+                throw std::runtime_error("maximum template size should be " + std::to_string(max_size_) + " bp");
+            }
         }
+        my_template.insert(my_template.end(), template_seq, template_seq + my_length);
+        my_num_words = std::max(static_cast<SeqLength>(1), (my_length + bases_per_word - 1) / bases_per_word);
+        my_num_constant = my_length - std::count(template_seq, template_seq + my_length, '-');
+        my_forward_ref = my_forward_mask = my_reverse_ref = my_reverse_mask = new_hash();
+
+        dispatch_words([&](auto fixed) -> void {
+            build<decltype(fixed)::value>(template_seq);
+        });
+    }
 
+private:
+    template<SeqLength fixed_words_>
+    void build(const char* template_seq) {
         if (my_forward) {
             for (SeqLength i = 0; i < my_length; ++i) {
                 char b = template_seq[i];
                 if (b != '-') {
-                    add_base_to_hash(my_forward_ref, b);
-                    add_mask_to_hash(my_forward_mask);
-                    my_forward_mask_ambiguous.set(i);
+                    add_base<fixed_words_>(my_forward_ref, b);
+                    add_other<fixed_words_>(my_forward_mask);
+                    if constexpr(!runtime_size) {
+                        my_forward_mask_ambiguous.set(my_length - i - 1); // bit 0 refers to the last base, see State::ambiguous.
+                    }
                 } else {
-                    shift_hash(my_forward_ref);
-                    shift_hash(my_forward_mask);
+                    shift<fixed_words_>(my_forward_ref);
+                    shift<fixed_words_>(my_forward_mask);
                     add_variable_base(my_forward_variables, i);
                 }
             }
@@ -90,12 +186,14 @@ public:
             for (SeqLength i = 0; i < my_length; ++i) {
                 char b = template_seq[my_length - i - 1];
                 if (b != '-') {
-                    add_base_to_hash(my_reverse_ref, complement_base(b));
-                    add_mask_to_hash(my_reverse_mask);
-                    my_reverse_mask_ambiguous.set(i);
+                    add_base<fixed_words_>(my_reverse_ref, complement_base(b));
+                    add_other<fixed_words_>(my_reverse_mask);
+                    if constexpr(!runtime_size) {
+                        my_reverse_mask_ambiguous.set(my_length - i - 1);
+                    }
                 } else {
-                    shift_hash(my_reverse_ref);
-                    shift_hash(my_reverse_mask);
+                    shift<fixed_words_>(my_reverse_ref);
+                    shift<fixed_words_>(my_reverse_mask);
                     add_variable_base(my_reverse_variables, i);
                 }
             }
@@ -134,11 +232,11 @@ public:
         /**
          * @cond
          */
-        std::bitset<N> state;
+        Hash state = Hash();
         const char * seq;
         SeqLength len;
 
-        std::bitset<N/4> ambiguous; // we only need a yes/no for the ambiguous state, so we can use a smaller bitset.
+        std::bitset<N/4> ambiguous; // we only need a yes/no for the ambiguous state, so we can use a smaller bitset. Not used for runtime-sized templates.
         SeqLength last_ambiguous; // contains the position of the most recent ambiguous base; should only be read if any_ambiguous = true.
         bool any_ambiguous = false; // indicates whether ambiguous.count() > 0.
         /**
@@ -151,61 +249,121 @@ public:
      *
      * @param[in] read_seq Pointer to an array containing the read sequence.
      * @param read_length Length of the read sequence.
+     * @param start Position on the read at which to start the search.
+     * This can be used to quickly check the template at a likely position on the read, without scanning all preceding positions.
      *
      * @return An empty state object.
      * If its `finished` member is `false`, it should be passed to `next()` before accessing its other members.
-     * If `true`, the read sequence was too short for any match to be found.
+     * If `true`, the read sequence was too short for any match to be found at or after `start`.
      */
-    State initialize(const char* read_seq, SeqLength read_length) const {
+    State initialize(const char* read_seq, SeqLength read_length, SeqLength start = 0) const {
         State out;
-        out.seq = read_seq;
-        out.len = read_length;
-
-        if (my_length <= read_length) {
-            for (SeqLength i = 0; i < my_length - 1; ++i) {
-                char base = read_seq[i];
-
-                if (is_standard_base(base)) {
-                    add_base_to_hash(out.state, base);
-
-                    if (out.any_ambiguous) {
-                        out.ambiguous <<= 1;
-                    }
-                } else {
-                    add_other_to_hash(out.state);
+        initialize(read_seq, read_length, out, start);
+        return out;
+    }
 
-                    if (out.any_ambiguous) {
-                        out.ambiguous <<= 1;
-                    } else {
-                        out.any_ambiguous = true;
-                    }
-                    out.ambiguous.set(0);
-                    out.last_ambiguous = i;
-                }
+    /**
+     * Begin a new search for the template in a read sequence, reusing an existing state object.
+     * This is equivalent to the other `initialize()` overload but avoids a heap allocation per read for runtime-sized templates of more than 32 bases.
+     *
+     * @param[in] read_seq Pointer to an array containing the read sequence.
+     * @param read_length Length of the read sequence.
+     * @param[out] state A state object, typically from a search on a previous read.
+     * On output, this is filled with an empty state as described for the other `initialize()` overload.
+     * @param start Position on the read at which to start the search.
+     */
+    void initialize(const char* read_seq, SeqLength read_length, State& state, SeqLength start = 0) const {
+        state.seq = read_seq;
+        state.len = read_length;
+        state.position = start - 1; // overflows to -1 for start = 0, see State::position.
+        state.forward_mismatches = 0;
+        state.reverse_mismatches = 0;
+        state.any_ambiguous = false;
+
+        if (start <= read_length && my_length <= read_length - start) {
+            state.finished = false;
+            if constexpr(runtime_size) {
+                state.state.reset(my_num_words);
+            } else {
+                state.state = Hash();
+                state.ambiguous.reset();
             }
+            dispatch_words([&](auto fixed) -> void {
+                initialize_internal<decltype(fixed)::value>(state, start);
+            });
         } else {
-            out.finished = true;
+            state.finished = true;
         }
-
-        return out;
     }
 
     /**
      * Find the next match in the read sequence.
-     * The first invocation will search for a match at position 0;
+     * The first invocation will search for a match at the `start` position used in `initialize()`, i.e., position 0 by default;
      * this can be repeatedly called until `match.finished` is `true`.
      *
      * @param state A state object produced by `initialize()`.
      * On return, `state` is updated with the details of the current match at a particular position on the read sequence.
      */
     void next(State& state) const {
+        dispatch_words([&](auto fixed) -> void {
+            next_internal<decltype(fixed)::value>(state);
+        });
+    }
+
+    /**
+     * Call a function with a replacement for `next()` that is specialized for the length of the template.
+     * For runtime-sized templates, `next()` needs to choose the appropriate kernel at every position;
+     * this can be avoided by running the entire loop over positions inside `fun`, such that the kernel is only chosen once.
+     * For compile-time sizes, this is equivalent to calling `next()` directly.
+     *
+     * @tparam Function_ Function that accepts a single argument `step`, where `step(state)` is equivalent to `next(state)` for any `State` object `state`.
+     * @param fun Function to call.
+     * @return The return value of `fun`.
+     */
+    template<class Function_>
+    decltype(auto) with_next(Function_ fun) const {
+        return dispatch_words([&](auto fixed) -> decltype(auto) {
+            return fun([this](State& state) -> void {
+                next_internal<decltype(fixed)::value>(state);
+            });
+        });
+    }
+
+private:
+    template<SeqLength fixed_words_>
+    void initialize_internal(State& out, SeqLength start) const {
+        for (SeqLength i = start, end = start + my_length - 1; i < end; ++i) {
+            auto code = base_code(out.seq[i]);
+
+            if (code) {
+                add_code<fixed_words_>(out.state, code);
+
+                if (out.any_ambiguous) {
+                    shift_ambiguous(out);
+                }
+            } else {
+                add_other<fixed_words_>(out.state);
+
+                if (out.any_ambiguous) {
+                    shift_ambiguous(out);
+                } else {
+                    out.any_ambiguous = true;
+                }
+                set_ambiguous(out);
+                out.last_ambiguous = i;
+            }
+        }
+    }
+
+    template<SeqLength fixed_words_>
+    void next_internal(State& state) const {
         SeqLength right = state.position + my_length;
-        char base = state.seq[right];
+        auto code = base_code(state.seq[right]);
 
-        if (is_standard_base(base)) {
-            add_base_to_hash(state.state, base); // no need to trim off the end, the mask will handle that.
+        if (code) {
+            add_code<fixed_words_>(state.state, code); // no need to trim off the end, the mask will handle that.
             if (state.any_ambiguous) {
-                state.ambiguous <<= 1;
+                shift_ambiguous(state);
 
                 // If the last ambiguous position is equal to 'position', the
                 // ensuing increment to the latter will shift it out of the
@@ -216,19 +374,19 @@ public:
             }
 
         } else {
-            add_other_to_hash(state.state);
+            add_other<fixed_words_>(state.state);
 
             if (state.any_ambiguous) {
-                state.ambiguous <<= 1;
+                shift_ambiguous(state);
             } else {
                 state.any_ambiguous = true;
             }
-            state.ambiguous.set(0);
+            set_ambiguous(state);
             state.last_ambiguous = right;
         }
 
         ++state.position;
-        full_match(state);
+        full_match<fixed_words_>(state);
         if (right + 1 == state.len) {
             state.finished = true;
         }
@@ -236,46 +394,465 @@ public:
         return;
     }
 
+    // Runtime-sized templates don't track the ambiguous positions in a bitset, see strand_match().
+    static void shift_ambiguous(State& state) {
+        if constexpr(!runtime_size) {
+            state.ambiguous <<= 1;
+        }
+    }
+
+    static void set_ambiguous(State& state) {
+        if constexpr(!runtime_size) {
+            state.ambiguous.set(0);
+        }
+    }
+
+public:
+    /**
+     * @brief Candidate match from `scan()`.
+     */
+    struct Candidate {
+        /**
+         * Index of the read in the batch.
+         */
+        std::size_t read;
+
+        /**
+         * Position of the match to the template on the read sequence.
+         */
+        SeqLength position;
+
+        /**
+         * Number of mismatches on the forward strand at `position`.
+         * This should only be used if the forward strand is searched.
+         */
+        int forward_mismatches;
+
+        /**
+         * Number of mismatches on the reverse strand at `position`.
+         * This should only be used if the reverse strand is searched.
+         */
+        int reverse_mismatches;
+    };
+
+    /**
+     * Number of reads that are scanned together in `scan()`.
+     */
+    static constexpr std::size_t batch_lanes = 16;
+
+    /**
+     * Scan a batch of reads for all positions that match the template.
+     * This reports the same positions and mismatches as repeated calls to `next()` for each read,
+     * but groups of `batch_lanes` reads are processed together so that the compiler can vectorize the calculation across reads.
+     *
+     * @param reads Pointer to an array of length `num_reads`, containing the start and one-past-the-end of each read sequence.
+     * @param num_reads Number of reads in the batch.
+     * @param max_mismatches Maximum number of mismatches in the constant regions.
+     * @param[out] candidates Vector of candidate matches, i.e., positions where the number of mismatches on any searched strand is no greater than `max_mismatches`.
+     * On output, this is sorted by read and then by position.
+     */
+    void scan(const std::pair<const char*, const char*>* reads, std::size_t num_reads, int max_mismatches, std::vector<Candidate>& candidates) const {
+        candidates.clear();
+        dispatch_words([&](auto fixed) -> void {
+            for (std::size_t start = 0; start < num_reads; start += batch_lanes) {
+                std::size_t nlanes = std::min(batch_lanes, num_reads - start);
+                scan_lanes<decltype(fixed)::value>(reads + start, nlanes, start, max_mismatches, candidates);
+            }
+        });
+    }
+
 private:
-    std::bitset<N> my_forward_ref, my_forward_mask;
-    std::bitset<N> my_reverse_ref, my_reverse_mask;
+    // Unlike next(), ambiguous bases in the read are encoded as all-zero, which never match the one-hot reference.
+    // The number of mismatches is then just the number of constant bases minus the popcount of 'state & ref',
+    // so we don't need to track the ambiguous positions or apply the mask.
+    template<SeqLength fixed_words_>
+    void scan_lanes(const std::pair<const char*, const char*>* reads, std::size_t nlanes, std::size_t offset, int max_mismatches, std::vector<Candidate>& candidates) const {
+        constexpr std::size_t L = batch_lanes;
+        const SeqLength nwords = words_used<fixed_words_>();
+
+        std::array<const char*, L> seqs;
+        std::array<SeqLength, L> lengths;
+        SeqLength longest = 0;
+        for (std::size_t l = 0; l < L; ++l) {
+            if (l < nlanes) {
+                seqs[l] = reads[l].first;
+                lengths[l] = reads[l].second - reads[l].first;
+            } else {
+                seqs[l] = NULL;
+                lengths[l] = 0;
+            }
+            longest = std::max(longest, lengths[l]);
+        }
+        if (longest < my_length) {
+            return;
+        }
+
+        constexpr SeqLength stored_words = (fixed_words_ ? fixed_words_ : num_words);
+        typename std::conditional<stored_words == 0, std::vector<std::array<Word, L> >, std::array<std::array<Word, L>, stored_words> >::type states{};
+        if constexpr(stored_words == 0) {
+            states.resize(nwords);
+        }
+        std::array<int, L> fmm{}, rmm{};
+        std::array<Word, L> codes;
+        auto first = candidates.size();
+
+        for (SeqLength r = 0; r < longest; ++r) {
+            for (std::size_t l = 0; l < L; ++l) {
+                codes[l] = (r < lengths[l] ? base_code(seqs[l][r]) : 0);
+            }
+
+            for (SeqLength w = nwords - 1; w > 0; --w) {
+                auto& current = states[w];
+                const auto& previous = states[w - 1];
+                for (std::size_t l = 0; l < L; ++l) {
+                    current[l] = (current[l] << 4) | (previous[l] >> 60);
+                }
+            }
+            for (std::size_t l = 0; l < L; ++l) {
+                states[0][l] = (states[0][l] << 4) | codes[l];
+            }
+
+            if (r + 1 < my_length) {
+                continue;
+            }
+
+            if (my_forward) {
+                lane_mismatches(states, nwords, my_forward_ref, fmm);
+            }
+            if (my_reverse) {
+                lane_mismatches(states, nwords, my_reverse_ref, rmm);
+            }
+
+            SeqLength position = r + 1 - my_length;
+            for (std::size_t l = 0; l < nlanes; ++l) {
+                if (r < lengths[l] && ((my_forward && fmm[l] <= max_mismatches) || (my_reverse && rmm[l] <= max_mismatches))) {
+                    candidates.push_back(Candidate{ offset + l, position, fmm[l], rmm[l] });
+                }
+            }
+        }
+
+        // Candidates were added in order of position, so we need to regroup them by read.
+        std::stable_sort(candidates.begin() + first, candidates.end(), [](const Candidate& left, const Candidate& right) -> bool { return left.read < right.read; });
+    }
+
+    template<class States_, class Counts_>
+    void lane_mismatches(const States_& states, SeqLength nwords, const Hash& ref, Counts_& mismatches) const {
+        constexpr std::size_t L = batch_lanes;
+        for (std::size_t l = 0; l < L; ++l) {
+            mismatches[l] = my_num_constant;
+        }
+        for (SeqLength w = 0; w < nwords; ++w) {
+            const auto& current = states[w];
+            auto rw = ref[w];
+            for (std::size_t l = 0; l < L; ++l) {
+                mismatches[l] -= popcount(current[l] & rw);
+            }
+        }
+    }
+
+public:
+    /**
+     * Build an index of exact "anchors" from the constant regions of the template, for use in `anchor_positions()`.
+     * If a position on the read has no more than `max_mismatches` mismatches to the constant regions,
+     * at least one of `max_mismatches + 1` disjoint substrings of the constant regions must be exactly present in the read (i.e., the pigeonhole principle).
+     * These substrings are used as anchors to identify candidate positions without evaluating the template at every position of the read.
+     *
+     * Anchors are most effective when `max_mismatches` is small relative to the length of the constant regions.
+     * If the constant regions are too short to provide anchors of length `min_anchor_length`, no anchors are built.
+     *
+     * @param max_mismatches Maximum number of mismatches in the constant regions.
+     * @param min_anchor_length Minimum length of each anchor.
+     * Shorter anchors are not used as they are expected to match too many positions on the read.
+     *
+     * @return Whether anchors were built.
+     * If `false`, `anchor_positions()` should not be used.
+     */
+    bool build_anchors(int max_mismatches, SeqLength min_anchor_length = 6) {
+        my_anchors.clear();
+        my_anchor_length = 0;
+        if (max_mismatches < 0) {
+            return false;
+        }
+
+        std::vector<std::pair<SeqLength, SeqLength> > runs; // start and length of each constant run.
+        for (SeqLength i = 0; i < my_length; ++i) {
+            if (my_template[i] == '-') {
+                continue;
+            }
+            if (!runs.empty() && runs.back().first + runs.back().second == i) {
+                ++(runs.back().second);
+            } else {
+                runs.emplace_back(i, 1);
+            }
+        }
+
+        // Finding the longest anchor length that gives us enough disjoint anchors.
+        std::size_t num_anchors = static_cast<std::size_t>(max_mismatches) + 1;
+        SeqLength anchor_length = std::min(my_length, max_anchor_length);
+        for (; anchor_length >= min_anchor_length && anchor_length > 0; --anchor_length) {
+            std::size_t available = 0;
+            for (const auto& run : runs) {
+                available += run.second / anchor_length;
+            }
+            if (available >= num_anchors) {
+                break;
+            }
+        }
+        if (anchor_length < min_anchor_length || anchor_length == 0) {
+            return false;
+        }
+
+        my_anchor_length = anchor_length;
+        std::string revcomp;
+        if (my_reverse) {
+            revcomp.insert(revcomp.end(), my_template.rbegin(), my_template.rend());
+            for (auto& b : revcomp) {
+                if (b != '-') {
+                    b = complement_base(b);
+                }
+            }
+        }
+
+        std::size_t added = 0;
+        for (const auto& run : runs) {
+            for (SeqLength start = run.first, end = run.first + run.second; start + anchor_length <= end && added < num_anchors; start += anchor_length, ++added) {
+                if (my_forward) {
+                    add_anchor(my_template, start);
+                }
+                if (my_reverse) {
+                    // Each forward anchor corresponds to a disjoint anchor in the reverse complement.
+                    add_anchor(revcomp, my_length - start - anchor_length);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Find candidate positions of the template on a read sequence, using the anchors from `build_anchors()`.
+     * Every position where the number of mismatches to the constant regions (on any searched strand) is no greater than `max_mismatches` in `build_anchors()` is guaranteed to be reported.
+     * Some of the reported positions may have more mismatches, so each position should be confirmed with `initialize()` and `next()`.
+     *
+     * @param[in] read_seq Pointer to an array containing the read sequence.
+     * @param read_length Length of the read sequence.
+     * @param[out] positions Vector of candidate positions, sorted in increasing order without duplicates.
+     */
+    void anchor_positions(const char* read_seq, SeqLength read_length, std::vector<SeqLength>& positions) const {
+        positions.clear();
+        if (read_length < my_length || my_anchor_length == 0) {
+            return;
+        }
+
+        // Rolling 2-bit encoding of the most recent 'my_anchor_length' bases, 
+        // where 'valid' is the number of consecutive non-ambiguous bases.
+        const Word kmer_mask = (my_anchor_length == max_anchor_length ? static_cast<Word>(-1) : (static_cast<Word>(1) << (2 * my_anchor_length)) - 1);
+        const SeqLength last_start = read_length - my_length;
+        Word kmer = 0;
+        SeqLength valid = 0;
+
+        for (SeqLength r = 0; r < read_length; ++r) {
+            auto code = base_code(read_seq[r]);
+            if (code == 0) {
+                valid = 0;
+                continue;
+            }
+            kmer = ((kmer << 2) | two_bit_codes[code]) & kmer_mask;
+            ++valid;
+            if (valid < my_anchor_length) {
+                continue;
+            }
+
+            SeqLength kmer_start = r + 1 - my_anchor_length;
+            for (const auto& anchor : my_anchors) {
+                if (anchor.first == kmer && anchor.second <= kmer_start) {
+                    SeqLength candidate = kmer_start - anchor.second;
+                    if (candidate <= last_start) {
+                        positions.push_back(candidate);
+                    }
+                }
+            }
+        }
+
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    }
+
+    /**
+     * @return Length of the anchors from `build_anchors()`, or zero if no anchors were built.
+     */
+    SeqLength anchor_length() const {
+        return my_anchor_length;
+    }
+
+private:
+    static constexpr SeqLength max_anchor_length = 32; // so that each anchor fits into a single 64-bit word.
+
+    static constexpr std::array<unsigned char, 9> two_bit_codes = { 0, 0, 1, 0, 2, 0, 0, 0, 3 }; // one-hot code to 2-bit code.
+
+    void add_anchor(const std::string& tmpl, SeqLength start) {
+        Word kmer = 0;
+        for (SeqLength i = 0; i < my_anchor_length; ++i) {
+            kmer = (kmer << 2) | two_bit_codes[base_code(tmpl[start + i])];
+        }
+        my_anchors.emplace_back(kmer, start);
+    }
+
+    std::string my_template;
+    std::vector<std::pair<Word, SeqLength> > my_anchors; // 2-bit encoded anchor and its start position on the (reverse-complemented) template.
+    SeqLength my_anchor_length = 0;
+
+private:
+    Hash my_forward_ref = Hash(), my_forward_mask = Hash();
+    Hash my_reverse_ref = Hash(), my_reverse_mask = Hash();
     SeqLength my_length;
+    SeqLength my_num_words = 0; // number of words required for the template, which may be less than 'num_words'.
+    int my_num_constant = 0; // number of bases in the constant regions.
     bool my_forward, my_reverse;
 
     std::bitset<N/4> my_forward_mask_ambiguous; // we only need a yes/no for whether a position is an ambiguous base, so we can use a smaller bitset.
     std::bitset<N/4> my_reverse_mask_ambiguous;
 
-    static void add_mask_to_hash(std::bitset<N>& current) {
-        shift_hash(current);
-        current.set(0);
-        current.set(1);
-        current.set(2);
-        current.set(3);
-        return;
+    // Templates of up to 32 bases use a fixed number of words so that the compiler can unroll all loops.
+    // For larger templates, we only loop over the words that are actually required by the template;
+    // any bits beyond the template length are ignored by the mask.
+    // 'fun' is called with an std::integral_constant containing the fixed number of words, or zero if the number is only known at runtime.
+    template<class Function_>
+    decltype(auto) dispatch_words(Function_ fun) const {
+        if constexpr(runtime_size) {
+            if (my_num_words == 1) {
+                return fun(std::integral_constant<SeqLength, 1>());
+            } else if (my_num_words == 2) {
+                return fun(std::integral_constant<SeqLength, 2>());
+            } else {
+                return fun(std::integral_constant<SeqLength, 0>());
+            }
+        } else if constexpr(num_words <= 2) {
+            return fun(std::integral_constant<SeqLength, num_words>());
+        } else {
+            return fun(std::integral_constant<SeqLength, 0>());
+        }
+    }
+
+    template<SeqLength fixed_words_>
+    SeqLength words_used() const {
+        if constexpr(fixed_words_ > 0) {
+            return fixed_words_;
+        } else {
+            return my_num_words;
+        }
     }
 
-    static int strand_match(const State& match, const std::bitset<N>& ref, const std::bitset<N>& mask, const std::bitset<N/4>& mask_ambiguous) {
+    template<SeqLength fixed_words_, class Hash_>
+    static auto hash_data(Hash_& x) {
+        if constexpr(runtime_size) {
+            return x.template fixed_data<fixed_words_>();
+        } else {
+            return x.data();
+        }
+    }
+
+    Hash new_hash() const {
+        if constexpr(runtime_size) {
+            return Hash(my_num_words);
+        } else {
+            return Hash();
+        }
+    }
+
+    template<SeqLength fixed_words_>
+    void shift(Hash& x) const {
+        auto nwords = words_used<fixed_words_>();
+        auto ptr = hash_data<fixed_words_>(x);
+        for (SeqLength w = nwords - 1; w > 0; --w) {
+            ptr[w] = (ptr[w] << 4) | (ptr[w - 1] >> 60);
+        }
+        ptr[0] <<= 4;
+    }
+
+    // One-hot code for each standard base, or zero for all other characters.
+    static constexpr std::array<unsigned char, 256> base_codes = []() {
+        std::array<unsigned char, 256> output{};
+        output['A'] = output['a'] = 1;
+        output['C'] = output['c'] = 2;
+        output['G'] = output['g'] = 4;
+        output['T'] = output['t'] = 8;
+        return output;
+    }();
+
+    static Word base_code(char b) {
+        return base_codes[static_cast<unsigned char>(b)];
+    }
+
+    template<SeqLength fixed_words_>
+    void add_code(Hash& x, Word code) const {
+        shift<fixed_words_>(x);
+        hash_data<fixed_words_>(x)[0] |= code;
+    }
+
+    template<SeqLength fixed_words_>
+    void add_base(Hash& x, char b) const {
+        auto code = base_code(b);
+        if (code == 0) {
+            throw std::runtime_error("unknown base '" + std::string(1, b) + "'");
+        }
+        add_code<fixed_words_>(x, code);
+    }
+
+    template<SeqLength fixed_words_>
+    void add_other(Hash& x) const {
+        add_code<fixed_words_>(x, 15);
+    }
+
+    static int popcount(Word x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(x);
+#else
+        return std::bitset<64>(x).count();
+#endif
+    }
+
+    template<SeqLength fixed_words_>
+    int strand_match(const State& match, const Hash& ref, const Hash& mask, const std::bitset<N/4>& mask_ambiguous) const {
         // pop count here is equal to the number of non-ambiguous mismatches *
         // 2 + number of ambiguous mismatches * 3. This is because
         // non-ambiguous bases are encoded by 1 set bit per 4 bases (so 2 are
         // left after a XOR'd mismatch), while ambiguous mismatches are encoded
         // by all set bits per 4 bases (which means that 3 are left after XOR).
-        int pcount = ((match.state & mask) ^ ref).count(); 
+        int pcount = 0;
+        auto nwords = words_used<fixed_words_>();
+        auto sptr = hash_data<fixed_words_>(match.state);
+        auto rptr = hash_data<fixed_words_>(ref);
+        auto mptr = hash_data<fixed_words_>(mask);
+        for (SeqLength w = 0; w < nwords; ++w) {
+            pcount += popcount((sptr[w] & mptr[w]) ^ rptr[w]);
+        }
 
         if (match.any_ambiguous) {
-            int acount = (match.ambiguous & mask_ambiguous).count();
+            int acount = 0;
+            if constexpr(runtime_size) {
+                // Without a bitset, we count the ambiguous bases in the constant regions directly, i.e., the masked 4-bit codes with all bits set.
+                constexpr Word lowest_bits = 0x1111111111111111;
+                for (SeqLength w = 0; w < nwords; ++w) {
+                    Word x = sptr[w] & mptr[w];
+                    acount += popcount(x & (x >> 1) & (x >> 2) & (x >> 3) & lowest_bits);
+                }
+            } else {
+                acount = (match.ambiguous & mask_ambiguous).count();
+            }
             return (pcount - acount) / 2; // i.e., acount + (pcount - acount * 3) / 2;
         } else {
             return pcount / 2;
         }
     }
 
+    template<SeqLength fixed_words_>
     void full_match(State& match) const {
         if (my_forward) {
-            match.forward_mismatches = strand_match(match, my_forward_ref, my_forward_mask, my_forward_mask_ambiguous);
+            match.forward_mismatches = strand_match<fixed_words_>(match, my_forward_ref, my_forward_mask, my_forward_mask_ambiguous);
         }
         if (my_reverse) {
-            match.reverse_mismatches = strand_match(match, my_reverse_ref, my_reverse_mask, my_reverse_mask_ambiguous);
+            match.reverse_mismatches = strand_match<fixed_words_>(match, my_reverse_ref, my_reverse_mask, my_reverse_mask_ambiguous);
         }
     }
 
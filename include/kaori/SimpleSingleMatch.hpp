@@ -9,6 +9,9 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <utility>
+#include <cstddef>
+#include <algorithm>
 
 /**
  * @file SimpleSingleMatch.hpp
@@ -26,6 +29,7 @@ namespace kaori {
  * No restrictions are placed on the distribution of mismatches throughout the vector sequence.
  * 
  * @tparam max_size_ Maximum length of the template sequence.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class SimpleSingleMatch {
@@ -48,13 +52,37 @@ public:
          * Strand(s) of the read sequence to search.
          */
         SearchStrand strand = SearchStrand::FORWARD;
+
+        /**
+         * Likely positions of the template on the read, e.g., for amplicon libraries where the template starts at the same offset in most reads.
+         * If provided, `search_first()` will test these positions (in the given order) before falling back to a scan of the entire read.
+         * This reduces the cost of `search_first()` to a handful of template comparisons for most reads,
+         * at the cost of reporting a match at a likely position even if another valid match occurs earlier in the read.
+         */
+        std::vector<SeqLength> likely_offsets;
+
+        /**
+         * Number of matches from which to learn the likely positions of the template, if `likely_offsets` is empty.
+         * In each `State`, the positions of the first `learn_offsets` matches from `search_first()` are recorded,
+         * after which any position accounting for at least 10% of those matches is used as a likely position (see `likely_offsets`).
+         * If zero, no learning is performed.
+         */
+        int learn_offsets = 0;
+
+        /**
+         * Whether to only evaluate positions near exact matches to substrings of the constant regions, see `ScanTemplate::build_anchors()`.
+         * This avoids evaluating the template at every position of the read when `max_mismatches` is small relative to the length of the constant regions.
+         * Results are the same as a full scan of the read.
+         * If the constant regions are too short to build anchors, all positions are evaluated instead.
+         */
+        bool use_anchors = false;
     };
 
 public:
     /**
      * @param[in] template_seq Pointer to a character array containing the template sequence, see `ScanTemplate`.
      * @param template_length Length of the array pointed to by `barcode_length`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool Known sequences for the single variable region in `template_seq`.
      * @param options Optional parameters.
      */
@@ -67,7 +95,9 @@ public:
         my_forward(search_forward(options.strand)), 
         my_reverse(search_reverse(options.strand)),
         my_max_mm(options.max_mismatches),
-        my_constant(template_seq, template_length, options.strand)
+        my_constant(template_seq, template_length, options.strand),
+        my_likely_offsets(options.likely_offsets),
+        my_learn_offsets(my_likely_offsets.empty() ? std::max(options.learn_offsets, 0) : 0)
     {
         // Exact strandedness doesn't matter here, just need the number and length.
         const auto& regions = my_constant.forward_variable_regions();
@@ -75,6 +105,10 @@ public:
             throw std::runtime_error("expected one variable region in the constant template");
         }
 
+        if (options.use_anchors) {
+            my_use_anchors = my_constant.build_anchors(my_max_mm);
+        }
+
         SeqLength var_length = regions[0].second - regions[0].first;
         if (var_length != barcode_pool.length()) {
             throw std::runtime_error("length of barcode_pool sequences (" + std::to_string(barcode_pool.length()) + 
@@ -100,6 +134,9 @@ private:
     int my_max_mm;
     ScanTemplate<max_size_> my_constant;
     SimpleBarcodeSearch my_forward_lib, my_reverse_lib;
+    std::vector<SeqLength> my_likely_offsets;
+    int my_learn_offsets;
+    bool my_use_anchors = false;
 
 public:
     /**
@@ -143,6 +180,13 @@ public:
          */
         std::string buffer;
         typename SimpleBarcodeSearch::State forward_details, reverse_details;
+        std::vector<typename ScanTemplate<max_size_>::Candidate> candidates;
+        typename ScanTemplate<max_size_>::State scan; // reused across reads to avoid reallocation for long runtime-sized templates.
+
+        std::vector<SeqLength> anchor_positions;
+        std::vector<SeqLength> likely_offsets;
+        std::vector<int> offset_counts;
+        int num_learned = 0;
         /**
          * @endcond
          */
@@ -154,7 +198,9 @@ public:
      * @return A new `State` object.
      */
     State initialize() const {
-        return State();
+        State output;
+        output.likely_offsets = my_likely_offsets;
+        return output;
     }
 
     /**
@@ -174,42 +220,34 @@ public:
     }
 
 private:
-    void forward_match(const char* seq, const typename ScanTemplate<max_size_>::State& details, State& state) const {
-        auto start = seq + details.position;
+    void forward_match(const char* seq, SeqLength position, int const_mismatches, State& state) const {
+        auto start = seq + position;
         const auto& range = my_constant.forward_variable_regions()[0];
         state.buffer.clear();
         state.buffer.insert(state.buffer.end(), start + range.first, start + range.second);
-        my_forward_lib.search(state.buffer, state.forward_details, my_max_mm - details.forward_mismatches);
+        my_forward_lib.search(state.buffer, state.forward_details, my_max_mm - const_mismatches);
     }
 
-    void reverse_match(const char* seq, const typename ScanTemplate<max_size_>::State& details, State& state) const {
-        auto start = seq + details.position;
+    void reverse_match(const char* seq, SeqLength position, int const_mismatches, State& state) const {
+        auto start = seq + position;
         const auto& range = my_constant.reverse_variable_regions()[0];
         state.buffer.clear();
         state.buffer.insert(state.buffer.end(), start + range.first, start + range.second);
-        my_reverse_lib.search(state.buffer, state.reverse_details, my_max_mm - details.reverse_mismatches);
+        my_reverse_lib.search(state.buffer, state.reverse_details, my_max_mm - const_mismatches);
     }
 
-public:
-    /**
-     * Search a read for the first match to a valid vector sequence.
-     * A match is only reported if the number of mismatches of the vector sequence to the read is no greater than `max_mismatches` (see the constructor)
-     * and there is exactly one barcode sequence with the fewest mismatches to the read sequence at the variable region.
-     *
-     * @param[in] read_seq Pointer to a character array containing the read sequence.
-     * @param read_length Length of the read sequence.
-     * @param state State object, used to store the search result.
-     *
-     * @return Whether an appropriate match was found.
-     * If `true`, `state` is filled with the details of the first match.
-     */
-    bool search_first(const char* read_seq, SeqLength read_length, State& state) const {
-        auto deets = my_constant.initialize(read_seq, read_length);
+    // 'next' should be a function that sets the position and constant mismatches of the next candidate match on the read, returning false if there are no more candidates.
+    // This allows the same search logic to be used with candidates from ScanTemplate::next() or ScanTemplate::scan().
+    template<class Next_>
+    bool search_first_internal(const char* read_seq, Next_ next, State& state) const {
         bool found = false;
         state.index = STATUS_UNMATCHED;
         state.mismatches = 0;
         state.variable_mismatches = 0;
 
+        SeqLength position;
+        int forward_mismatches, reverse_mismatches;
+
         auto update = [&](bool rev, int const_mismatches, const typename SimpleBarcodeSearch::State& x) -> bool {
             if (!is_barcode_index_ok(x.index)) {
                 return false;
@@ -221,7 +259,7 @@ public:
             }
 
             found = true;
-            state.position = deets.position;
+            state.position = position;
             state.mismatches = total;
             state.reverse = rev;
             state.index = x.index;
@@ -229,19 +267,17 @@ public:
             return true;
         };
 
-        while (!deets.finished) {
-            my_constant.next(deets);
-
-            if (my_forward && deets.forward_mismatches <= my_max_mm) {
-                forward_match(read_seq, deets, state);
-                if (update(false, deets.forward_mismatches, state.forward_details)) {
+        while (next(position, forward_mismatches, reverse_mismatches)) {
+            if (my_forward && forward_mismatches <= my_max_mm) {
+                forward_match(read_seq, position, forward_mismatches, state);
+                if (update(false, forward_mismatches, state.forward_details)) {
                     break;
                 }
             }
 
-            if (my_reverse && deets.reverse_mismatches <= my_max_mm) {
-                reverse_match(read_seq, deets, state);
-                if (update(true, deets.reverse_mismatches, state.reverse_details)) {
+            if (my_reverse && reverse_mismatches <= my_max_mm) {
+                reverse_match(read_seq, position, reverse_mismatches, state);
+                if (update(true, reverse_mismatches, state.reverse_details)) {
                     break;
                 }
             }
@@ -250,24 +286,15 @@ public:
         return found;
     }
 
-    /**
-     * Search a read for the best match to a valid vector sequence. 
-     * This is slower than `search_first()` but will find the matching position with the fewest mismatches.
-     * If multiple positions are tied for the fewest mismatches, no match is reported.
-     *
-     * @param[in] read_seq Pointer to a character array containing the read sequence.
-     * @param read_length Length of the read sequence.
-     * @param state State object, used to store the search result.
-     *
-     * @return Whether a match was found.
-     * If `true`, `state` is filled with the details of the best match.
-     */
-    bool search_best(const char* read_seq, SeqLength read_length, State& state) const {
-        auto deets = my_constant.initialize(read_seq, read_length);
+    template<class Next_>
+    bool search_best_internal(const char* read_seq, Next_ next, State& state) const {
         state.index = STATUS_UNMATCHED;
         bool found = false;
         int best = my_max_mm + 1;
 
+        SeqLength position;
+        int forward_mismatches, reverse_mismatches;
+
         auto update = [&](bool rev, int const_mismatches, const typename SimpleBarcodeSearch::State& x) -> void {
             if (!is_barcode_index_ok(x.index)) {
                 return;
@@ -289,27 +316,200 @@ public:
                 state.index = x.index;
                 state.mismatches = total;
                 state.variable_mismatches = x.mismatches;
-                state.position = deets.position;
+                state.position = position;
                 state.reverse = rev;
             }
         };
 
-        while (!deets.finished) {
-            my_constant.next(deets);
+        while (next(position, forward_mismatches, reverse_mismatches)) {
+            if (my_forward && forward_mismatches <= my_max_mm) {
+                forward_match(read_seq, position, forward_mismatches, state);
+                update(false, forward_mismatches, state.forward_details);
+            }
 
-            if (my_forward && deets.forward_mismatches <= my_max_mm) {
-                forward_match(read_seq, deets, state);
-                update(false, deets.forward_mismatches, state.forward_details);
+            if (my_reverse && reverse_mismatches <= my_max_mm) {
+                reverse_match(read_seq, position, reverse_mismatches, state);
+                update(true, reverse_mismatches, state.reverse_details);
             }
+        }
 
-            if (my_reverse && deets.reverse_mismatches <= my_max_mm) {
-                reverse_match(read_seq, deets, state);
-                update(true, deets.reverse_mismatches, state.reverse_details);
+        return found;
+    }
+
+    // 'step' should be the specialized next() from ScanTemplate::with_next().
+    template<class Step_>
+    auto scan_next(const char* read_seq, SeqLength read_length, typename ScanTemplate<max_size_>::State& deets, Step_ step) const {
+        my_constant.initialize(read_seq, read_length, deets);
+        return [&deets,step](SeqLength& position, int& forward_mismatches, int& reverse_mismatches) mutable -> bool {
+            if (deets.finished) {
+                return false;
+            }
+            step(deets);
+            position = deets.position;
+            forward_mismatches = deets.forward_mismatches;
+            reverse_mismatches = deets.reverse_mismatches;
+            return true;
+        };
+    }
+
+    // Only tests the template at each of the specified offsets.
+    auto offset_next(const char* read_seq, SeqLength read_length, const std::vector<SeqLength>& offsets, typename ScanTemplate<max_size_>::State& deets) const {
+        return [this,read_seq,read_length,oIt=offsets.begin(),oEnd=offsets.end(),&deets](SeqLength& position, int& forward_mismatches, int& reverse_mismatches) mutable -> bool {
+            while (oIt != oEnd) {
+                my_constant.initialize(read_seq, read_length, deets, *oIt);
+                ++oIt;
+                if (!deets.finished) {
+                    my_constant.next(deets);
+                    position = deets.position;
+                    forward_mismatches = deets.forward_mismatches;
+                    reverse_mismatches = deets.reverse_mismatches;
+                    return true;
+                }
             }
+            return false;
+        };
+    }
+
+    void learn_offset(State& state) const {
+        if (state.offset_counts.size() <= state.position) {
+            state.offset_counts.resize(state.position + 1);
+        }
+        ++state.offset_counts[state.position];
+        ++state.num_learned;
+        if (state.num_learned < my_learn_offsets) {
+            return;
         }
 
+        for (SeqLength i = 0, end = state.offset_counts.size(); i < end; ++i) {
+            if (state.offset_counts[i] * 10 >= state.num_learned) {
+                state.likely_offsets.push_back(i);
+            }
+        }
+        std::stable_sort(state.likely_offsets.begin(), state.likely_offsets.end(), [&](SeqLength left, SeqLength right) -> bool {
+            return state.offset_counts[left] > state.offset_counts[right];
+        });
+        state.offset_counts.clear();
+        state.offset_counts.shrink_to_fit();
+    }
+
+    // Positions where the template cannot match are skipped if anchors are available.
+    template<class Function_>
+    bool search_all(const char* read_seq, SeqLength read_length, State& state, Function_ search) const {
+        if (my_use_anchors) {
+            my_constant.anchor_positions(read_seq, read_length, state.anchor_positions);
+            return search(offset_next(read_seq, read_length, state.anchor_positions, state.scan));
+        } else {
+            return my_constant.with_next([&](auto step) -> bool {
+                return search(scan_next(read_seq, read_length, state.scan, step));
+            });
+        }
+    }
+
+    bool use_offsets(const State& state) const {
+        return !state.likely_offsets.empty() || state.num_learned < my_learn_offsets;
+    }
+
+public:
+    /**
+     * Search a read for the first match to a valid vector sequence.
+     * A match is only reported if the number of mismatches of the vector sequence to the read is no greater than `max_mismatches` (see the constructor)
+     * and there is exactly one barcode sequence with the fewest mismatches to the read sequence at the variable region.
+     * If likely positions are available (see `Options::likely_offsets` and `Options::learn_offsets`), these are tested before scanning the entire read.
+     *
+     * @param[in] read_seq Pointer to a character array containing the read sequence.
+     * @param read_length Length of the read sequence.
+     * @param state State object, used to store the search result.
+     *
+     * @return Whether an appropriate match was found.
+     * If `true`, `state` is filled with the details of the first match.
+     */
+    bool search_first(const char* read_seq, SeqLength read_length, State& state) const {
+        if (!state.likely_offsets.empty()) {
+            if (search_first_internal(read_seq, offset_next(read_seq, read_length, state.likely_offsets, state.scan), state)) {
+                return true;
+            }
+        }
+
+        bool found = search_all(read_seq, read_length, state, [&](auto next) -> bool { return search_first_internal(read_seq, std::move(next), state); });
+        if (found && state.num_learned < my_learn_offsets) {
+            learn_offset(state);
+        }
         return found;
     }
+
+    /**
+     * Search a read for the best match to a valid vector sequence. 
+     * This is slower than `search_first()` but will find the matching position with the fewest mismatches.
+     * If multiple positions are tied for the fewest mismatches, no match is reported.
+     *
+     * @param[in] read_seq Pointer to a character array containing the read sequence.
+     * @param read_length Length of the read sequence.
+     * @param state State object, used to store the search result.
+     *
+     * @return Whether a match was found.
+     * If `true`, `state` is filled with the details of the best match.
+     */
+    bool search_best(const char* read_seq, SeqLength read_length, State& state) const {
+        return search_all(read_seq, read_length, state, [&](auto next) -> bool { return search_best_internal(read_seq, std::move(next), state); });
+    }
+
+    /**
+     * Search a batch of reads for the first or best match to a valid vector sequence.
+     * This gives the same results as calling `search_first()` or `search_best()` on each read,
+     * but uses `ScanTemplate::scan()` to find candidate positions for multiple reads at once.
+     *
+     * @tparam Function_ Function to be called for each read.
+     *
+     * @param reads Pointer to an array of length `num_reads`, containing the start and one-past-the-end of each read sequence.
+     * @param num_reads Number of reads.
+     * @param best Whether to search for the best match, as in `search_best()`.
+     * Otherwise, the first match is reported, as in `search_first()`.
+     * @param state State object, used to store the search result for each read.
+     * @param fun Function that accepts the index of the read in the batch, and a boolean indicating whether a match was found.
+     * This is called once for each read in increasing order of its index.
+     * If the boolean is true, `state` contains the details of the match for that read, as described for `search_first()` and `search_best()`.
+     */
+    template<class Function_>
+    void search_batch(const std::pair<const char*, const char*>* reads, std::size_t num_reads, bool best, State& state, Function_ fun) const {
+        if (my_use_anchors || (!best && use_offsets(state))) {
+            // Checking the anchors or likely offsets is already cheaper than scanning the whole read, so there's no point batching.
+            for (std::size_t r = 0; r < num_reads; ++r) {
+                auto len = reads[r].second - reads[r].first;
+                fun(r, best ? search_best(reads[r].first, len, state) : search_first(reads[r].first, len, state));
+            }
+            return;
+        }
+
+        auto& candidates = state.candidates;
+        my_constant.scan(reads, num_reads, my_max_mm, candidates);
+
+        auto cIt = candidates.begin(), cEnd = candidates.end();
+        for (std::size_t r = 0; r < num_reads; ++r) {
+            auto next = [&](SeqLength& position, int& forward_mismatches, int& reverse_mismatches) -> bool {
+                if (cIt == cEnd || cIt->read != r) {
+                    return false;
+                }
+                position = cIt->position;
+                forward_mismatches = cIt->forward_mismatches;
+                reverse_mismatches = cIt->reverse_mismatches;
+                ++cIt;
+                return true;
+            };
+
+            bool found;
+            if (best) {
+                found = search_best_internal(reads[r].first, next, state);
+            } else {
+                found = search_first_internal(reads[r].first, next, state);
+            }
+
+            // Skipping any remaining candidates for this read, e.g., after search_first() breaks early.
+            while (cIt != cEnd && cIt->read == r) {
+                ++cIt;
+            }
+            fun(r, found);
+        }
+    }
 };
 
 }
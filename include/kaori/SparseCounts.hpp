@@ -0,0 +1,96 @@
+#ifndef KAORI_SPARSE_COUNTS_HPP
+#define KAORI_SPARSE_COUNTS_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "utils.hpp"
+
+/**
+ * @file SparseCounts.hpp
+ *
+ * @brief Sparse accumulation of barcode counts.
+ */
+
+namespace kaori {
+
+/**
+ * @cond
+ */
+// Per-state counts for a pool of barcodes, tracking which barcodes were
+// touched so that transferring to the global counts only costs O(touched).
+// The dense array is only allocated on the first increment, so states that
+// are created but never see a match (e.g., idle threads) are cheap.
+class SparseCounts {
+public:
+    SparseCounts() = default;
+
+    SparseCounts(std::size_t n) : my_size(n) {}
+
+private:
+    std::size_t my_size = 0;
+    std::vector<Count> my_counts;
+    std::vector<BarcodeIndex> my_touched;
+
+public:
+    void increment(BarcodeIndex i) {
+        if (my_counts.empty()) {
+            my_counts.resize(my_size);
+        }
+        auto& current = my_counts[i];
+        if (current == 0) {
+            my_touched.push_back(i);
+        }
+        ++current;
+    }
+
+    Count operator[](BarcodeIndex i) const {
+        return (my_counts.empty() ? 0 : my_counts[i]);
+    }
+
+    std::size_t num_touched() const {
+        return my_touched.size();
+    }
+
+    // Pointer to the dense array, or NULL if it has not yet been allocated.
+    const Count* data() const {
+        return (my_counts.empty() ? NULL : my_counts.data());
+    }
+
+    // Adds all counts to 'dest' and resets this object, so that it can be reused for further accumulation.
+    void transfer(std::vector<Count>& dest) {
+        for (auto i : my_touched) {
+            auto& current = my_counts[i];
+            dest[i] += current;
+            current = 0;
+        }
+        my_touched.clear();
+    }
+
+    // Adds all counts from 'other' into this object and resets 'other'.
+    void merge(SparseCounts& other) {
+        if (other.my_touched.empty()) {
+            return;
+        }
+        if (my_counts.empty()) {
+            my_counts.resize(my_size);
+        }
+        for (auto i : other.my_touched) {
+            auto& current = my_counts[i];
+            if (current == 0) {
+                my_touched.push_back(i);
+            }
+            auto& incoming = other.my_counts[i];
+            current += incoming;
+            incoming = 0;
+        }
+        other.my_touched.clear();
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
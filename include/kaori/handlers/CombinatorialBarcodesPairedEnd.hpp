@@ -3,6 +3,7 @@
 
 #include "../SimpleSingleMatch.hpp"
 #include "../utils.hpp"
+#include "../serialize.hpp"
 
 #include <array>
 #include <vector>
@@ -25,6 +26,7 @@ namespace kaori {
  * This handler will capture the frequencies of each barcode combination. 
  *
  * @tparam max_size_ Maximum length of the template sequences on both reads.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class CombinatorialBarcodesPairedEnd {
@@ -74,12 +76,12 @@ public:
      * @param[in] template_seq1 Pointer to a character array containing the first template sequence. 
      * This should contain exactly one variable region.
      * @param template_length1 Length of the first template.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool1 Pool of known barcode sequences for the variable region in the first template.
      * @param[in] template_seq2 Pointer to a character array containing the second template sequence. 
      * This should contain exactly one variable region.
      * @param template_length2 Length of the second template.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool2 Pool of known barcode sequences for the variable region in the second template.
      * @param options Optional parameters.
      */
@@ -169,7 +171,21 @@ public:
         my_barcode2_only += s.barcode2_only;
     }
 
+    void merge(State& dest, State& src) const {
+        for (const auto& col : src.collected) {
+            dest.collected[col.first] += col.second;
+        }
+        src.collected.clear();
+        dest.total += src.total;
+        dest.barcode1_only += src.barcode1_only;
+        dest.barcode2_only += src.barcode2_only;
+        src.total = 0;
+        src.barcode1_only = 0;
+        src.barcode2_only = 0;
+    }
+
     constexpr static bool use_names = false;
+    static constexpr bool commutative = true;
     /**
      *@endcond
      */
@@ -292,6 +308,40 @@ public:
     BarcodeIndex get_barcode2_only() const {
         return my_barcode2_only;
     }
+
+    /**
+     * Save the counts for each combination of barcodes, along with the total number of read pairs and the number of pairs matching only one of the two barcodes.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_map(output, my_combinations);
+        save_value(output, my_total);
+        save_value(output, my_barcode1_only);
+        save_value(output, my_barcode2_only);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and totals.
+     * The handler should have been constructed with the same barcode pools as the saved handler.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        decltype(my_combinations) combinations;
+        load_map(input, combinations);
+        Count total, barcode1_only, barcode2_only;
+        load_value(input, total);
+        load_value(input, barcode1_only);
+        load_value(input, barcode2_only);
+
+        my_combinations.swap(combinations);
+        my_total = total;
+        my_barcode1_only = barcode1_only;
+        my_barcode2_only = barcode2_only;
+    }
 };
 
 }
@@ -4,6 +4,7 @@
 #include "../ScanTemplate.hpp"
 #include "../BarcodeSearch.hpp"
 #include "../utils.hpp"
+#include "../serialize.hpp"
 
 #include <array>
 #include <vector>
@@ -26,6 +27,7 @@ namespace kaori {
  * This handler will capture the frequencies of each barcode combination. 
  *
  * @tparam max_size_ Maximum length of the template sequences on both reads.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  * @tparam num_variable_ Number of variable regions in the construct.
  */
 template<SeqLength max_size_, int num_variable_>
@@ -61,7 +63,7 @@ public:
      * @param[in] template_seq Pointer to a character array containing the template sequence. 
      * This should contain exactly `num_variable_` variable regions.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pools Array containing the barcode pools for each of the variable regions, in the order of their appearance in the template sequence.
      * @param options Optional parameters.
      *
@@ -154,6 +156,7 @@ public:
 
         // Default constructors should be called in this case, so it should be fine.
         std::array<typename SimpleBarcodeSearch::State, num_variable_> forward_details, reverse_details;
+        typename ScanTemplate<max_size_>::State deets;
     };
     /**
      * @endcond
@@ -208,11 +211,13 @@ private:
     }
 
 private:
-    void process_first(State& state, const std::pair<const char*, const char*>& x) const {
-        auto deets = my_constant_matcher.initialize(x.first, x.second - x.first);
+    template<class Next_>
+    void process_first(State& state, const std::pair<const char*, const char*>& x, Next_ next) const {
+        auto& deets = state.deets;
+        my_constant_matcher.initialize(x.first, x.second - x.first, deets);
 
         while (!deets.finished) {
-            my_constant_matcher.next(deets);
+            next(deets);
 
             if (my_forward && deets.forward_mismatches <= my_max_mm) {
                 if (forward_match(x.first, deets, state).first) {
@@ -230,8 +235,10 @@ private:
         }
     }
 
-    void process_best(State& state, const std::pair<const char*, const char*>& x) const {
-        auto deets = my_constant_matcher.initialize(x.first, x.second - x.first);
+    template<class Next_>
+    void process_best(State& state, const std::pair<const char*, const char*>& x, Next_ next) const {
+        auto& deets = state.deets;
+        my_constant_matcher.initialize(x.first, x.second - x.first, deets);
         bool found = false;
         int best_mismatches = my_max_mm + 1;
         std::array<BarcodeIndex, num_variable_> best_id;
@@ -255,7 +262,7 @@ private:
         };
 
         while (!deets.finished) {
-            my_constant_matcher.next(deets);
+            next(deets);
 
             if (my_forward && deets.forward_mismatches <= my_max_mm) {
                 update(forward_match(x.first, deets, state));
@@ -298,16 +305,28 @@ public:
         return;
     }
 
-    void process(State& state, const std::pair<const char*, const char*>& x) const {
-        if (my_use_first) {
-            process_first(state, x);
-        } else {
-            process_best(state, x);
+    void merge(State& dest, State& src) const {
+        for (const auto& col : src.collected) {
+            dest.collected[col.first] += col.second;
         }
+        src.collected.clear();
+        dest.total += src.total;
+        src.total = 0;
+    }
+
+    void process(State& state, const std::pair<const char*, const char*>& x) const {
+        my_constant_matcher.with_next([&](auto next) -> void {
+            if (my_use_first) {
+                process_first(state, x, next);
+            } else {
+                process_best(state, x, next);
+            }
+        });
         ++state.total;
     }
 
     static constexpr bool use_names = false;
+    static constexpr bool commutative = true;
     /**
      * @endcond
      */
@@ -326,6 +345,34 @@ public:
     Count get_total() const {
         return my_total;
     }
+
+    /**
+     * Save the counts for each combination of barcodes, along with the total number of reads.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_map(output, my_combinations);
+        save_value(output, my_total);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and total.
+     * The handler should have been constructed with the same barcode pools as the saved handler.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        decltype(my_combinations) combinations;
+        load_map(input, combinations);
+        Count total;
+        load_value(input, total);
+
+        my_combinations.swap(combinations);
+        my_total = total;
+    }
 };
 
 }
@@ -4,6 +4,8 @@
 #include "../ScanTemplate.hpp"
 #include "../BarcodeSearch.hpp"
 #include "../utils.hpp"
+#include "../SparseCounts.hpp"
+#include "../serialize.hpp"
 
 /**
  * @file DualBarcodesPairedEnd.hpp
@@ -22,6 +24,7 @@ namespace kaori {
  * This handler will capture the frequencies of each barcode combination. 
  *
  * @tparam max_size_ Maximum length of the template sequences on both reads.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class DualBarcodesPairedEnd { 
@@ -76,12 +79,12 @@ public:
      * @param[in] template_seq1 Pointer to a character array containing the first template sequence. 
      * This should contain exactly one variable region.
      * @param template_length1 Length of the array pointed to by `template_seq1`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool1 Pool of known barcode sequences for the variable region in the first template.
      * @param[in] template_seq2 Pointer to a character array containing the second template sequence. 
      * This should contain exactly one variable region.
      * @param template_length2 Length of the array pointed to by `template_seq2`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool2 Pool of known barcode sequences for the variable region in the second template.
      * @param options Optional parameters.
      *
@@ -199,7 +202,7 @@ public:
         State() = default;
         State(typename std::vector<Count>::size_type n) : counts(n) {}
 
-        std::vector<Count> counts;
+        SparseCounts counts;
         Count total = 0;
 
         std::pair<std::string, int> first_match;
@@ -208,6 +211,7 @@ public:
 
         // Default constructors should be called in this case, so it should be fine.
         typename SegmentedBarcodeSearch<2>::State details;
+        typename ScanTemplate<max_size_>::State deets1, deets2;
     };
 
     State initialize() const {
@@ -216,14 +220,20 @@ public:
 
     void reduce(State& s) {
         my_varlib.reduce(s.details);
-        auto csize = my_counts.size();
-        for (decltype(csize) i = 0; i < csize; ++i) {
-            my_counts[i] += s.counts[i];
-        }
+        s.counts.transfer(my_counts);
         my_total += s.total;
+        s.total = 0;
+    }
+
+    void merge(State& dest, State& src) const {
+        dest.counts.merge(src.counts);
+        dest.total += src.total;
+        src.total = 0;
     }
 
     constexpr static bool use_names = false;
+    static constexpr bool commutative = true;
+    static constexpr bool reusable_state = true;
     /**
      * @endcond
      */
@@ -250,30 +260,35 @@ private:
         typename ScanTemplate<max_size_>::State& deets,
         Store& store)
     {
-        while (!deets.finished) {
-            constant.next(deets);
-            if (reverse) {
-                if (deets.reverse_mismatches <= max_mm) {
-                    const auto& reg = constant.reverse_variable_regions()[0];
-                    auto start = against + deets.position;
-                    fill_store(store, start + reg.first, start + reg.second, deets.reverse_mismatches);
-                    return true;
-                }
-            } else {
-                if (deets.forward_mismatches <= max_mm) {
-                    const auto& reg = constant.forward_variable_regions()[0];
-                    auto start = against + deets.position;
-                    fill_store(store, start + reg.first, start + reg.second, deets.forward_mismatches);
-                    return true;
+        // Choosing the specialized next() once per scan rather than at every position.
+        return constant.with_next([&](auto next) -> bool {
+            while (!deets.finished) {
+                next(deets);
+                if (reverse) {
+                    if (deets.reverse_mismatches <= max_mm) {
+                        const auto& reg = constant.reverse_variable_regions()[0];
+                        auto start = against + deets.position;
+                        fill_store(store, start + reg.first, start + reg.second, deets.reverse_mismatches);
+                        return true;
+                    }
+                } else {
+                    if (deets.forward_mismatches <= max_mm) {
+                        const auto& reg = constant.forward_variable_regions()[0];
+                        auto start = against + deets.position;
+                        fill_store(store, start + reg.first, start + reg.second, deets.forward_mismatches);
+                        return true;
+                    }
                 }
             }
-        }
-        return false;
+            return false;
+        });
     }
 
     bool process_first(State& state, const std::pair<const char*, const char*>& against1, const std::pair<const char*, const char*>& against2) const {
-        auto deets1 = my_constant1.initialize(against1.first, against1.second - against1.first);
-        auto deets2 = my_constant2.initialize(against2.first, against2.second - against2.first);
+        auto& deets1 = state.deets1;
+        auto& deets2 = state.deets2;
+        my_constant1.initialize(against1.first, against1.second - against1.first, deets1);
+        my_constant2.initialize(against2.first, against2.second - against2.first, deets2);
 
         state.second_matches.clear();
         typedef decltype(state.second_matches.size()) Size;
@@ -285,7 +300,7 @@ private:
             my_varlib.search(state.combined, state.details, std::array<int, 2>{ my_max_mm1 - state.first_match.second, my_max_mm2 - current2.second });
 
             if (is_barcode_index_ok(state.details.index)) {
-                ++state.counts[state.details.index];
+                state.counts.increment(state.details.index);
                 return true;
             } else {
                 return false;
@@ -325,8 +340,10 @@ private:
     }
 
     std::pair<BarcodeIndex, int> process_best(State& state, const std::pair<const char*, const char*>& against1, const std::pair<const char*, const char*>& against2) const {
-        auto deets1 = my_constant1.initialize(against1.first, against1.second - against1.first);
-        auto deets2 = my_constant2.initialize(against2.first, against2.second - against2.first);
+        auto& deets1 = state.deets1;
+        auto& deets2 = state.deets2;
+        my_constant1.initialize(against1.first, against1.second - against1.first, deets1);
+        my_constant2.initialize(against2.first, against2.second - against2.first, deets2);
 
         // Getting all hits on the second read, and then looping over that
         // vector for each hit of the first read. We have to do all pairwise
@@ -389,7 +406,7 @@ public:
 
             found = is_barcode_index_ok(best.first);
             if (found) {
-                ++state.counts[best.first];
+                state.counts.increment(best.first);
             }
         }
 
@@ -416,6 +433,35 @@ public:
     Count get_total() const {
         return my_total;
     }
+
+    /**
+     * Save the count for each barcode pair in the pool, along with the total number of read pairs.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_counts(output, my_counts);
+        save_value(output, my_total);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and total.
+     * The handler should have been constructed with the same barcode pools, as the counts are stored in the order of the pools;
+     * an error is raised if the number of saved counts differs from the number of barcode pairs.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        std::vector<Count> counts(my_counts.size());
+        load_counts(input, counts);
+        Count total;
+        load_value(input, total);
+
+        my_counts.swap(counts);
+        my_total = total;
+    }
 };
 
 /**
@@ -5,6 +5,8 @@
 #include "CombinatorialBarcodesPairedEnd.hpp"
 #include "../utils.hpp"
 
+#include <sstream>
+
 /**
  * @file DualBarcodesPairedEndWithDiagnostics.hpp
  *
@@ -21,6 +23,7 @@ namespace kaori {
  * The handler also counts the number of reads where only one barcode construct matches to a read.
  *
  * @tparam max_size_ Maximum length of the template sequences on both reads.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class DualBarcodesPairedEndWithDiagnostics { 
@@ -29,12 +32,12 @@ public:
      * @param[in] template_seq1 Pointer to a character array containing the first template sequence. 
      * This should contain exactly one variable region.
      * @param template_length1 Length of the array pointed to by `template_seq1`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool1 Pool of known barcode sequences for the variable region in the first template.
      * @param[in] template_seq2 Pointer to a character array containing the second template sequence. 
      * This should contain exactly one variable region.
      * @param template_length2 Length of the array pointed to by `template_seq2`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool2 Pool of known barcode sequences for the variable region in the second template.
      * @param options Optional parameters.
      *
@@ -109,7 +112,13 @@ public:
         my_combo_handler.reduce(s.combo_state);
     }
 
+    void merge(State& dest, State& src) const {
+        my_dual_handler.merge(dest.dual_state, src.dual_state);
+        my_combo_handler.merge(dest.combo_state, src.combo_state);
+    }
+
     constexpr static bool use_names = false;
+    static constexpr bool commutative = true;
     /**
      *@endcond
      */
@@ -166,6 +175,35 @@ public:
     Count get_barcode2_only() const {
         return my_combo_handler.get_barcode2_only();
     }
+
+    /**
+     * Save the results of the underlying `DualBarcodesPairedEnd` handler, followed by those of the `CombinatorialBarcodesPairedEnd` handler used for diagnostics.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        my_dual_handler.save(output);
+        my_combo_handler.save(output);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the results of both the dual and combinatorial handlers.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Each handler's load() is all-or-nothing, so we only need to restore the dual handler if the combinatorial handler fails.
+        std::stringstream backup(std::ios::in | std::ios::out | std::ios::binary);
+        my_dual_handler.save(backup);
+        my_dual_handler.load(input);
+        try {
+            my_combo_handler.load(input);
+        } catch (...) {
+            my_dual_handler.load(backup);
+            throw;
+        }
+    }
 };
 
 /**
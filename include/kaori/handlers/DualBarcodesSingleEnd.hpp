@@ -4,6 +4,8 @@
 #include "../ScanTemplate.hpp"
 #include "../BarcodeSearch.hpp"
 #include "../utils.hpp"
+#include "../SparseCounts.hpp"
+#include "../serialize.hpp"
 
 #include <array>
 #include <vector>
@@ -26,6 +28,7 @@ namespace kaori {
  * It will count the frequency of each barcode combination, along with the total number of reads. 
  *
  * @tparam max_size_ Maximum length of the template sequence.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class DualBarcodesSingleEnd {
@@ -60,7 +63,7 @@ public:
      * @param[in] template_seq Pointer to an array containing the template sequence.
      * The template may contain any number (usually 2 or more) of variable regions.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pools Array containing pools of known barcode sequences for each of the variable regions, in the order of their appearance in the template sequence.
      * Each pool should have the same number of barcodes; corresponding entries across pools define a specific combination of barcodes. 
      * @param options Optional parameters.
@@ -145,13 +148,14 @@ public:
         State() = default;
         State(typename std::vector<Count>::size_type n) : counts(n) {}
 
-        std::vector<Count> counts;
+        SparseCounts counts;
         Count total = 0;
 
         std::string buffer;
 
         // Default constructors should be called in this case, so it should be fine.
         typename SimpleBarcodeSearch::State forward_details, reverse_details;
+        typename ScanTemplate<max_size_>::State deets;
     };
     /**
      * @endcond
@@ -188,16 +192,18 @@ private:
     }
 
 private:
-    bool process_first(State& state, const std::pair<const char*, const char*>& x) const {
-        auto deets = my_constant_matcher.initialize(x.first, x.second - x.first);
+    template<class Next_>
+    bool process_first(State& state, const std::pair<const char*, const char*>& x, Next_ next) const {
+        auto& deets = state.deets;
+        my_constant_matcher.initialize(x.first, x.second - x.first, deets);
 
         while (!deets.finished) {
-            my_constant_matcher.next(deets);
+            next(deets);
 
             if (my_forward && deets.forward_mismatches <= my_max_mm) {
                 auto id = forward_match(x.first, deets, state).first;
                 if (is_barcode_index_ok(id)) {
-                    ++state.counts[id];
+                    state.counts.increment(id);
                     return true;
                 }
             }
@@ -205,7 +211,7 @@ private:
             if (my_reverse && deets.reverse_mismatches <= my_max_mm) {
                 auto id = reverse_match(x.first, deets, state).first;
                 if (is_barcode_index_ok(id)) {
-                    ++state.counts[id];
+                    state.counts.increment(id);
                     return true;
                 }
             }
@@ -213,8 +219,10 @@ private:
         return false;
     }
 
-    bool process_best(State& state, const std::pair<const char*, const char*>& x) const {
-        auto deets = my_constant_matcher.initialize(x.first, x.second - x.first);
+    template<class Next_>
+    bool process_best(State& state, const std::pair<const char*, const char*>& x, Next_ next) const {
+        auto& deets = state.deets;
+        my_constant_matcher.initialize(x.first, x.second - x.first, deets);
         bool found = false;
         int best_mismatches = my_max_mm + 1;
         BarcodeIndex best_id = STATUS_UNMATCHED;
@@ -239,7 +247,7 @@ private:
         };
 
         while (!deets.finished) {
-            my_constant_matcher.next(deets);
+            next(deets);
 
             if (my_forward && deets.forward_mismatches <= my_max_mm) {
                 update(forward_match(x.first, deets, state));
@@ -251,7 +259,7 @@ private:
         }
 
         if (found) {
-            ++state.counts[best_id];
+            state.counts.increment(best_id);
         }
         return found;
     }
@@ -272,23 +280,32 @@ public:
             my_reverse_lib.reduce(s.reverse_details);
         }
 
-        for (decltype(my_counts.size()) i = 0, end = my_counts.size(); i < end; ++i) {
-            my_counts[i] += s.counts[i];
-        }
+        s.counts.transfer(my_counts);
         my_total += s.total;
+        s.total = 0;
         return;
     }
 
+    void merge(State& dest, State& src) const {
+        dest.counts.merge(src.counts);
+        dest.total += src.total;
+        src.total = 0;
+    }
+
     bool process(State& state, const std::pair<const char*, const char*>& x) const {
         ++state.total;
-        if (my_use_first) {
-            return process_first(state, x);
-        } else {
-            return process_best(state, x);
-        }
+        return my_constant_matcher.with_next([&](auto next) -> bool {
+            if (my_use_first) {
+                return process_first(state, x, next);
+            } else {
+                return process_best(state, x, next);
+            }
+        });
     }
 
     static constexpr bool use_names = false;
+    static constexpr bool commutative = true;
+    static constexpr bool reusable_state = true;
     /**
      * @endcond
      */
@@ -309,6 +326,35 @@ public:
     Count get_total() const {
         return my_total;
     }
+
+    /**
+     * Save the count for each barcode pair in the pool, along with the total number of reads.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_counts(output, my_counts);
+        save_value(output, my_total);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and total.
+     * The handler should have been constructed with the same barcode pools, as the counts are stored in the order of the pools;
+     * an error is raised if the number of saved counts differs from the number of barcode pairs.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        std::vector<Count> counts(my_counts.size());
+        load_counts(input, counts);
+        Count total;
+        load_value(input, total);
+
+        my_counts.swap(counts);
+        my_total = total;
+    }
 };
 
 }
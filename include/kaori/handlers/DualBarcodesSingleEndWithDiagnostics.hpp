@@ -5,6 +5,8 @@
 #include "CombinatorialBarcodesSingleEnd.hpp"
 #include "../utils.hpp"
 
+#include <sstream>
+
 /**
  * @file DualBarcodesSingleEndWithDiagnostics.hpp
  *
@@ -20,6 +22,7 @@ namespace kaori {
  * These frequences can be helpful for diagnosing problems with library construction.
  *
  * @tparam max_size_ Maximum length of the template sequences on both reads.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  * @tparam num_variable_ Number of the template sequences on both reads.
  */
 template<SeqLength max_size_, int num_variable_>
@@ -29,7 +32,7 @@ public:
      * @param[in] template_seq Pointer to an array containing the template sequence.
      * The template may contain any number (usually 2 or more) of variable regions.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pools Array containing pools of known barcode sequences for each of the variable regions, in the order of their appearance in the template sequence.
      * Each pool should have the same number of barcodes; corresponding entries across pools define a specific combination of barcodes. 
      * @param options Optional parameters.
@@ -96,7 +99,13 @@ public:
         my_combo_handler.reduce(s.combo_state);
     }
 
+    void merge(State& dest, State& src) const {
+        my_dual_handler.merge(dest.dual_state, src.dual_state);
+        my_combo_handler.merge(dest.combo_state, src.combo_state);
+    }
+
     constexpr static bool use_names = false;
+    static constexpr bool commutative = true;
     /**
      *@endcond
      */
@@ -139,6 +148,35 @@ public:
     Count get_total() const {
         return my_dual_handler.get_total();
     }
+
+    /**
+     * Save the results of the underlying `DualBarcodesSingleEnd` handler, followed by those of the `CombinatorialBarcodesSingleEnd` handler used for diagnostics.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        my_dual_handler.save(output);
+        my_combo_handler.save(output);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the results of both the dual and combinatorial handlers.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Each handler's load() is all-or-nothing, so we only need to restore the dual handler if the combinatorial handler fails.
+        std::stringstream backup(std::ios::in | std::ios::out | std::ios::binary);
+        my_dual_handler.save(backup);
+        my_dual_handler.load(input);
+        try {
+            my_combo_handler.load(input);
+        } catch (...) {
+            my_dual_handler.load(backup);
+            throw;
+        }
+    }
 };
 
 }
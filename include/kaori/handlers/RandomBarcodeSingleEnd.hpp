@@ -2,6 +2,7 @@
 #define KAORI_RANDOM_BARCODE_SINGLE_END_HPP
 
 #include "../ScanTemplate.hpp"
+#include "../serialize.hpp"
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -23,6 +24,7 @@ namespace kaori {
  * Random barcodes containing N's are allowed and will be counted separately.
  *
  * @tparam max_size_ Maximum length of the template sequences on both reads.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class RandomBarcodeSingleEnd {
@@ -53,7 +55,7 @@ public:
      * @param[in] template_seq Pointer to an array containing the template sequence.
      * This should contain exactly one variable region.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param options Optional parameters.
      */
     RandomBarcodeSingleEnd(const char* template_seq, SeqLength template_length, const Options& options) :
@@ -84,6 +86,7 @@ public:
         std::unordered_map<std::string, Count> counts;
         std::string buffer;
         Count total = 0;
+        typename ScanTemplate<max_size_>::State deets;
     };
 
     void forward_match(const char* seq, SeqLength position, State& state) const {
@@ -116,12 +119,22 @@ public:
     }
 
     void process(State& state, const std::pair<const char*, const char*>& x) const {
+        my_constant.with_next([&](auto next) -> void {
+            process_internal(state, x, next);
+        });
+        ++state.total;
+    }
+
+private:
+    template<class Next_>
+    void process_internal(State& state, const std::pair<const char*, const char*>& x, Next_ next) const {
         auto read_seq = x.first;
-        auto deets = my_constant.initialize(read_seq, x.second - x.first);
+        auto& deets = state.deets;
+        my_constant.initialize(read_seq, x.second - x.first, deets);
 
         if (my_use_first) {
             while (!deets.finished) {
-                my_constant.next(deets);
+                next(deets);
                 if (my_forward && deets.forward_mismatches <= my_max_mm) {
                     forward_match(read_seq, deets.position, state);
                     break;
@@ -139,7 +152,7 @@ public:
             bool best_tied = false;
 
             while (!deets.finished) {
-                my_constant.next(deets);
+                next(deets);
 
                 if (my_forward && deets.forward_mismatches <= my_max_mm) {
                     if (deets.forward_mismatches < best) {
@@ -172,11 +185,11 @@ public:
                 }
             }
         }
-
-        ++state.total;
     }
 
+public:
     static constexpr bool use_names = false;
+    static constexpr bool commutative = true;
     /**
      * @endcond
      */
@@ -201,6 +214,18 @@ public:
         }
         my_total += s.total;
     }
+
+    void merge(State& dest, State& src) const {
+        if (dest.counts.size() < src.counts.size()) {
+            std::swap(dest.counts, src.counts);
+        }
+        for (const auto& pair : src.counts) {
+            dest.counts[pair.first] += pair.second;
+        }
+        src.counts.clear();
+        dest.total += src.total;
+        src.total = 0;
+    }
     /**
      * @endcond
      */
@@ -219,6 +244,34 @@ public:
     Count get_total() const {
         return my_total;
     }
+
+    /**
+     * Save the count for each observed barcode sequence, along with the total number of reads.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_map(output, my_counts);
+        save_value(output, my_total);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and total.
+     * The saved barcodes are not checked against the template, so the handler should have been constructed with the same template as the saved handler.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        decltype(my_counts) counts;
+        load_map(input, counts);
+        Count total;
+        load_value(input, total);
+
+        my_counts.swap(counts);
+        my_total = total;
+    }
 };
 
 }
@@ -2,6 +2,8 @@
 #define KAORI_SINGLE_BARCODE_PAIRED_END_HPP
 
 #include "../SimpleSingleMatch.hpp"
+#include "../SparseCounts.hpp"
+#include "../serialize.hpp"
 #include <vector>
 
 /**
@@ -20,6 +22,7 @@ namespace kaori {
  * This handler will search both reads for the vector sequence and count the frequency of each barcode.
  *
  * @tparam max_size_ Maximum length of the template sequence.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class SingleBarcodePairedEnd {
@@ -55,7 +58,7 @@ public:
      * @param[in] template_seq Pointer to an array containing the template sequence.
      * This should contain exactly one variable region.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool Known barcode sequences for the variable region.
      * @param options Optional parameters.
      */
@@ -85,16 +88,16 @@ public:
         State(typename SimpleSingleMatch<max_size_>::State s, typename std::vector<Count>::size_type nvar) : search(std::move(s)), counts(nvar) {}
 
         typename SimpleSingleMatch<max_size_>::State search;
-        std::vector<Count> counts;
+        SparseCounts counts;
         Count total = 0;
     };
 
     void process(State& state, const std::pair<const char*, const char*>& r1, const std::pair<const char*, const char*>& r2) const {
         if (my_use_first) {
             if (my_matcher.search_first(r1.first, r1.second - r1.first, state.search)) {
-                ++state.counts[state.search.index];
+                state.counts.increment(state.search.index);
             } else if (my_matcher.search_first(r2.first, r2.second - r2.first, state.search)) {
-                ++state.counts[state.search.index];
+                state.counts.increment(state.search.index);
             }
         } else {
             bool found1 = my_matcher.search_best(r1.first, r1.second - r1.first, state.search);
@@ -106,16 +109,16 @@ public:
             auto mm2 = state.search.mismatches;
 
             if (found1 && !found2) {
-                ++state.counts[id1];
+                state.counts.increment(id1);
             } else if (!found1 && found2) {
-                ++state.counts[id2];
+                state.counts.increment(id2);
             } else if (found1 && found2) {
                 if (mm1 < mm2) {
-                    ++state.counts[id1];
+                    state.counts.increment(id1);
                 } else if (mm1 > mm2) {
-                    ++state.counts[id2];
+                    state.counts.increment(id2);
                 } else if (id1 == id2) {
-                    ++state.counts[id1];
+                    state.counts.increment(id1);
                 }
             }
         }
@@ -123,6 +126,8 @@ public:
     }
 
     static constexpr bool use_names = false;
+    static constexpr bool commutative = true;
+    static constexpr bool reusable_state = true;
     /**
      * @endcond
      */
@@ -137,10 +142,15 @@ public:
 
     void reduce(State& s) {
         my_matcher.reduce(s.search);
-        for (decltype(my_counts.size()) i = 0, end = my_counts.size(); i < end; ++i) {
-            my_counts[i] += s.counts[i];
-        }
+        s.counts.transfer(my_counts);
         my_total += s.total;
+        s.total = 0;
+    }
+
+    void merge(State& dest, State& src) const {
+        dest.counts.merge(src.counts);
+        dest.total += src.total;
+        src.total = 0;
     }
     /**
      * @endcond
@@ -167,6 +177,35 @@ public:
     Count get_total() const {
         return my_total;
     }
+
+    /**
+     * Save the count for each barcode in the pool, along with the total number of read pairs.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_counts(output, my_counts);
+        save_value(output, my_total);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and total.
+     * The handler should have been constructed with the same barcode pool, as the counts are stored in the order of the pool;
+     * an error is raised if the number of saved counts differs from the size of the pool.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        std::vector<Count> counts(my_counts.size());
+        load_counts(input, counts);
+        Count total;
+        load_value(input, total);
+
+        my_counts.swap(counts);
+        my_total = total;
+    }
 };
 
 }
@@ -2,7 +2,11 @@
 #define KAORI_SINGLE_BARCODE_SINGLE_END_HPP
 
 #include "../SimpleSingleMatch.hpp"
+#include "../SparseCounts.hpp"
+#include "../serialize.hpp"
 #include <vector>
+#include <utility>
+#include <cstddef>
 
 /**
  * @file SingleBarcodeSingleEnd.hpp
@@ -20,6 +24,7 @@ namespace kaori {
  * This handler will search the read for the vector sequence and count the frequency of each barcode.
  *
  * @tparam max_size_ Maximum length of the template sequence.
+ * This may be zero to determine the maximum length at runtime, see `ScanTemplate`.
  */
 template<SeqLength max_size_>
 class SingleBarcodeSingleEnd {
@@ -48,6 +53,24 @@ public:
          * How duplicated barcode sequences should be handled.
          */
         DuplicateAction duplicates = DuplicateAction::ERROR;
+
+        /**
+         * Likely positions of the template on the read, to be tested before scanning the entire read when `use_first = true`.
+         * See `SimpleSingleMatch::Options::likely_offsets` for details.
+         */
+        std::vector<SeqLength> likely_offsets;
+
+        /**
+         * Number of matches from which to learn the likely positions of the template when `use_first = true`.
+         * See `SimpleSingleMatch::Options::learn_offsets` for details.
+         */
+        int learn_offsets = 0;
+
+        /**
+         * Whether to only evaluate positions near exact matches to substrings of the template's constant regions.
+         * See `SimpleSingleMatch::Options::use_anchors` for details.
+         */
+        bool use_anchors = false;
     };
 
 public:
@@ -55,7 +78,7 @@ public:
      * @param[in] template_seq Pointer to a character array containing the template sequence.
      * This should contain exactly one variable region.
      * @param template_length Length of the array pointed to by `template_seq`.
-     * This should be less than or equal to `max_size_`.
+     * This should be less than or equal to `max_size_`, if the latter is non-zero.
      * @param barcode_pool Known barcode sequences for the variable region.
      * @param options Optional parameters.
      */
@@ -69,6 +92,9 @@ public:
                 ssopt.strand = options.strand;
                 ssopt.max_mismatches = options.max_mismatches;
                 ssopt.duplicates = options.duplicates;
+                ssopt.likely_offsets = options.likely_offsets;
+                ssopt.learn_offsets = options.learn_offsets;
+                ssopt.use_anchors = options.use_anchors;
                 return ssopt;
             }()
         ),
@@ -85,7 +111,7 @@ public:
         State(typename SimpleSingleMatch<max_size_>::State s, typename std::vector<Count>::size_type nvar) : search(std::move(s)), counts(nvar) {}
 
         typename SimpleSingleMatch<max_size_>::State search;
-        std::vector<Count> counts;
+        SparseCounts counts;
         Count total = 0;
     };
 
@@ -97,12 +123,23 @@ public:
             found = my_matcher.search_best(x.first, x.second - x.first, state.search);
         }
         if (found) {
-            ++(state.counts[state.search.index]);
+            state.counts.increment(state.search.index);
         }
         ++state.total;
     }
 
+    void process_batch(State& state, const std::pair<const char*, const char*>* reads, std::size_t num_reads) const {
+        my_matcher.search_batch(reads, num_reads, !my_use_first, state.search, [&](std::size_t, bool found) -> void {
+            if (found) {
+                state.counts.increment(state.search.index);
+            }
+        });
+        state.total += num_reads;
+    }
+
     static constexpr bool use_names = false;
+    static constexpr bool commutative = true;
+    static constexpr bool reusable_state = true;
     /**
      * @endcond
      */
@@ -117,10 +154,15 @@ public:
 
     void reduce(State& s) {
         my_matcher.reduce(s.search);
-        for (decltype(my_counts.size()) i = 0, end = my_counts.size(); i < end; ++i) {
-            my_counts[i] += s.counts[i];
-        }
+        s.counts.transfer(my_counts);
         my_total += s.total;
+        s.total = 0;
+    }
+
+    void merge(State& dest, State& src) const {
+        dest.counts.merge(src.counts);
+        dest.total += src.total;
+        src.total = 0;
     }
     /**
      * @endcond
@@ -147,6 +189,35 @@ public:
     Count get_total() const {
         return my_total;
     }
+
+    /**
+     * Save the count for each barcode in the pool, along with the total number of reads.
+     * See `ProcessDataCheckpoint` for how this is used to checkpoint a long run.
+     *
+     * @param output Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& output) const {
+        save_counts(output, my_counts);
+        save_value(output, my_total);
+    }
+
+    /**
+     * Restore the results saved by `save()`, replacing the current counts and total.
+     * The handler should have been constructed with the same barcode pool, as the counts are stored in the order of the pool;
+     * an error is raised if the number of saved counts differs from the size of the pool.
+     *
+     * @param input Stream to read from, opened in binary mode.
+     */
+    void load(std::istream& input) {
+        // Loading everything before replacing anything, so that the handler is unchanged if the input is truncated.
+        std::vector<Count> counts(my_counts.size());
+        load_counts(input, counts);
+        Count total;
+        load_value(input, total);
+
+        my_counts.swap(counts);
+        my_total = total;
+    }
 };
 
 }
@@ -11,10 +11,24 @@
 #include "handlers/SingleBarcodePairedEnd.hpp"
 #include "handlers/SingleBarcodeSingleEnd.hpp"
 #include "process_data.hpp"
+#include "process_file.hpp"
+#include "process_stream.hpp"
+#include "serialize.hpp"
+#include "PrefetchReader.hpp"
+#include "Executor.hpp"
+#include "FastaReader.hpp"
+#include "LineSequenceReader.hpp"
+
+#if __has_include(<sys/mman.h>)
+#include "MappedFastqReader.hpp"
+#endif
 
 /**
  * @file kaori.hpp
  * @brief Umbrella includes for the **kaori** barcode-matching library.
+ *
+ * This does not include `ParallelGzipReader.hpp`, which requires linking to Zlib;
+ * users should include it explicitly if needed.
  */
 
 /**
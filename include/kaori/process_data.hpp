@@ -7,8 +7,23 @@
 #include <condition_variable>
 #include <stdexcept>
 #include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <functional>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include <string>
+#include <deque>
+#include <chrono>
+#include <numeric>
+#include <atomic>
+#include <limits>
+#include <array>
 
 #include "FastqReader.hpp"
+#include "PrefetchReader.hpp"
+#include "Executor.hpp"
 
 #include "byteme/byteme.hpp"
 
@@ -20,11 +35,175 @@
 
 namespace kaori {
 
+class MappedFastqReader;
+
+/**
+ * @brief Token to cancel the processing of single- or paired-end data.
+ *
+ * This allows a long-running call to `process_single_end_data()` or friends to be stopped cleanly from another thread, e.g., on application shutdown.
+ * It can be shared between multiple calls, in which case cancellation applies to all of them.
+ */
+class CancellationToken {
+public:
+    /**
+     * Request cancellation.
+     * This can be called from any thread and returns immediately.
+     */
+    void cancel() {
+        my_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * @return Whether cancellation has been requested.
+     */
+    bool cancelled() const {
+        return my_cancelled.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> my_cancelled = false;
+};
+
+/**
+ * @brief Statistics from processing single- or paired-end data.
+ *
+ * These are intended to help tune the `queue_size`, `num_threads` and `block_size` options in `ProcessSingleEndDataOptions` or `ProcessPairedEndDataOptions`.
+ * All times are reported in seconds.
+ */
+struct ProcessDataStats {
+    /**
+     * Number of chunks of reads that were processed.
+     */
+    std::size_t num_chunks = 0;
+
+    /**
+     * Time that the calling thread spent waiting for a chunk to be processed before it could parse more reads.
+     * Large values indicate that processing is the bottleneck, so more threads or a larger queue might help.
+     */
+    double parse_wait = 0;
+
+    /**
+     * Time that the worker threads spent waiting for a parsed chunk, summed across all threads.
+     * Large values indicate that parsing is the bottleneck.
+     * This is only reported for the `DefaultExecutor`, and is set to zero if a custom `Executor` is supplied.
+     */
+    double process_wait = 0;
+
+    /**
+     * Time that the calling thread spent waiting for the remaining chunks to be processed after all reads were parsed.
+     */
+    double drain_wait = 0;
+
+    /**
+     * Number of reads that were parsed.
+     * For paired-end data, each pair is counted as one read.
+     */
+    unsigned long long num_reads = 0;
+
+    /**
+     * Number of bytes that were consumed from the input sources, summed across both sources for paired-end data.
+     * For the stream processors, this is the total length of all submitted names and sequences.
+     */
+    unsigned long long num_bytes = 0;
+
+    /**
+     * Time that the calling thread spent parsing reads into chunks.
+     */
+    double parse_time = 0;
+
+    /**
+     * Time that the calling thread spent reducing states into the handler, including any parallel merges of persistent states.
+     */
+    double reduce_time = 0;
+
+    /**
+     * Time spent by each worker thread in processing chunks.
+     * This is only reported for the `DefaultExecutor` and is empty if a custom `Executor` is supplied.
+     */
+    std::vector<double> thread_busy;
+
+    /**
+     * Time spent by each worker thread in waiting for chunks, see `process_wait`.
+     * This is only reported for the `DefaultExecutor` and is empty if a custom `Executor` is supplied.
+     */
+    std::vector<double> thread_idle;
+
+    /**
+     * Wall-clock time since the start of processing.
+     */
+    double elapsed = 0;
+
+    /**
+     * Number of reads in each chunk at the end of processing.
+     * This is equal to the `block_size` option unless `adaptive_block_size = true`.
+     * For the stream processors, this is always zero as the batch size is chosen by the caller.
+     */
+    std::size_t block_size = 0;
+
+    /**
+     * Whether processing stopped before the end of the input, due to cancellation or to the `max_reads` or `time_limit` options.
+     * In such cases, the handler only contains results for the first `num_reads` reads.
+     * This may also be `true` if the input happens to end at exactly `max_reads` reads.
+     */
+    bool stopped = false;
+};
+
+/**
+ * @brief Position of a checkpoint in the input.
+ *
+ * This is passed to the `checkpoint` function in `ProcessSingleEndDataOptions` or `ProcessPairedEndDataOptions`,
+ * at which point the handler contains the results for exactly the first `num_reads` reads of the input.
+ *
+ * The handlers in **kaori** can save their results with a `save()` method, which should be called alongside recording the checkpoint.
+ * To resume, the results are restored into a newly constructed handler with `load()`, and the checkpoint is supplied as `resume` in the options.
+ * The saved format is a raw binary dump of the handler's results, so it should only be loaded by the same handler class,
+ * constructed with the same arguments, in a program built for the same platform.
+ * `load()` throws an error if the saved results are truncated or otherwise inconsistent with the size of the stream.
+ */
+struct ProcessDataCheckpoint {
+    /**
+     * Number of reads from the start of the input that have been reduced into the handler, including those skipped with `skip_reads` or `resume`.
+     * For paired-end data, each pair is counted as one read.
+     */
+    unsigned long long num_reads = 0;
+
+    /**
+     * Offset of the first unprocessed record in each input source, in terms of the bytes supplied by that source from its start.
+     * This contains one entry for single-end and interleaved data, and two entries (one per file) for paired-end data.
+     * When resuming, sources that can seek are positioned at these offsets, so that the first `num_reads` reads do not need to be parsed again.
+     * Note that, for compressed inputs, these are offsets into the decompressed bytes.
+     */
+    std::vector<unsigned long long> offsets;
+
+    /**
+     * Number of bytes consumed from the input sources, as described for `ProcessDataStats::num_bytes`.
+     * This is provided for information only, as the reader may have consumed more bytes than were needed for `num_reads`.
+     */
+    unsigned long long num_bytes = 0;
+};
+
 /**
  * @cond
  */
 typedef std::size_t ReadIndex;
 
+// Buffers are grown by the parsing thread, so their pages are first touched
+// (and thus allocated on the NUMA node of) the parsing thread. Once a
+// buffer's capacity has stabilized, we move it into memory that is first
+// touched by the worker that processes the chunk, so that later chunks
+// are read from local memory. This only needs to be done after each growth.
+template<typename Type_>
+void touch_on_growth(std::vector<Type_>& buffer, std::size_t& touched) {
+    if (buffer.capacity() <= touched) {
+        return;
+    }
+    std::vector<Type_> fresh(buffer.capacity()); // value-initialization writes to every page.
+    std::copy(buffer.begin(), buffer.end(), fresh.begin());
+    fresh.resize(buffer.size());
+    buffer.swap(fresh);
+    touched = buffer.capacity();
+}
+
 class ChunkOfReads {
 public:
     ChunkOfReads() : my_sequence_offset(1), my_name_offset(1) {} // zero is always the first element.
@@ -46,6 +225,14 @@ public:
         add_read_details(name, my_name_buffer, my_name_offset);
     }
 
+    void add_read_sequence(const std::pair<const char*, const char*>& sequence) {
+        add_read_details(sequence, my_sequence_buffer, my_sequence_offset);
+    }
+
+    void add_read_name(const std::pair<const char*, const char*>& name) {
+        add_read_details(name, my_name_buffer, my_name_offset);
+    }
+
     ReadIndex size() const {
         return my_sequence_offset.size() - 1;
     }
@@ -58,11 +245,19 @@ public:
         return get_details(i, my_name_buffer, my_name_offset);
     }
 
+    void first_touch() {
+        touch_on_growth(my_sequence_buffer, my_sequence_buffer_touched);
+        touch_on_growth(my_sequence_offset, my_sequence_offset_touched);
+        touch_on_growth(my_name_buffer, my_name_buffer_touched);
+        touch_on_growth(my_name_offset, my_name_offset_touched);
+    }
+
 private:
     std::vector<char> my_sequence_buffer;
     std::vector<std::size_t> my_sequence_offset;
     std::vector<char> my_name_buffer;
     std::vector<std::size_t> my_name_offset;
+    std::size_t my_sequence_buffer_touched = 0, my_sequence_offset_touched = 0, my_name_buffer_touched = 0, my_name_offset_touched = 0;
 
     static void add_read_details(const std::vector<char>& src, std::vector<char>& dst, std::vector<std::size_t>& offset) {
         dst.insert(dst.end(), src.begin(), src.end());
@@ -70,151 +265,904 @@ private:
         offset.push_back(last + src.size());
     }
 
+    static void add_read_details(const std::pair<const char*, const char*>& src, std::vector<char>& dst, std::vector<std::size_t>& offset) {
+        dst.insert(dst.end(), src.first, src.second);
+        auto last = offset.back();
+        offset.push_back(last + (src.second - src.first));
+    }
+
     static std::pair<const char*, const char*> get_details(ReadIndex i, const std::vector<char>& dest, const std::vector<std::size_t>& offset) {
         const char * base = dest.data();
         return std::make_pair(base + offset[i], base + offset[i + 1]);
     }
 };
 
-template<typename Workspace_>
-class ThreadPool {
+class ChunkOfReadViews {
 public:
-    template<typename RunJob_>
-    ThreadPool(RunJob_ run_job, int num_threads) : my_helpers(num_threads) {
-        std::mutex init_mut;
-        std::condition_variable init_cv;
-        int num_initialized = 0;
-
-        my_threads.reserve(num_threads);
-        for (int t = 0; t < num_threads; ++t) {
-            // Copy lambda as it will be gone once this constructor finishes.
-            my_threads.emplace_back([run_job,this,&init_mut,&init_cv,&num_initialized](int thread) -> void { 
-                Helper env; // allocating this locally within each thread to reduce the risk of false sharing.
-                my_helpers[thread] = &env;
-                {
-                    std::lock_guard lck(init_mut);
-                    ++num_initialized;
-                    init_cv.notify_one();
-                }
+    void clear(bool use_names) {
+        my_sequences.clear();
+        if (use_names) {
+            my_names.clear();
+        }
+    }
 
-                while (1) {
-                    std::unique_lock lck(env.mut);
-                    env.cv.wait(lck, [&]() -> bool { return env.input_ready; });
-                    if (env.terminated) {
-                        return;
-                    }
-                    env.input_ready = false;
+    void add_read_sequence(const std::pair<const char*, const char*>& sequence) {
+        my_sequences.push_back(sequence);
+    }
 
-                    try {
-                        run_job(env.work);
-                    } catch (...) {
-                        std::lock_guard elck(my_error_mut);
-                        if (!my_error) {
-                            my_error = std::current_exception();
-                        }
-                    }
+    void add_read_name(const std::pair<const char*, const char*>& name) {
+        my_names.push_back(name);
+    }
+
+    ReadIndex size() const {
+        return my_sequences.size();
+    }
+
+    const std::pair<const char*, const char*>& get_sequence(ReadIndex i) const {
+        return my_sequences[i];
+    }
+
+    const std::pair<const char*, const char*>& get_name(ReadIndex i) const {
+        return my_names[i];
+    }
+
+    void first_touch() {
+        touch_on_growth(my_sequences, my_sequences_touched);
+        touch_on_growth(my_names, my_names_touched);
+    }
+
+private:
+    std::vector<std::pair<const char*, const char*> > my_sequences, my_names;
+    std::size_t my_sequences_touched = 0, my_names_touched = 0;
+};
+
+// Readers that report pointers (rather than their own buffers) are assumed to
+// guarantee the validity of those pointers for their lifetime, so we can skip the copy.
+template<class Reader_>
+using ChunkForReader = typename std::conditional<
+    std::is_same<typename std::decay<decltype(std::declval<Reader_&>().get_sequence())>::type, std::pair<const char*, const char*> >::value,
+    ChunkOfReadViews,
+    ChunkOfReads
+>::type;
+
+// Readers can provide views of their sequence and name to avoid an intermediate copy before we add them to the chunk.
+template<class Reader_, typename = int>
+struct reader_has_views : public std::false_type {};
 
-                    env.has_output = true;
-                    env.available = true;
-                    env.cv.notify_one();
+template<class Reader_>
+struct reader_has_views<Reader_, decltype((void)std::declval<const Reader_&>().get_sequence_view(), 0)> : public std::true_type {};
+
+template<class Reader_>
+decltype(auto) sequence_of(const Reader_& fastq) {
+    if constexpr(reader_has_views<Reader_>::value) {
+        return fastq.get_sequence_view();
+    } else {
+        return fastq.get_sequence();
+    }
+}
+
+template<class Reader_>
+decltype(auto) name_of(const Reader_& fastq) {
+    if constexpr(reader_has_views<Reader_>::value) {
+        return fastq.get_name_view();
+    } else {
+        return fastq.get_name();
+    }
+}
+
+template<bool use_names_, class Reader_, class Chunk_>
+bool fill_chunk(Reader_& fastq, Chunk_& chunk, std::size_t block_size) {
+    for (ReadIndex b = 0; b < block_size; ++b) {
+        if (!fastq()) {
+            return true;
+        }
+
+        chunk.add_read_sequence(sequence_of(fastq));
+        if constexpr(use_names_) {
+            chunk.add_read_name(name_of(fastq));
+        }
+    }
+    return false;
+}
+
+// Runs one job at a time on a persistent thread, so that the caller can do
+// something else (e.g., parse the other mate) while waiting for it to finish.
+class BackgroundJob {
+public:
+    BackgroundJob() {
+        my_thread = std::thread([this]() -> void {
+            while (1) {
+                std::unique_lock lck(my_mut);
+                my_cv.wait(lck, [&]() -> bool { return my_submitted || my_terminated; });
+                if (my_terminated) {
+                    return;
                 }
-            }, t);
+
+                my_submitted = false;
+                lck.unlock();
+
+                std::exception_ptr error;
+                try {
+                    my_job();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+
+                lck.lock();
+                my_error = error;
+                my_finished = true;
+                lck.unlock();
+                my_cv.notify_all();
+            }
+        });
+    }
+
+    BackgroundJob(const BackgroundJob&) = delete;
+    BackgroundJob& operator=(const BackgroundJob&) = delete;
+
+    ~BackgroundJob() {
+        {
+            std::lock_guard lck(my_mut);
+            my_terminated = true;
         }
+        my_cv.notify_all();
+        my_thread.join();
+    }
+
+private:
+    std::mutex my_mut;
+    std::condition_variable my_cv;
+    std::function<void()> my_job;
+    bool my_submitted = false;
+    bool my_finished = false;
+    bool my_terminated = false;
+    std::exception_ptr my_error;
+    std::thread my_thread;
 
-        // Only returning once all threads (and their specific mutexes) are initialized.
+public:
+    void submit(std::function<void()> job) {
         {
-            std::unique_lock ilck(init_mut);
-            init_cv.wait(ilck, [&]() -> bool { return num_initialized == num_threads; });
+            std::lock_guard lck(my_mut);
+            my_job = std::move(job);
+            my_submitted = true;
+            my_finished = false;
         }
+        my_cv.notify_all();
     }
 
-    ~ThreadPool() {
-        for (auto envptr : my_helpers) {
-            auto& env = *envptr;
-            {
-                std::lock_guard lck(env.mut);
-                env.terminated = true;
-                env.input_ready = true;
+    void wait() {
+        std::unique_lock lck(my_mut);
+        my_cv.wait(lck, [&]() -> bool { return my_finished; });
+        if (my_error) {
+            auto err = my_error;
+            my_error = nullptr;
+            std::rethrow_exception(err);
+        }
+    }
+};
+
+// Chooses the number of reads per chunk. In adaptive mode, the size is adjusted
+// by comparing the time taken to process each chunk with the time taken to parse it.
+// If the workers can process chunks faster than the caller can parse them, the workers
+// would otherwise be idle; so we grow the chunks to amortize the cost of each handoff.
+// If the workers are slower, the reader is blocked regardless of the chunk size;
+// so we shrink the chunks to balance the load at the end of the run, but not below
+// the point where each chunk is too quick for the handoff to be negligible.
+class BlockSizer {
+public:
+    BlockSizer(std::size_t block_size) : my_size(std::max(block_size, static_cast<std::size_t>(1))), my_lower(my_size), my_upper(my_size) {}
+
+    BlockSizer(std::size_t block_size, std::size_t lower, std::size_t upper, int num_threads) : 
+        my_lower(std::max(lower, static_cast<std::size_t>(1))), 
+        my_upper(std::max(upper, my_lower)),
+        my_num_threads(std::max(num_threads, 1))
+    {
+        my_size = std::min(std::max(block_size, my_lower), my_upper);
+    }
+
+private:
+    std::size_t my_size, my_lower, my_upper;
+    int my_num_threads = 1;
+
+public:
+    std::size_t get() const {
+        return my_size;
+    }
+
+    bool adaptive() const {
+        return my_lower < my_upper;
+    }
+
+    // Minimum processing time per chunk, in seconds, below which we don't shrink any further.
+    static constexpr double min_chunk_time = 0.01;
+
+    void update(double parse_time, double process_time) {
+        if (!(parse_time > 0)) {
+            return; 
+        }
+        double ratio = process_time / (parse_time * my_num_threads);
+        if (ratio < 0.5) {
+            my_size = (my_size > my_upper / 2 ? my_upper : my_size * 2);
+        } else if (ratio > 1 && process_time > 2 * min_chunk_time) {
+            my_size = std::max(my_size / 2, my_lower);
+        }
+    }
+};
+
+template<typename Workspace_>
+class ThreadPool {
+public:
+    ThreadPool(
+        std::function<void(Workspace_&)> run_job,
+        int num_threads,
+        std::size_t num_workspaces = 0,
+        Executor* executor = NULL,
+        const std::vector<int>& cpu_affinity = std::vector<int>()
+    ) : 
+        my_run_job(std::move(run_job))
+    {
+        if (num_threads < 1) {
+            num_threads = 1;
+        }
+        if (num_workspaces < static_cast<std::size_t>(num_threads)) {
+            num_workspaces = (num_workspaces == 0 ? 2 * static_cast<std::size_t>(num_threads) : static_cast<std::size_t>(num_threads));
+        }
+
+        if (executor) {
+            my_executor = executor;
+        } else {
+            DefaultExecutorOptions eopt;
+            eopt.cpus = cpu_affinity;
+            my_own_executor.reset(new DefaultExecutor(num_threads, eopt));
+            my_executor = my_own_executor.get();
+        }
+
+        // Allocating each workspace on its home worker, so that its memory is first touched on the same NUMA node as the worker that will usually process it.
+        // The handler state is also initialized by the worker in each job, while the read buffers are moved to the worker's memory after they are grown by the parser (see touch_on_growth()).
+        my_slots.resize(num_workspaces);
+        std::vector<std::exception_ptr> errors(num_workspaces);
+        for (std::size_t w = 0; w < num_workspaces; ++w) {
+            my_executor->submit_to(w, [this,w,&errors]() -> void {
+                try {
+                    my_slots[w].reset(new Slot);
+                    my_slots[w]->home = w;
+                } catch (...) {
+                    errors[w] = std::current_exception();
+                }
+            });
+        }
+        my_executor->wait();
+        for (const auto& err : errors) {
+            if (err) {
+                std::rethrow_exception(err);
             }
-            env.cv.notify_one();
         }
-        for (auto& thread : my_threads) {
-            thread.join();
+    }
+
+    ~ThreadPool() {
+        // Skipping any jobs that haven't started yet, and waiting for the rest to finish before the workspaces are destroyed.
+        {
+            std::lock_guard lck(my_mut);
+            my_terminated = true;
         }
+        my_executor->wait();
     }
 
 private:
-    std::vector<std::thread> my_threads;
-
-    struct Helper {
-        std::mutex mut;
-        std::condition_variable cv;
-        bool input_ready = false;
-        bool available = true;
-        bool has_output = false;
-        bool terminated = false;
+    std::function<void(Workspace_&)> my_run_job;
+    std::unique_ptr<DefaultExecutor> my_own_executor;
+    Executor* my_executor;
+
+    struct Slot {
         Workspace_ work;
+        bool done = false;
+        std::size_t home = 0;
+        double parse_time = 0;
+        double process_time = 0;
+        unsigned long long sequence = 0;
+        bool failed = false;
     };
-    std::vector<Helper*> my_helpers;
+    std::vector<std::unique_ptr<Slot> > my_slots;
 
-    std::mutex my_error_mut;
+    // All of the members below are protected by 'my_mut'.
+    std::mutex my_mut;
+    std::condition_variable my_done_cv;
+    std::deque<Slot*> my_done; // processed workspaces waiting to be merged, only used for unordered runs.
+    bool my_ordered = true;
+    bool my_terminated = false;
     std::exception_ptr my_error;
+    ProcessDataStats my_stats;
+
+    std::function<void(const ProcessDataStats&)> my_progress;
+    double my_progress_interval = 0;
+    BlockSizer* my_sizer = NULL;
+
+    std::function<void()> my_checkpoint;
+    double my_checkpoint_interval = 0;
+    std::chrono::steady_clock::time_point my_last_checkpoint;
+
+    const CancellationToken* my_cancellation = NULL;
+    unsigned long long my_max_reads = std::numeric_limits<unsigned long long>::max();
+    double my_time_limit = std::numeric_limits<double>::infinity();
+    std::chrono::steady_clock::time_point my_start_time, my_last_progress;
+
+    // Merging on the workers, if requested with set_background_merge().
+    // The members below are protected by 'my_merge_mut', except for 'my_next_sequence' which is only used by the thread that calls dispatch().
+    std::function<void(Workspace_&)> my_background_merge;
+    std::mutex my_merge_mut;
+    std::vector<Slot*> my_merge_pending;
+    bool my_merging = false;
+    bool my_merge_failed = false;
+    unsigned long long my_next_merge = 0;
+    unsigned long long my_next_sequence = 0;
+    double my_background_reduce_time = 0;
+
+    static double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void mark_done(Slot* slot) {
+        {
+            std::lock_guard lck(my_mut);
+            slot->done = true;
+            if (!my_ordered) {
+                my_done.push_back(slot);
+            }
+        }
+        my_done_cv.notify_all();
+    }
+
+    // Whichever worker finds the next slot in the merge order will merge it, along with any subsequent slots that have already been processed.
+    // Other workers just leave their slots in the pending list and return, so that they are not blocked by a slow merge.
+    void merge_in_background(Slot* slot) {
+        std::unique_lock mlck(my_merge_mut);
+        my_merge_pending.push_back(slot);
+        if (my_merging) {
+            return;
+        }
+        my_merging = true;
+
+        while (1) {
+            auto it = my_merge_pending.begin();
+            if (my_ordered) {
+                while (it != my_merge_pending.end() && (*it)->sequence != my_next_merge) {
+                    ++it;
+                }
+            }
+            if (it == my_merge_pending.end()) {
+                break;
+            }
+            Slot* current = *it;
+            my_merge_pending.erase(it);
+            ++my_next_merge;
+            bool skip = current->failed || my_merge_failed;
+            mlck.unlock();
+
+            std::exception_ptr error;
+            double elapsed = 0;
+            if (!skip) {
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    my_background_merge(current->work);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                elapsed = seconds_since(start);
+            }
+            if (error) {
+                std::lock_guard lck(my_mut);
+                if (!my_error) {
+                    my_error = error;
+                }
+            }
+            mark_done(current);
+
+            mlck.lock();
+            my_background_reduce_time += elapsed;
+            if (error) {
+                my_merge_failed = true;
+            }
+        }
+
+        my_merging = false;
+    }
+
+    void submit(Slot* slot) {
+        my_executor->submit_to(slot->home, [this,slot]() -> void {
+            bool skip;
+            {
+                std::lock_guard lck(my_mut);
+                skip = my_terminated;
+            }
+
+            std::exception_ptr error;
+            double elapsed = 0;
+            if (!skip) {
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    my_run_job(slot->work);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                elapsed = seconds_since(start);
+            }
+
+            if (my_background_merge) {
+                {
+                    std::lock_guard lck(my_mut);
+                    if (error && !my_error) {
+                        my_error = error;
+                    }
+                    slot->process_time = elapsed;
+                }
+                slot->failed = (skip || error);
+                merge_in_background(slot);
+                return;
+            }
+
+            {
+                std::lock_guard lck(my_mut);
+                if (error && !my_error) {
+                    my_error = error;
+                }
+                slot->process_time = elapsed;
+                slot->done = true;
+                if (!my_ordered) {
+                    my_done.push_back(slot);
+                }
+            }
+            my_done_cv.notify_one();
+        });
+    }
 
 public:
+    Executor& executor() {
+        return *my_executor;
+    }
+
+    // Only safe to call when no jobs are running, e.g., after run() returns.
+    template<typename Function_>
+    void for_each_workspace(Function_ fun) {
+        for (auto& slot : my_slots) {
+            fun(slot->work);
+        }
+    }
+
+    // Only safe to call when no jobs are running, e.g., after run() returns.
+    const ProcessDataStats& stats() const {
+        return my_stats;
+    }
+
+    // Callback to report progress during a run, called on the same thread as run() or dispatch().
+    void set_progress(std::function<void(const ProcessDataStats&)> progress, double interval) {
+        my_progress = std::move(progress);
+        my_progress_interval = interval;
+    }
+
+    // Adjusts the block size based on the timings of each completed chunk, if the sizer is adaptive.
+    void set_block_sizer(BlockSizer& sizer) {
+        my_sizer = (sizer.adaptive() ? &sizer : NULL);
+        my_stats.block_size = sizer.get();
+    }
+
+    // Callback to create a checkpoint during run(), after all in-flight chunks have been merged.
+    void set_checkpoint(std::function<void()> checkpoint, double interval) {
+        my_checkpoint = std::move(checkpoint);
+        my_checkpoint_interval = interval;
+    }
+
+    // Stops parsing new chunks once any of these conditions are met; in-flight chunks are still processed and merged.
+    void set_limits(const CancellationToken* cancellation, unsigned long long max_reads, double time_limit) {
+        my_cancellation = cancellation;
+        my_max_reads = max_reads;
+        my_time_limit = time_limit;
+    }
+
+    // Number of reads to parse into the next chunk, so that the total does not exceed the maximum.
+    std::size_t limit_block_size(std::size_t block_size) const {
+        auto remaining = my_max_reads - std::min(my_max_reads, my_stats.num_reads);
+        return (remaining < block_size ? remaining : block_size);
+    }
+
+    // Records the input consumed by the latest chunk; 'total_bytes' is the cumulative number of bytes consumed so far.
+    void record_input(std::size_t num_reads, unsigned long long total_bytes) {
+        my_stats.num_reads += num_reads;
+        my_stats.num_bytes = total_bytes;
+    }
+
+    // Merges each workspace on the worker that processed it, immediately after processing, instead of on the calling thread in acquire() or finish().
+    // Merges are serialized and follow the order of dispatch() for ordered runs; the 'merge_job' passed to acquire() or finish() is then only used to reset the workspace.
+    // This should be called before start().
+    void set_background_merge(std::function<void(Workspace_&)> merge) {
+        my_background_merge = std::move(merge);
+    }
+
+    // Reduction that is performed by the caller after finish(), e.g., for persistent states.
+    template<typename Function_>
+    void timed_reduce(Function_ fun) {
+        auto start = std::chrono::steady_clock::now();
+        fun();
+        my_stats.reduce_time += seconds_since(start);
+    }
+
+    // Finalizes the statistics for this run, and reports the final progress.
+    void complete() {
+        {
+            std::lock_guard mlck(my_merge_mut);
+            my_stats.reduce_time += my_background_reduce_time;
+            my_background_reduce_time = 0;
+        }
+        my_stats.elapsed = seconds_since(my_start_time);
+        if (my_progress) {
+            my_progress(my_stats);
+        }
+    }
+
+    // We submit jobs in order of parsing, and merge their results in the same order.
+    // Multiple workspaces can be in flight at once, so parsing can run ahead of the processing
+    // and a slow chunk only stalls the merges, not the processing of subsequent chunks.
     template<typename CreateJob_, typename MergeJob_>
     void run(CreateJob_ create_job, MergeJob_ merge_job) {
-        auto num_threads = my_threads.size();
+        run_internal(true, std::move(create_job), std::move(merge_job));
+    }
+
+    // Alternative to run() where results are merged as soon as each job completes.
+    // This avoids stalling on a slow chunk but the order of merges is no longer deterministic,
+    // so it should only be used if 'merge_job' is commutative.
+    template<typename CreateJob_, typename MergeJob_>
+    void run_unordered(CreateJob_ create_job, MergeJob_ merge_job) {
+        run_internal(false, std::move(create_job), std::move(merge_job));
+    }
+
+private:
+    template<typename CreateJob_, typename MergeJob_>
+    void run_internal(bool ordered, CreateJob_ create_job, MergeJob_ merge_job) {
+        start(ordered);
         bool finished = false;
-        decltype(num_threads) thread = 0, finished_count = 0;
+        while (!finished) {
+            if (stop_requested()) {
+                my_stats.stopped = true;
+                break;
+            }
 
-        // We submit jobs by cycling through all threads, then we merge their results in order of submission.
-        // This is a less efficient worksharing scheme but it guarantees the same order of merges.
-        while (1) {
-            auto& env = (*my_helpers[thread]);
-            std::unique_lock lck(env.mut);
-            env.cv.wait(lck, [&]() -> bool { return env.available; });
+            // 'create_job' is responsible for parsing the FASTQ file and
+            // creating a ChunkOfReads. Parsing is serial here as the input
+            // might not be seekable; see process_single_end_file() for
+            // parallel parsing of uncompressed files.
+            auto& work = acquire(merge_job);
+            auto start = std::chrono::steady_clock::now();
+            finished = create_job(work);
+            my_current->parse_time = seconds_since(start);
+            my_stats.parse_time += my_current->parse_time;
+            dispatch();
 
-            {
-                std::lock_guard elck(my_error_mut);
-                if (my_error) {
-                    std::rethrow_exception(my_error);
+            if (my_checkpoint && !finished && seconds_since(my_last_checkpoint) >= my_checkpoint_interval) {
+                // Merging all in-flight chunks, so that the results are consistent with all reads parsed so far.
+                while (auto slot = retrieve(&(my_stats.parse_wait), merge_job)) {
+                    my_available.push_back(slot);
                 }
+                my_checkpoint();
+                my_last_checkpoint = std::chrono::steady_clock::now();
             }
-            env.available = false;
+        }
+        finish(merge_job);
+    }
 
-            if (env.has_output) {
-                merge_job(env.work);
-                env.has_output = false;
-            }
+    bool stop_requested() const {
+        return (my_cancellation && my_cancellation->cancelled()) 
+            || my_stats.num_reads >= my_max_reads 
+            || seconds_since(my_start_time) >= my_time_limit;
+    }
+
+    // State of the current run, only accessed by the thread that calls start(), acquire(), dispatch() and finish().
+    std::vector<Slot*> my_available;
+    std::deque<Slot*> my_in_flight; // in order of submission, only used for ordered runs.
+    std::size_t my_num_in_flight = 0;
+    Slot* my_current = NULL;
 
-            if (finished) {
-                // Go through all threads one last time, making sure all results are merged.
-                ++finished_count;
-                if (finished_count == num_threads) {
-                    break;
+    // Retrieves and merges the next completed workspace. If 'wait = NULL', this returns NULL if no workspace has completed yet.
+    // Otherwise, it only returns NULL if no workspaces are in flight, and the time spent waiting is added to 'wait'.
+    template<typename MergeJob_>
+    Slot* retrieve(double* wait, MergeJob_& merge_job) {
+        Slot* slot;
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::unique_lock lck(my_mut);
+            if (my_ordered) {
+                if (my_in_flight.empty()) {
+                    return NULL;
                 }
+                slot = my_in_flight.front();
+                if (wait == NULL && !slot->done) {
+                    return NULL;
+                }
+                my_done_cv.wait(lck, [&]() -> bool { return slot->done; });
+                my_in_flight.pop_front();
             } else {
-                // 'create_job' is responsible for parsing the FASTQ file and
-                // creating a ChunkOfReads. Unfortunately I can't figure out
-                // how to parallelize the parsing as it is very hard to jump
-                // into a middle of a FASTQ file and figure out where the next
-                // entry is; this is because (i) multiline sequences are legal
-                // and (ii) +/@ are not sufficient delimiters when they can
-                // show up in the quality scores.
-                finished = create_job(env.work);
-                env.input_ready = true;
-                lck.unlock();
-                env.cv.notify_one();
+                if (my_done.empty() && (wait == NULL || my_num_in_flight == 0)) {
+                    return NULL;
+                }
+                my_done_cv.wait(lck, [&]() -> bool { return !my_done.empty(); });
+                slot = my_done.front();
+                my_done.pop_front();
             }
+            --my_num_in_flight;
+
+            if (my_error) {
+                std::rethrow_exception(my_error);
+            }
+            slot->done = false;
+            if (wait) {
+                *wait += seconds_since(start);
+            }
+        }
+
+        if (my_sizer) {
+            my_sizer->update(slot->parse_time, slot->process_time);
+            my_stats.block_size = my_sizer->get();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        merge_job(slot->work);
+        my_stats.reduce_time += seconds_since(start);
+        return slot;
+    }
+
+public:
+    // Incremental interface for callers that produce chunks on their own schedule, e.g., when reads are pushed by the caller.
+    // This should be used as start(), then any number of acquire()/dispatch() pairs, followed by finish().
+    void start(bool ordered) {
+        {
+            std::lock_guard lck(my_mut);
+            my_ordered = ordered;
+        }
+        my_available.clear();
+        for (auto it = my_slots.rbegin(); it != my_slots.rend(); ++it) {
+            my_available.push_back(it->get());
+        }
+        my_start_time = std::chrono::steady_clock::now();
+        my_last_progress = my_start_time;
+        my_last_checkpoint = my_start_time;
+
+        my_next_sequence = 0;
+        {
+            std::lock_guard mlck(my_merge_mut);
+            my_next_merge = 0;
+            my_merge_failed = false;
+        }
+    }
+
+    // Returns an empty workspace to be filled by the caller, waiting for (and merging) an in-flight workspace if necessary.
+    template<typename MergeJob_>
+    Workspace_& acquire(MergeJob_ merge_job) {
+        // Merging anything that's already done, so that its workspace can be reused.
+        while (auto slot = retrieve(NULL, merge_job)) {
+            my_available.push_back(slot);
+        }
 
-            ++thread;
-            if (thread == num_threads) {
-                thread = 0;
+        if (!my_available.empty()) {
+            my_current = my_available.back();
+            my_available.pop_back();
+        } else {
+            my_current = retrieve(&(my_stats.parse_wait), merge_job);
+        }
+        return my_current->work;
+    }
+
+    // Submits the workspace from the last call to acquire() for processing.
+    void dispatch() {
+        my_current->sequence = my_next_sequence++;
+        if (my_ordered) {
+            my_in_flight.push_back(my_current);
+        }
+        ++my_num_in_flight;
+        ++my_stats.num_chunks;
+        submit(my_current);
+        my_current = NULL;
+
+        if (my_progress) {
+            auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration<double>(now - my_last_progress).count() >= my_progress_interval) {
+                my_stats.elapsed = std::chrono::duration<double>(now - my_start_time).count();
+                my_progress(my_stats);
+                my_last_progress = now;
             }
         }
     }
+
+    // Waits for all in-flight workspaces and merges them.
+    template<typename MergeJob_>
+    void finish(MergeJob_ merge_job) {
+        while (retrieve(&(my_stats.drain_wait), merge_job)) {}
+
+        // Worker times are only available for our own executor.
+        if (my_own_executor) {
+            my_own_executor->wait();
+            my_stats.thread_busy = my_own_executor->busy_times();
+            my_stats.thread_idle = my_own_executor->idle_times();
+            my_stats.process_wait = std::accumulate(my_stats.thread_idle.begin(), my_stats.thread_idle.end(), 0.0);
+        }
+    }
 };
 
+// Handlers can declare that the order of their reductions does not matter.
+template<class Handler_, typename = int>
+struct handler_is_commutative : public std::false_type {};
+
+template<class Handler_>
+struct handler_is_commutative<Handler_, decltype((void)Handler_::commutative, 0)> : public std::integral_constant<bool, Handler_::commutative> {};
+
+// Handlers can declare that reduce() leaves the state ready for reuse.
+template<class Handler_, typename = int>
+struct handler_has_reusable_state : public std::false_type {};
+
+template<class Handler_>
+struct handler_has_reusable_state<Handler_, decltype((void)Handler_::reusable_state, 0)> : public std::integral_constant<bool, Handler_::reusable_state> {};
+
+// Byte sources can provide a seek() method to resume from a checkpoint without re-parsing the preceding reads.
+template<class Source_, typename = int>
+struct source_has_seek : public std::false_type {};
+
+template<class Source_>
+struct source_has_seek<Source_, decltype(std::declval<Source_&>().seek(std::declval<unsigned long long>()), 0)> : public std::true_type {};
+
+// Handlers can provide a merge() method to combine two states in a worker thread.
+template<class Handler_, typename = int>
+struct handler_has_merge : public std::false_type {};
+
+template<class Handler_>
+struct handler_has_merge<Handler_, decltype(
+    std::declval<const Handler_&>().merge(std::declval<decltype(std::declval<const Handler_&>().initialize())&>(), std::declval<decltype(std::declval<const Handler_&>().initialize())&>()),
+    0
+)> : public std::true_type {};
+
+// Single-end handlers can provide a process_batch() method to process multiple reads at once.
+template<class Handler_, typename = int>
+struct handler_has_process_batch : public std::false_type {};
+
+template<class Handler_>
+struct handler_has_process_batch<Handler_, decltype(
+    std::declval<const Handler_&>().process_batch(
+        std::declval<decltype(std::declval<const Handler_&>().initialize())&>(),
+        std::declval<const std::pair<const char*, const char*>*>(),
+        std::declval<std::size_t>()
+    ),
+    0
+)> : public std::true_type {};
+
+// Pairwise merging of states in a binary tree, where all merges at the same level are run in parallel.
+// The combined results are stored in the first state.
+template<class Handler_, class State_>
+void tree_merge(const Handler_& handler, std::vector<State_*>& states, int num_threads, Executor& executor) {
+    std::size_t nstates = states.size();
+    for (std::size_t stride = 1; stride < nstates; stride *= 2) {
+        std::size_t step = stride * 2;
+        std::size_t npairs = (nstates - stride + step - 1) / step;
+        std::size_t ntasks = std::min(static_cast<std::size_t>(std::max(num_threads, 1)), npairs);
+        std::vector<std::exception_ptr> errors(ntasks);
+
+        for (std::size_t t = 0; t < ntasks; ++t) {
+            executor.submit([&,t]() -> void {
+                try {
+                    for (std::size_t p = t; p < npairs; p += ntasks) {
+                        handler.merge(*(states[p * step]), *(states[p * step + stride]));
+                    }
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+        executor.wait();
+
+        for (const auto& err : errors) {
+            if (err) {
+                std::rethrow_exception(err);
+            }
+        }
+    }
+}
+
+template<class Handler_, class Pool_>
+void reduce_persistent_states(Handler_& handler, Pool_& tp, int num_threads) {
+    typedef typename std::remove_reference<decltype(handler.initialize())>::type State;
+    std::vector<State*> states;
+    tp.for_each_workspace([&](auto& work) -> void {
+        if (work.initialized) {
+            states.push_back(&(work.state));
+        }
+    });
+
+    if constexpr(handler_has_merge<Handler_>::value) {
+        if (states.size() > 1) {
+            tree_merge(handler, states, num_threads, tp.executor());
+            states.resize(1);
+        }
+    }
+
+    for (auto sptr : states) {
+        handler.reduce(*sptr);
+    }
+
+    // Reinitializing all states if the workspaces are used again, e.g., after a checkpoint.
+    tp.for_each_workspace([&](auto& work) -> void {
+        work.initialized = false;
+    });
+}
+
+template<class Handler_, class Pool_, typename CreateJob_, typename MergeJob_>
+void run_thread_pool(Pool_& tp, CreateJob_ create_job, MergeJob_ merge_job) {
+    if constexpr(handler_is_commutative<Handler_>::value) {
+        tp.run_unordered(std::move(create_job), std::move(merge_job));
+    } else {
+        tp.run(std::move(create_job), std::move(merge_job));
+    }
+}
+
+// Returns whether the source was positioned at the resumed checkpoint; otherwise, the preceding reads need to be skipped by parsing.
+template<class Source_>
+bool seek_to_checkpoint(Source_& source, const ProcessDataCheckpoint* resume, std::size_t index, std::size_t num_sources) {
+    if constexpr(source_has_seek<Source_>::value) {
+        if (resume) {
+            if (resume->offsets.size() != num_sources) {
+                throw std::runtime_error("number of offsets in 'resume' is not consistent with the number of input sources");
+            }
+            source.seek(resume->offsets[index]);
+            return true;
+        }
+    }
+    return false;
+}
+
+template<class Options_>
+unsigned long long reads_before_start(const Options_& options) {
+    return (options.resume ? options.resume->num_reads : options.skip_reads);
+}
+
+template<class Options_>
+unsigned long long reads_to_skip(const Options_& options, bool seeked) {
+    return (seeked ? 0 : reads_before_start(options));
+}
+
+template<class Options_>
+unsigned long long start_offset(const Options_& options, bool seeked, std::size_t index) {
+    return (seeked ? options.resume->offsets[index] : 0);
+}
+
+template<class Options_, class Pool_>
+void report_checkpoint(const Options_& options, const Pool_& tp, std::vector<unsigned long long> offsets) {
+    ProcessDataCheckpoint checkpoint;
+    checkpoint.num_reads = reads_before_start(options) + tp.stats().num_reads;
+    checkpoint.num_bytes = tp.stats().num_bytes;
+    checkpoint.offsets = std::move(offsets);
+    options.checkpoint(checkpoint);
+}
+
+template<class Handler_, class Options_, class Pool_, class Offsets_>
+void configure_checkpoint(Handler_& handler, const Options_& options, Pool_& tp, Offsets_& offsets) {
+    if (options.checkpoint) {
+        tp.set_checkpoint(
+            [&]() -> void {
+                if (options.persistent_state) {
+                    tp.timed_reduce([&]() -> void {
+                        reduce_persistent_states(handler, tp, options.num_threads);
+                    });
+                }
+                report_checkpoint(options, tp, offsets());
+            },
+            options.checkpoint_interval
+        );
+    }
+}
+
+template<class Options_>
+BlockSizer create_block_sizer(const Options_& options) {
+    if (options.adaptive_block_size) {
+        return BlockSizer(options.block_size, options.min_block_size, options.max_block_size, options.num_threads);
+    } else {
+        return BlockSizer(options.block_size);
+    }
+}
+
 /**
  * @endcond
  */
@@ -228,29 +1176,279 @@ struct ProcessSingleEndDataOptions {
      */
     int num_threads = 1;
 
-    /**
-     * Size of the buffer for storing bytes from a FASTQ file prior to parsing.
-     * Larger values improve speed at the cost of increased memory usage.
-     */
-    std::size_t buffer_size = 65535;
+    /**
+     * Size of the buffer for storing bytes from a FASTQ file prior to parsing.
+     * Larger values improve speed at the cost of increased memory usage.
+     */
+    std::size_t buffer_size = 65535;
+
+    /**
+     * Number of reads to be processed in each thread.
+     * Smaller values improve work-sharing granularity but increase multi-threading overhead. 
+     */
+    std::size_t block_size = 65535; // use the smallest maximum value for a size_t.
+
+    /**
+     * Whether to adapt the number of reads in each chunk to the relative cost of parsing and processing.
+     * If `true`, `block_size` is only used as the initial size.
+     * Chunks are enlarged when the worker threads process them faster than they are parsed, to reduce the overhead of handing each chunk to a worker;
+     * and shrunk when the workers are slower, to balance the load across workers at the end of the run.
+     * The size is always kept within `[min_block_size, max_block_size]`.
+     */
+    bool adaptive_block_size = false;
+
+    /**
+     * Minimum number of reads in each chunk when `adaptive_block_size = true`.
+     */
+    std::size_t min_block_size = 1000;
+
+    /**
+     * Maximum number of reads in each chunk when `adaptive_block_size = true`.
+     * Larger values reduce overhead at the cost of memory usage, which increases with `max_block_size * queue_size`.
+     */
+    std::size_t max_block_size = 1000000;
+
+    /**
+     * Number of blocks (each of `buffer_size` bytes) to read ahead from the input source on a dedicated thread, see `PrefetchReader` for details.
+     * This allows decompression of Gzip-compressed inputs to overlap with parsing and processing.
+     * If zero, all reading is performed on the calling thread.
+     */
+    std::size_t prefetch_blocks = 0;
+
+    /**
+     * Whether each worker thread should keep its handler state across chunks.
+     * If `true`, `initialize()` is called once per chunk workspace (see `queue_size`) and `reduce()` is called once per workspace after all reads are processed.
+     * This avoids repeated allocation and reduction of large states, e.g., the count vectors for large barcode pools.
+     * However, the order of reduction no longer corresponds to the order of reads in the file, so this should only be used with handlers where the order does not matter.
+     * If `false`, a new state is created for each chunk of `block_size` reads and reduced in order of the chunks,
+     * unless the handler has a `reusable_state` flag, in which case each workspace's state is reused for the next chunk after its reduction.
+     *
+     * If the handler has a `merge()` method, the per-workspace states are combined in parallel with pairwise merges before a single call to `reduce()`.
+     * This is recommended for handlers with expensive reductions, e.g., those that populate large hash tables.
+     */
+    bool persistent_state = false;
+
+    /**
+     * Maximum number of chunks that can be in flight at any given time, i.e., parsed but not yet merged.
+     * Larger values allow parsing to run ahead of processing (and vice versa) at the cost of increased memory usage.
+     * If zero, this defaults to twice `num_threads`; otherwise, values less than `num_threads` are increased to `num_threads`.
+     */
+    std::size_t queue_size = 0;
+
+    /**
+     * Pointer to a `ProcessDataStats` object in which to store statistics about the run.
+     * If `NULL`, statistics are not reported.
+     */
+    ProcessDataStats* stats = NULL;
+
+    /**
+     * Pointer to an `Executor` that runs the processing of each chunk, e.g., to use an existing thread pool in the caller's application.
+     * If provided, `num_threads` should be set to the expected number of concurrently running tasks; it is used to choose the default `queue_size` and the number of parallel merges.
+     * If `NULL`, a `DefaultExecutor` with `num_threads` threads is used.
+     */
+    Executor* executor = NULL;
+
+    /**
+     * CPUs to which the worker threads should be pinned, see `DefaultExecutorOptions::cpus` for details.
+     * Each chunk workspace is allocated by, and preferentially processed on, the same worker so that the handler state remains local to that worker's NUMA node.
+     * This is ignored if `executor` is provided.
+     */
+    std::vector<int> cpu_affinity;
+
+    /**
+     * Function to report progress during long runs.
+     * This is called on the calling thread with the statistics accumulated so far, at most once every `progress_interval` seconds and once more upon completion.
+     * Worker-specific statistics (e.g., `ProcessDataStats::thread_busy`) are only available upon completion.
+     * If empty, no progress is reported.
+     */
+    std::function<void(const ProcessDataStats&)> progress;
+
+    /**
+     * Minimum interval between calls to `progress`, in seconds.
+     */
+    double progress_interval = 10;
+
+    /**
+     * Token to cancel processing from another thread.
+     * Once cancelled, no further reads are parsed, but chunks that are already in flight are still processed and reduced into the handler.
+     * The handler will then contain consistent results for the first `ProcessDataStats::num_reads` reads.
+     * If `NULL`, processing cannot be cancelled.
+     */
+    const CancellationToken* cancellation = NULL;
+
+    /**
+     * Maximum number of reads to process, e.g., to only count the first 50 million reads.
+     * For paired-end data, each pair is counted as one read.
+     */
+    unsigned long long max_reads = std::numeric_limits<unsigned long long>::max();
+
+    /**
+     * Maximum wall-clock time for processing, in seconds.
+     * This is checked before parsing each chunk, after which parsing stops as if `cancellation` had been triggered.
+     * As in-flight chunks still need to be processed, the actual run time may exceed this limit by the time taken to process a few chunks.
+     */
+    double time_limit = std::numeric_limits<double>::infinity();
+
+    /**
+     * Function to checkpoint a long run, e.g., by saving the results of the handler (see its `save()` method) together with the supplied `ProcessDataCheckpoint`.
+     * This is called on the calling thread every `checkpoint_interval` seconds, after all parsed reads have been processed and reduced into the handler, including any persistent states.
+     * It is called once more if processing stops early due to `cancellation`, `max_reads` or `time_limit`, e.g., to save the results before the process is terminated.
+     * If empty, no checkpoints are created.
+     */
+    std::function<void(const ProcessDataCheckpoint&)> checkpoint;
+
+    /**
+     * Minimum interval between calls to `checkpoint`, in seconds.
+     * Each checkpoint waits for all in-flight chunks to be processed, so very small intervals will reduce throughput.
+     */
+    double checkpoint_interval = 600;
+
+    /**
+     * Number of reads to skip at the start of the input.
+     * Skipped reads are still parsed but are not passed to the handler, nor are they counted in `ProcessDataStats::num_reads` or towards `max_reads`.
+     * An error is raised if the input contains fewer than `skip_reads` reads.
+     * This is ignored if `resume` is provided.
+     */
+    unsigned long long skip_reads = 0;
+
+    /**
+     * Checkpoint from a previous run on the same input, from which to resume processing.
+     * The handler should already have been restored from this checkpoint (see its `load()` method).
+     * If the byte sources have a `seek(unsigned long long)` method, e.g., `MappedFastqReader`, they are positioned at `ProcessDataCheckpoint::offsets`; 
+     * note that this method must be visible from the type of the supplied pointer, not just the pointed-to object.
+     * Otherwise, the first `ProcessDataCheckpoint::num_reads` reads are skipped as described for `skip_reads`.
+     * If `NULL`, processing starts from the beginning of the input.
+     */
+    const ProcessDataCheckpoint* resume = NULL;
+};
+
+/**
+ * @cond
+ */
+template<class Chunk_, class State_>
+struct SingleEndWorkspace {
+    Chunk_ reads;
+    State_ state;
+    bool initialized = false;
+};
+
+template<class Handler_, class Workspace_>
+void process_single_end_chunk(const Handler_& handler, Workspace_& work, bool persistent_state) {
+    auto& state = work.state;
+    // Reinitializing non-persistent states for simplicity and to avoid accumulation of reserved memory,
+    // unless the handler promises that reduce() has already reset the state for reuse.
+    if (!work.initialized || (!persistent_state && !handler_has_reusable_state<Handler_>::value)) {
+        state = handler.initialize();
+        work.initialized = true;
+    }
+    const auto& curreads = work.reads;
+    auto nreads = curreads.size();
+
+    if constexpr(!Handler_::use_names && handler_has_process_batch<Handler_>::value) {
+        constexpr std::size_t batch_size = 256;
+        std::array<std::pair<const char*, const char*>, batch_size> batch;
+        for (decltype(nreads) b = 0; b < nreads; b += batch_size) {
+            std::size_t n = std::min(static_cast<std::size_t>(nreads - b), batch_size);
+            for (std::size_t i = 0; i < n; ++i) {
+                batch[i] = curreads.get_sequence(b + i);
+            }
+            handler.process_batch(state, batch.data(), n);
+        }
+    } else if constexpr(!Handler_::use_names) {
+        for (decltype(nreads) b = 0; b < nreads; ++b) {
+            handler.process(state, curreads.get_sequence(b));
+        }
+    } else {
+        for (decltype(nreads) b = 0; b < nreads; ++b) {
+            handler.process(state, curreads.get_name(b), curreads.get_sequence(b));
+        }
+    }
+
+    work.reads.first_touch();
+}
+
+template<class Reader_, class Handler_>
+void process_single_end_reads(Reader_& fastq, Handler_& handler, const ProcessSingleEndDataOptions& options, bool seeked) {
+    typedef SingleEndWorkspace<ChunkForReader<Reader_>, decltype(handler.initialize())> Workspace;
+    const Handler_& conhandler = handler; // Safety measure to enforce const-ness within each thread.
+
+    auto skip = reads_to_skip(options, seeked);
+    for (unsigned long long r = 0; r < skip; ++r) {
+        if (!fastq()) {
+            throw std::runtime_error("fewer reads in the input than 'skip_reads'");
+        }
+    }
+
+    ThreadPool<Workspace> tp(
+        [&](Workspace& work) -> void {
+            process_single_end_chunk(conhandler, work, options.persistent_state);
+        },
+        options.num_threads,
+        options.queue_size,
+        options.executor,
+        options.cpu_affinity
+    );
+
+    if (options.progress) {
+        tp.set_progress(options.progress, options.progress_interval);
+    }
+
+    auto sizer = create_block_sizer(options);
+    tp.set_block_sizer(sizer);
+    tp.set_limits(options.cancellation, options.max_reads, options.time_limit);
+
+    auto start = start_offset(options, seeked, 0);
+    auto offsets = [&]() -> std::vector<unsigned long long> {
+        return { start + fastq.position() };
+    };
+    configure_checkpoint(handler, options, tp, offsets);
+
+    run_thread_pool<Handler_>(
+        tp,
+        [&](Workspace& work) -> bool {
+            bool finished = fill_chunk<Handler_::use_names>(fastq, work.reads, tp.limit_block_size(sizer.get()));
+            tp.record_input(work.reads.size(), fastq.position());
+            return finished;
+        },
+        [&](Workspace& work) -> void {
+            if (!options.persistent_state) {
+                handler.reduce(work.state);
+            }
+            work.reads.clear(Handler_::use_names);
+        }
+    );
+
+    if (options.persistent_state) {
+        tp.timed_reduce([&]() -> void {
+            reduce_persistent_states(handler, tp, options.num_threads);
+        });
+    }
 
-    /**
-     * Number of reads to be processed in each thread.
-     * Smaller values improve work-sharing granularity but increase multi-threading overhead. 
-     */
-    std::size_t block_size = 65535; // use the smallest maximum value for a size_t.
-};
+    if (options.checkpoint && tp.stats().stopped) {
+        report_checkpoint(options, tp, offsets());
+    }
+
+    tp.complete();
+    if (options.stats) {
+        *(options.stats) = tp.stats();
+    }
+}
+/**
+ * @endcond
+ */
 
 /**
  * Run a handler for each read in single-end data, by calling `handler.process()` on each read.
  * It is expected that the results are stored in `handler` for retrieval by the caller.
  *
+ * @tparam Reader_ Class template for a reader that parses records from a byte source, e.g., `FastqReader`, `FastaReader` or `LineSequenceReader`.
+ * This should accept a `Pointer_` and a buffer size in its constructor, and provide the same `operator()`, `get_sequence()` and `get_name()` methods as `FastqReader`.
  * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
  * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization. 
  * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object. 
  * @tparam Handler_ Class that implements a handler for single-end data.
  *
- * @param input Pointer to an input byte source containing data from a single-end FASTQ file.
+ * @param input Pointer to an input byte source containing data from a single-end FASTQ file (or another format supported by `Reader_`).
  * @param handler Handler instance for single-end data. 
  * @param options Further options.
  *
@@ -264,66 +1462,65 @@ struct ProcessSingleEndDataOptions {
  *
  * The `Handler` should have a static `constexpr` variable `use_names`, indicating whether or not names should be passed to the `process()` method.
  *
+ * The `Handler` may optionally have a static `constexpr` variable `commutative`.
+ * If this is `true`, the results of `reduce()` should not depend on the order in which the states are reduced.
+ * The state for each chunk of reads is then reduced as soon as its processing is complete, rather than waiting for all preceding chunks;
+ * this improves throughput when some chunks take longer than others.
+ * Otherwise, if `commutative` is absent or `false`, the states are always reduced in the same order as the chunks of reads in the input.
+ *
+ * The `Handler` may optionally implement a `merge(State& dest, State& src)` method.
+ * This should be a thread-safe `const` method that combines the results in `src` into `dest`; `src` may be left in an unspecified state.
+ * If present, it is used to combine states in parallel before the final `reduce()` when `persistent_state = true` in the options.
+ *
+ * The `Handler` may optionally have a static `constexpr` variable `reusable_state`.
+ * If this is `true`, `reduce()` should reset the state so that it can be used as if it were freshly returned by `initialize()`.
+ * When `persistent_state = false`, each state is then reused for subsequent chunks instead of being recreated with `initialize()`;
+ * this avoids repeated allocation of large states, e.g., the per-barcode counts for large pools.
+ *
  * If `use_names` is `false`, the `Handler` class should implement:
  * - `process(State& state, const std::pair<const char*, const char*>& seq)`: this should be a `const` method that processes the read in `seq` and stores its results in `state`.
  *   `seq` will contain pointers to the start and one-past-the-end of the read sequence.
  *
+ * The class may also implement:
+ * - `process_batch(State& state, const std::pair<const char*, const char*>* seqs, std::size_t num)`: 
+ *   this should be a `const` method that processes the `num` reads in `seqs` and stores their results in `state`.
+ *   The results should be the same as calling `process()` on each read in order.
+ *   If present, it is used instead of `process()` to allow the handler to search multiple reads together.
+ *
  * Otherwise, if `use_names` is `true`, the class should implement:
  * - `process(State& state, const std::pair<const char*, const char*>& name, const std::pair<const char*, const char*>& seq)`: 
  *    this should be a `const` method that processes the read in `seq` and stores its results in `state`.
  *   `name` will contain pointers to the start and one-past-the-end of the read name.
  *   `seq` will contain pointers to the start and one-past-the-end of the read sequence.
  */
-template<typename Pointer_, class Handler_>
+template<template<typename> class Reader_ = FastqReader, typename Pointer_, class Handler_>
 void process_single_end_data(Pointer_ input, Handler_& handler, const ProcessSingleEndDataOptions& options) {
-    struct SingleEndWorkspace {
-        ChunkOfReads reads;
-        decltype(handler.initialize()) state;
-    };
-
-    FastqReader<Pointer_> fastq(input, options.buffer_size);
-    const Handler_& conhandler = handler; // Safety measure to enforce const-ness within each thread.
-
-    ThreadPool<SingleEndWorkspace> tp(
-        [&](SingleEndWorkspace& work) -> void {
-            auto& state = work.state;
-            state = conhandler.initialize(); // reinitializing for simplicity and to avoid accumulation of reserved memory.
-            const auto& curreads = work.reads;
-            auto nreads = curreads.size();
-
-            if constexpr(!Handler_::use_names) {
-                for (decltype(nreads) b = 0; b < nreads; ++b) {
-                    conhandler.process(state, curreads.get_sequence(b));
-                }
-            } else {
-                for (decltype(nreads) b = 0; b < nreads; ++b) {
-                    conhandler.process(state, curreads.get_name(b), curreads.get_sequence(b));
-                }
-            }
-        },
-        options.num_threads
-    );
-
-    tp.run(
-        [&](SingleEndWorkspace& work) -> bool {
-            auto& curreads = work.reads;
-            for (ReadIndex b = 0; b < options.block_size; ++b) {
-                if (!fastq()) {
-                    return true;
-                }
+    bool seeked = seek_to_checkpoint(*input, options.resume, 0, 1);
+    if (options.prefetch_blocks) {
+        PrefetchReader<Pointer_> prefetched(std::move(input), options.buffer_size, options.prefetch_blocks);
+        Reader_<PrefetchReader<Pointer_>*> fastq(&prefetched, options.buffer_size);
+        process_single_end_reads(fastq, handler, options, seeked);
+    } else {
+        Reader_<Pointer_> fastq(std::move(input), options.buffer_size);
+        process_single_end_reads(fastq, handler, options, seeked);
+    }
+}
 
-                curreads.add_read_sequence(fastq.get_sequence());
-                if constexpr(Handler_::use_names) {
-                    curreads.add_read_name(fastq.get_name());
-                }
-            }
-            return false;
-        },
-        [&](SingleEndWorkspace& work) -> void {
-            handler.reduce(work.state);
-            work.reads.clear(Handler_::use_names);
-        }
-    );
+/**
+ * Overload of `process_single_end_data()` for a memory-mapped FASTQ file.
+ * Read sequences and names are passed to the handler as pointers into the mapping, avoiding any copies during chunking.
+ *
+ * @tparam Handler_ Class that implements a handler for single-end data.
+ *
+ * @param input A `MappedFastqReader` for a single-end FASTQ file.
+ * @param handler Handler instance for single-end data. 
+ * @param options Further options.
+ * `ProcessSingleEndDataOptions::buffer_size` is ignored.
+ */
+template<class Handler_>
+void process_single_end_data(MappedFastqReader& input, Handler_& handler, const ProcessSingleEndDataOptions& options) {
+    bool seeked = seek_to_checkpoint(input, options.resume, 0, 1);
+    process_single_end_reads(input, handler, options, seeked);
 }
 
 /**
@@ -346,12 +1543,391 @@ struct ProcessPairedEndDataOptions {
      * Smaller values improve work-sharing granularity but increase multi-threading overhead. 
      */
     std::size_t block_size = 100000;
+
+    /**
+     * Whether to adapt the number of reads in each chunk to the relative cost of parsing and processing.
+     * If `true`, `block_size` is only used as the initial size.
+     * Chunks are enlarged when the worker threads process them faster than they are parsed, to reduce the overhead of handing each chunk to a worker;
+     * and shrunk when the workers are slower, to balance the load across workers at the end of the run.
+     * The size is always kept within `[min_block_size, max_block_size]`.
+     */
+    bool adaptive_block_size = false;
+
+    /**
+     * Minimum number of reads in each chunk when `adaptive_block_size = true`.
+     */
+    std::size_t min_block_size = 1000;
+
+    /**
+     * Maximum number of reads in each chunk when `adaptive_block_size = true`.
+     * Larger values reduce overhead at the cost of memory usage, which increases with `max_block_size * queue_size`.
+     */
+    std::size_t max_block_size = 1000000;
+
+    /**
+     * Number of blocks (each of `buffer_size` bytes) to read ahead from each input source on a dedicated thread, see `PrefetchReader` for details.
+     * This allows decompression of Gzip-compressed inputs to overlap with parsing and processing.
+     * If zero, all reading is performed on the calling thread.
+     */
+    std::size_t prefetch_blocks = 0;
+
+    /**
+     * Whether to parse the two FASTQ files concurrently.
+     * If `true`, the second file is parsed on a dedicated helper thread while the first file is parsed on the calling thread,
+     * and the two meet after each chunk of `block_size` reads has been filled.
+     * This reduces the time spent in the serial parsing section at the cost of an extra thread.
+     */
+    bool concurrent_mates = false;
+
+    /**
+     * Whether each worker thread should keep its handler state across chunks.
+     * If `true`, `initialize()` is called once per chunk workspace (see `queue_size`) and `reduce()` is called once per workspace after all reads are processed.
+     * This avoids repeated allocation and reduction of large states, e.g., the count vectors for large barcode pools.
+     * However, the order of reduction no longer corresponds to the order of reads in the file, so this should only be used with handlers where the order does not matter.
+     * If `false`, a new state is created for each chunk of `block_size` reads and reduced in order of the chunks,
+     * unless the handler has a `reusable_state` flag, in which case each workspace's state is reused for the next chunk after its reduction.
+     *
+     * If the handler has a `merge()` method, the per-workspace states are combined in parallel with pairwise merges before a single call to `reduce()`.
+     * This is recommended for handlers with expensive reductions, e.g., those that populate large hash tables.
+     */
+    bool persistent_state = false;
+
+    /**
+     * Maximum number of chunks that can be in flight at any given time, i.e., parsed but not yet merged.
+     * Larger values allow parsing to run ahead of processing (and vice versa) at the cost of increased memory usage.
+     * If zero, this defaults to twice `num_threads`; otherwise, values less than `num_threads` are increased to `num_threads`.
+     */
+    std::size_t queue_size = 0;
+
+    /**
+     * Pointer to a `ProcessDataStats` object in which to store statistics about the run.
+     * If `NULL`, statistics are not reported.
+     */
+    ProcessDataStats* stats = NULL;
+
+    /**
+     * Pointer to an `Executor` that runs the processing of each chunk, e.g., to use an existing thread pool in the caller's application.
+     * If provided, `num_threads` should be set to the expected number of concurrently running tasks; it is used to choose the default `queue_size` and the number of parallel merges.
+     * If `NULL`, a `DefaultExecutor` with `num_threads` threads is used.
+     */
+    Executor* executor = NULL;
+
+    /**
+     * CPUs to which the worker threads should be pinned, see `DefaultExecutorOptions::cpus` for details.
+     * Each chunk workspace is allocated by, and preferentially processed on, the same worker so that the handler state remains local to that worker's NUMA node.
+     * This is ignored if `executor` is provided.
+     */
+    std::vector<int> cpu_affinity;
+
+    /**
+     * Function to report progress during long runs.
+     * This is called on the calling thread with the statistics accumulated so far, at most once every `progress_interval` seconds and once more upon completion.
+     * Worker-specific statistics (e.g., `ProcessDataStats::thread_busy`) are only available upon completion.
+     * If empty, no progress is reported.
+     */
+    std::function<void(const ProcessDataStats&)> progress;
+
+    /**
+     * Minimum interval between calls to `progress`, in seconds.
+     */
+    double progress_interval = 10;
+
+    /**
+     * Token to cancel processing from another thread.
+     * Once cancelled, no further reads are parsed, but chunks that are already in flight are still processed and reduced into the handler.
+     * The handler will then contain consistent results for the first `ProcessDataStats::num_reads` reads.
+     * If `NULL`, processing cannot be cancelled.
+     */
+    const CancellationToken* cancellation = NULL;
+
+    /**
+     * Maximum number of reads to process, e.g., to only count the first 50 million reads.
+     * For paired-end data, each pair is counted as one read.
+     */
+    unsigned long long max_reads = std::numeric_limits<unsigned long long>::max();
+
+    /**
+     * Maximum wall-clock time for processing, in seconds.
+     * This is checked before parsing each chunk, after which parsing stops as if `cancellation` had been triggered.
+     * As in-flight chunks still need to be processed, the actual run time may exceed this limit by the time taken to process a few chunks.
+     */
+    double time_limit = std::numeric_limits<double>::infinity();
+
+    /**
+     * Function to checkpoint a long run, e.g., by saving the results of the handler (see its `save()` method) together with the supplied `ProcessDataCheckpoint`.
+     * This is called on the calling thread every `checkpoint_interval` seconds, after all parsed reads have been processed and reduced into the handler, including any persistent states.
+     * It is called once more if processing stops early due to `cancellation`, `max_reads` or `time_limit`, e.g., to save the results before the process is terminated.
+     * If empty, no checkpoints are created.
+     */
+    std::function<void(const ProcessDataCheckpoint&)> checkpoint;
+
+    /**
+     * Minimum interval between calls to `checkpoint`, in seconds.
+     * Each checkpoint waits for all in-flight chunks to be processed, so very small intervals will reduce throughput.
+     */
+    double checkpoint_interval = 600;
+
+    /**
+     * Number of reads to skip at the start of the input.
+     * Skipped reads are still parsed but are not passed to the handler, nor are they counted in `ProcessDataStats::num_reads` or towards `max_reads`.
+     * An error is raised if the input contains fewer than `skip_reads` reads.
+     * This is ignored if `resume` is provided.
+     */
+    unsigned long long skip_reads = 0;
+
+    /**
+     * Checkpoint from a previous run on the same input, from which to resume processing.
+     * The handler should already have been restored from this checkpoint (see its `load()` method).
+     * If the byte sources have a `seek(unsigned long long)` method, e.g., `MappedFastqReader`, they are positioned at `ProcessDataCheckpoint::offsets`; 
+     * note that this method must be visible from the type of the supplied pointer, not just the pointed-to object.
+     * Otherwise, the first `ProcessDataCheckpoint::num_reads` reads are skipped as described for `skip_reads`.
+     * If `NULL`, processing starts from the beginning of the input.
+     */
+    const ProcessDataCheckpoint* resume = NULL;
+};
+
+/**
+ * @cond
+ */
+template<class Chunk_, class State_>
+struct PairedEndWorkspace {
+    Chunk_ reads1, reads2;
+    State_ state;
+    bool initialized = false;
 };
 
+template<class Handler_, class Workspace_>
+void process_paired_end_chunk(const Handler_& handler, Workspace_& work, bool persistent_state) {
+    auto& state = work.state;
+    // Reinitializing non-persistent states for simplicity and to avoid accumulation of reserved memory,
+    // unless the handler promises that reduce() has already reset the state for reuse.
+    if (!work.initialized || (!persistent_state && !handler_has_reusable_state<Handler_>::value)) {
+        state = handler.initialize();
+        work.initialized = true;
+    }
+    const auto& curreads1 = work.reads1;
+    const auto& curreads2 = work.reads2;
+    ReadIndex nreads = curreads1.size();
+
+    if constexpr(!Handler_::use_names) {
+        for (ReadIndex b = 0; b < nreads; ++b) {
+            handler.process(state, curreads1.get_sequence(b), curreads2.get_sequence(b));
+        }
+    } else {
+        for (ReadIndex b = 0; b < nreads; ++b) {
+            handler.process(
+                state,
+                curreads1.get_name(b), 
+                curreads1.get_sequence(b),
+                curreads2.get_name(b), 
+                curreads2.get_sequence(b)
+            );
+        }
+    }
+
+    work.reads1.first_touch();
+    work.reads2.first_touch();
+}
+
+template<class Chunk_, class Handler_, class FillJob_, class Position_, class Offsets_>
+void process_paired_end_chunks(Handler_& handler, const ProcessPairedEndDataOptions& options, FillJob_ fill_job, Position_ position, Offsets_ offsets) {
+    typedef PairedEndWorkspace<Chunk_, decltype(handler.initialize())> Workspace;
+    const Handler_& conhandler = handler; // Safety measure to enforce const-ness within each thread.
+
+    ThreadPool<Workspace> tp(
+        [&](Workspace& work) -> void {
+            process_paired_end_chunk(conhandler, work, options.persistent_state);
+        },
+        options.num_threads,
+        options.queue_size,
+        options.executor,
+        options.cpu_affinity
+    );
+
+    if (options.progress) {
+        tp.set_progress(options.progress, options.progress_interval);
+    }
+
+    auto sizer = create_block_sizer(options);
+    tp.set_block_sizer(sizer);
+    tp.set_limits(options.cancellation, options.max_reads, options.time_limit);
+    configure_checkpoint(handler, options, tp, offsets);
+
+    run_thread_pool<Handler_>(
+        tp,
+        [&](Workspace& work) -> bool {
+            bool finished = fill_job(work.reads1, work.reads2, tp.limit_block_size(sizer.get()));
+            tp.record_input(work.reads1.size(), position());
+            return finished;
+        },
+        [&](Workspace& work) -> void {
+            if (!options.persistent_state) {
+                handler.reduce(work.state);
+            }
+            work.reads1.clear(Handler_::use_names);
+            work.reads2.clear(Handler_::use_names);
+        }
+    );
+
+    if (options.persistent_state) {
+        tp.timed_reduce([&]() -> void {
+            reduce_persistent_states(handler, tp, options.num_threads);
+        });
+    }
+
+    if (options.checkpoint && tp.stats().stopped) {
+        report_checkpoint(options, tp, offsets());
+    }
+
+    tp.complete();
+    if (options.stats) {
+        *(options.stats) = tp.stats();
+    }
+}
+
+template<class Reader_, class Handler_>
+void process_paired_end_reads(Reader_& fastq1, Reader_& fastq2, Handler_& handler, const ProcessPairedEndDataOptions& options, bool seeked) {
+    std::unique_ptr<BackgroundJob> mate_parser;
+    if (options.concurrent_mates) {
+        mate_parser.reset(new BackgroundJob);
+    }
+
+    auto skip = reads_to_skip(options, seeked);
+    for (unsigned long long r = 0; r < skip; ++r) {
+        bool okay1 = fastq1(), okay2 = fastq2();
+        if (okay1 != okay2) {
+            throw std::runtime_error("different number of reads in paired FASTQ files");
+        }
+        if (!okay1) {
+            throw std::runtime_error("fewer reads in the input than 'skip_reads'");
+        }
+    }
+
+    typedef ChunkForReader<Reader_> Chunk;
+    process_paired_end_chunks<Chunk>(
+        handler,
+        options,
+        [&](Chunk& reads1, Chunk& reads2, std::size_t block_size) -> bool {
+            bool finished1 = false, finished2 = false;
+
+            if (mate_parser) {
+                // Parsing the second mate on the helper thread while the first mate is parsed here.
+                // We must wait for the helper before leaving, as it holds references to 'reads2'.
+                mate_parser->submit([&]() -> void {
+                    finished2 = fill_chunk<Handler_::use_names>(fastq2, reads2, block_size);
+                });
+                try {
+                    finished1 = fill_chunk<Handler_::use_names>(fastq1, reads1, block_size);
+                } catch (...) {
+                    try {
+                        mate_parser->wait();
+                    } catch (...) {}
+                    throw;
+                }
+                mate_parser->wait();
+
+            } else {
+                finished1 = fill_chunk<Handler_::use_names>(fastq1, reads1, block_size);
+                finished2 = fill_chunk<Handler_::use_names>(fastq2, reads2, block_size);
+            }
+
+            if (finished1 != finished2 || reads1.size() != reads2.size()) {
+                throw std::runtime_error("different number of reads in paired FASTQ files");
+            }
+            return finished1;
+        },
+        [&]() -> unsigned long long {
+            return fastq1.position() + fastq2.position();
+        },
+        [&, start1 = start_offset(options, seeked, 0), start2 = start_offset(options, seeked, 1)]() -> std::vector<unsigned long long> {
+            return { start1 + fastq1.position(), start2 + fastq2.position() };
+        }
+    );
+}
+
+inline std::pair<const char*, const char*> as_span(const std::vector<char>& x) {
+    return std::make_pair(x.data(), x.data() + x.size());
+}
+
+inline const std::pair<const char*, const char*>& as_span(const std::pair<const char*, const char*>& x) {
+    return x;
+}
+
+inline std::pair<const char*, const char*> strip_mate_suffix(std::pair<const char*, const char*> name) {
+    if (name.second - name.first >= 2 && *(name.second - 2) == '/' && (*(name.second - 1) == '1' || *(name.second - 1) == '2')) {
+        name.second -= 2;
+    }
+    return name;
+}
+
+template<class Reader_, class Handler_>
+void process_interleaved_paired_end_reads(Reader_& fastq, Handler_& handler, const ProcessPairedEndDataOptions& options, bool seeked) {
+    unsigned long long pair_count = 0;
+    auto skip = reads_to_skip(options, seeked);
+    for (; pair_count < skip; ++pair_count) {
+        if (!fastq()) {
+            throw std::runtime_error("fewer reads in the input than 'skip_reads'");
+        }
+        if (!fastq()) {
+            throw std::runtime_error("odd number of records in interleaved FASTQ file");
+        }
+    }
+
+    typedef ChunkForReader<Reader_> Chunk;
+    process_paired_end_chunks<Chunk>(
+        handler,
+        options,
+        [&](Chunk& reads1, Chunk& reads2, std::size_t block_size) -> bool {
+            for (ReadIndex b = 0; b < block_size; ++b) {
+                if (!fastq()) {
+                    return true;
+                }
+                reads1.add_read_sequence(sequence_of(fastq));
+
+                if constexpr(!Handler_::use_names) {
+                    if (!fastq()) {
+                        throw std::runtime_error("odd number of records in interleaved FASTQ file");
+                    }
+                    reads2.add_read_sequence(sequence_of(fastq));
+
+                } else {
+                    // Names may be overwritten by the next record, so we need to store the first name before validation.
+                    reads1.add_read_name(name_of(fastq));
+                    if (!fastq()) {
+                        throw std::runtime_error("odd number of records in interleaved FASTQ file");
+                    }
+                    reads2.add_read_sequence(sequence_of(fastq));
+                    reads2.add_read_name(name_of(fastq));
+
+                    auto name1 = strip_mate_suffix(reads1.get_name(reads1.size() - 1));
+                    auto name2 = strip_mate_suffix(as_span(name_of(fastq)));
+                    if (name1.second - name1.first != name2.second - name2.first || !std::equal(name1.first, name1.second, name2.first)) {
+                        throw std::runtime_error("mismatched names for paired reads in interleaved FASTQ file (pair " + std::to_string(pair_count + 1) + ")");
+                    }
+                }
+
+                ++pair_count;
+            }
+            return false;
+        },
+        [&]() -> unsigned long long {
+            return fastq.position();
+        },
+        [&, start = start_offset(options, seeked, 0)]() -> std::vector<unsigned long long> {
+            return { start + fastq.position() };
+        }
+    );
+}
+/**
+ * @endcond
+ */
+
 /**
  * Run a handler for each read in paired-end data, by calling `handler.process()` on each read pair.
  * It is expected that the results are stored in `handler` for retrieval by the caller.
  *
+ * @tparam Reader_ Class template for a reader that parses records from a byte source, e.g., `FastqReader`, `FastaReader` or `LineSequenceReader`.
+ * This should accept a `Pointer_` and a buffer size in its constructor, and provide the same `operator()`, `get_sequence()` and `get_name()` methods as `FastqReader`.
  * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
  * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization. 
  * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object. 
@@ -374,6 +1950,21 @@ struct ProcessPairedEndDataOptions {
  *
  * The `Handler` should have a static `constexpr` variable `use_names`, indicating whether or not names should be passed to the `process()` method.
  *
+ * The `Handler` may optionally have a static `constexpr` variable `commutative`.
+ * If this is `true`, the results of `reduce()` should not depend on the order in which the states are reduced.
+ * The state for each chunk of reads is then reduced as soon as its processing is complete, rather than waiting for all preceding chunks;
+ * this improves throughput when some chunks take longer than others.
+ * Otherwise, if `commutative` is absent or `false`, the states are always reduced in the same order as the chunks of reads in the input.
+ *
+ * The `Handler` may optionally implement a `merge(State& dest, State& src)` method.
+ * This should be a thread-safe `const` method that combines the results in `src` into `dest`; `src` may be left in an unspecified state.
+ * If present, it is used to combine states in parallel before the final `reduce()` when `persistent_state = true` in the options.
+ *
+ * The `Handler` may optionally have a static `constexpr` variable `reusable_state`.
+ * If this is `true`, `reduce()` should reset the state so that it can be used as if it were freshly returned by `initialize()`.
+ * When `persistent_state = false`, each state is then reused for subsequent chunks instead of being recreated with `initialize()`;
+ * this avoids repeated allocation of large states, e.g., the per-barcode counts for large pools.
+ *
  * If `use_names` is `false`, the `Handler` class should implement:
  * - `process(State& state, const std::pair<const char*, const char*>& seq1, const std::pair<const char*, const char*>& seq2)`: 
  *   this should be a `const` method that processes the paired reads in `seq1` and `seq2`, and stores its results in `state`.
@@ -385,89 +1976,74 @@ struct ProcessPairedEndDataOptions {
  *   `name1` and `name2` will contain pointers to the start and one-past-the-end of the read names.
  *   `seq1` and `seq2` will contain pointers to the start and one-past-the-end of the read sequences.
  */
-template<class Pointer_, class Handler_>
+template<template<typename> class Reader_ = FastqReader, class Pointer_, class Handler_>
 void process_paired_end_data(Pointer_ input1, Pointer_ input2, Handler_& handler, const ProcessPairedEndDataOptions& options) {
-    struct PairedEndWorkspace {
-        ChunkOfReads reads1, reads2;
-        decltype(handler.initialize()) state;
-    };
-
-    FastqReader<Pointer_> fastq1(input1, options.buffer_size);
-    FastqReader<Pointer_> fastq2(input2, options.buffer_size);
-    const Handler_& conhandler = handler; // Safety measure to enforce const-ness within each thread.
-
-    ThreadPool<PairedEndWorkspace> tp(
-        [&](PairedEndWorkspace& work) -> void {
-            auto& state = work.state;
-            state = conhandler.initialize(); // reinitializing for simplicity and to avoid accumulation of reserved memory.
-            const auto& curreads1 = work.reads1;
-            const auto& curreads2 = work.reads2;
-            ReadIndex nreads = curreads1.size();
-
-            if constexpr(!Handler_::use_names) {
-                for (ReadIndex b = 0; b < nreads; ++b) {
-                    conhandler.process(state, curreads1.get_sequence(b), curreads2.get_sequence(b));
-                }
-            } else {
-                for (ReadIndex b = 0; b < nreads; ++b) {
-                    conhandler.process(
-                        state,
-                        curreads1.get_name(b), 
-                        curreads1.get_sequence(b),
-                        curreads2.get_name(b), 
-                        curreads2.get_sequence(b)
-                    );
-                }
-            }
-        },
-        options.num_threads
-    );
-
-    tp.run(
-        [&](PairedEndWorkspace& work) -> bool {
-            bool finished1 = false;
-            {
-                auto& curreads = work.reads1;
-                for (ReadIndex b = 0; b < options.block_size; ++b) {
-                    if (!fastq1()) {
-                        finished1 = true;
-                        break;
-                    }
-
-                    curreads.add_read_sequence(fastq1.get_sequence());
-                    if constexpr(Handler_::use_names) {
-                        curreads.add_read_name(fastq1.get_name());
-                    }
-                }
-            }
-
-            bool finished2 = false;
-            {
-                auto& curreads = work.reads2;
-                for (ReadIndex b = 0; b < options.block_size; ++b) {
-                    if (!fastq2()) {
-                        finished2 = true;
-                        break;
-                    }
+    bool seeked = seek_to_checkpoint(*input1, options.resume, 0, 2);
+    seek_to_checkpoint(*input2, options.resume, 1, 2);
+    if (options.prefetch_blocks) {
+        PrefetchReader<Pointer_> prefetched1(std::move(input1), options.buffer_size, options.prefetch_blocks);
+        PrefetchReader<Pointer_> prefetched2(std::move(input2), options.buffer_size, options.prefetch_blocks);
+        Reader_<PrefetchReader<Pointer_>*> fastq1(&prefetched1, options.buffer_size);
+        Reader_<PrefetchReader<Pointer_>*> fastq2(&prefetched2, options.buffer_size);
+        process_paired_end_reads(fastq1, fastq2, handler, options, seeked);
+    } else {
+        Reader_<Pointer_> fastq1(std::move(input1), options.buffer_size);
+        Reader_<Pointer_> fastq2(std::move(input2), options.buffer_size);
+        process_paired_end_reads(fastq1, fastq2, handler, options, seeked);
+    }
+}
 
-                    curreads.add_read_sequence(fastq2.get_sequence());
-                    if constexpr(Handler_::use_names) {
-                        curreads.add_read_name(fastq2.get_name());
-                    }
-                }
-            }
+/**
+ * Overload of `process_paired_end_data()` for memory-mapped FASTQ files.
+ * Read sequences and names are passed to the handler as pointers into the mappings, avoiding any copies during chunking.
+ *
+ * @tparam Handler_ A class that implements a handler for paired-end data.
+ *
+ * @param input1 A `MappedFastqReader` for one of the paired-end FASTQ files.
+ * @param input2 A `MappedFastqReader` for the other paired-end FASTQ file.
+ * @param handler Handler instance for paired-end data. 
+ * @param options Further options.
+ * `ProcessPairedEndDataOptions::buffer_size` is ignored.
+ */
+template<class Handler_>
+void process_paired_end_data(MappedFastqReader& input1, MappedFastqReader& input2, Handler_& handler, const ProcessPairedEndDataOptions& options) {
+    bool seeked = seek_to_checkpoint(input1, options.resume, 0, 2);
+    seek_to_checkpoint(input2, options.resume, 1, 2);
+    process_paired_end_reads(input1, input2, handler, options, seeked);
+}
 
-            if (finished1 != finished2 || work.reads1.size() != work.reads2.size()) {
-                throw std::runtime_error("different number of reads in paired FASTQ files");
-            }
-            return finished1;
-        },
-        [&](PairedEndWorkspace& work) -> void {
-            handler.reduce(work.state);
-            work.reads1.clear(Handler_::use_names);
-            work.reads2.clear(Handler_::use_names);
-        }
-    );
+/**
+ * Run a handler for each read pair in interleaved paired-end data, where the records for the two mates alternate within a single FASTQ file.
+ * This is equivalent to de-interleaving the file and calling `process_paired_end_data()`, but avoids the extra pass over the data.
+ * Each odd-numbered record (i.e., the first, third, etc.) is treated as the first mate and is followed by its partner.
+ *
+ * If `Handler_::use_names = true`, the names of the two records in each pair are checked for consistency, 
+ * after removing any `/1` or `/2` suffix from each name.
+ * An error is raised if the names do not match or if the file contains an odd number of records.
+ *
+ * @tparam Reader_ Class template for a reader that parses records from a byte source, e.g., `FastqReader`, `FastaReader` or `LineSequenceReader`.
+ * This should accept a `Pointer_` and a buffer size in its constructor, and provide the same `operator()`, `get_sequence()` and `get_name()` methods as `FastqReader`.
+ * @tparam Pointer_ Pointer to a class that serves as a source of input bytes.
+ * The pointed-to class should satisfy the `byteme::Reader` interface; it may also be a concrete `byteme::Reader` subclass to enable devirtualization. 
+ * Either a smart or raw pointer may be supplied depending on how the caller wants to manage the lifetime of the pointed-to object. 
+ * @tparam Handler_ A class that implements a handler for paired-end data, see `process_paired_end_data()` for requirements.
+ *
+ * @param input Pointer to an input byte source containing data from an interleaved paired-end FASTQ file.
+ * @param handler Handler instance for paired-end data. 
+ * @param options Further options.
+ * `ProcessPairedEndDataOptions::concurrent_mates` is ignored as both mates are parsed from the same file.
+ */
+template<template<typename> class Reader_ = FastqReader, class Pointer_, class Handler_>
+void process_interleaved_paired_end_data(Pointer_ input, Handler_& handler, const ProcessPairedEndDataOptions& options) {
+    bool seeked = seek_to_checkpoint(*input, options.resume, 0, 1);
+    if (options.prefetch_blocks) {
+        PrefetchReader<Pointer_> prefetched(std::move(input), options.buffer_size, options.prefetch_blocks);
+        Reader_<PrefetchReader<Pointer_>*> fastq(&prefetched, options.buffer_size);
+        process_interleaved_paired_end_reads(fastq, handler, options, seeked);
+    } else {
+        Reader_<Pointer_> fastq(std::move(input), options.buffer_size);
+        process_interleaved_paired_end_reads(fastq, handler, options, seeked);
+    }
 }
 
 }
@@ -0,0 +1,308 @@
+#ifndef KAORI_PROCESS_FILE_HPP
+#define KAORI_PROCESS_FILE_HPP
+
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <exception>
+#include <string>
+#include <chrono>
+#include <cstddef>
+
+#include "FastqReader.hpp"
+#include "Executor.hpp"
+#include "process_data.hpp"
+
+#include "byteme/byteme.hpp"
+
+/**
+ * @file process_file.hpp
+ *
+ * @brief Process single-end data from a seekable FASTQ file.
+ */
+
+namespace kaori {
+
+/**
+ * @cond
+ */
+class FileRangeReader final : public byteme::Reader {
+public:
+    FileRangeReader(const char* path, unsigned long long offset) : my_stream(path, std::ios::binary) {
+        if (!my_stream) {
+            throw std::runtime_error("failed to open file at '" + std::string(path) + "'");
+        }
+        my_stream.seekg(offset);
+    }
+
+    void seek(unsigned long long offset) {
+        my_stream.clear(); // in case we hit the end of the file on a previous read.
+        my_stream.seekg(offset);
+    }
+
+    std::size_t read(unsigned char* buffer, std::size_t n) {
+        my_stream.read(reinterpret_cast<char*>(buffer), n);
+        return my_stream.gcount();
+    }
+
+private:
+    std::ifstream my_stream;
+};
+
+inline unsigned long long file_size(const char* path) {
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        throw std::runtime_error("failed to open file at '" + std::string(path) + "'");
+    }
+    return stream.tellg();
+}
+
+inline bool is_fastq_record_start(FileRangeReader& reader, unsigned long long offset, std::size_t buffer_size, int lookahead) {
+    reader.seek(offset);
+    FastqReader<FileRangeReader*> fastq(&reader, buffer_size);
+
+    // Any parsing error means that we did not start at a valid record.
+    // Otherwise, we require several consecutive records (or the end of the file) to be parsed
+    // successfully, which should be difficult to achieve when starting from a quality string.
+    try {
+        for (int r = 0; r < lookahead; ++r) {
+            if (!fastq()) {
+                return r > 0;
+            }
+        }
+    } catch (std::exception&) {
+        return false;
+    }
+
+    return true;
+}
+
+inline unsigned long long find_fastq_record_start(const char* path, unsigned long long offset, unsigned long long end, std::size_t buffer_size, int lookahead) {
+    if (offset == 0) {
+        return 0;
+    }
+
+    // Starting one byte early so that we can check whether 'offset' is at the start of a line.
+    --offset;
+    FileRangeReader reader(path, offset);
+    byteme::SerialBufferedReader<char, FileRangeReader*> pb(&reader, buffer_size);
+    if (!pb.valid()) {
+        return end;
+    }
+
+    // Re-using a single stream to check all candidates, rather than opening the file for each one.
+    FileRangeReader checker(path, offset);
+
+    char last = pb.get();
+    while (pb.advance()) {
+        ++offset;
+        char current = pb.get();
+        if (last == '\n' && current == '@' && is_fastq_record_start(checker, offset, buffer_size, lookahead)) {
+            return offset;
+        }
+        last = current;
+    }
+
+    return end;
+}
+
+struct FastqRange {
+    unsigned long long start = 0;
+    unsigned long long end = 0;
+    unsigned long long num_reads = 0;
+    bool stopped = false;
+};
+
+template<class Handler_, class State_>
+void process_fastq_range(const char* path, FastqRange& range, unsigned long long limit, std::size_t buffer_size, const CancellationToken* cancellation, const Handler_& handler, State_& state) {
+    FileRangeReader reader(path, range.start);
+    FastqReader<FileRangeReader*> fastq(&reader, buffer_size);
+    range.num_reads = 0;
+    range.stopped = false;
+
+    // Only processing records that start within the range. The last record
+    // is allowed to extend past the limit, in which case the next range
+    // should start at the end of that record.
+    while (range.start + fastq.position() < limit) {
+        if (cancellation && cancellation->cancelled()) {
+            range.stopped = true;
+            break;
+        }
+        if (!fastq()) {
+            break;
+        }
+
+        if constexpr(!Handler_::use_names) {
+            handler.process(state, fastq.get_sequence_view());
+        } else {
+            handler.process(state, fastq.get_name_view(), fastq.get_sequence_view());
+        }
+        ++range.num_reads;
+    }
+
+    range.end = range.start + fastq.position();
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Options for `process_single_end_file()`.
+ */
+struct ProcessSingleEndFileOptions {
+    /**
+     * Number of threads to use for parsing and processing reads.
+     * The file is split into this number of byte ranges, each of which is handled by a separate thread.
+     */
+    int num_threads = 1;
+
+    /**
+     * Size of the buffer for storing bytes from a FASTQ file prior to parsing.
+     * Larger values improve speed at the cost of increased memory usage.
+     */
+    std::size_t buffer_size = 65535;
+
+    /**
+     * Number of consecutive records that must be successfully parsed when searching for the first record in each byte range.
+     * Larger values reduce the chance of mistaking a quality string for the start of a record, at the cost of some extra parsing.
+     */
+    int lookahead = 2;
+
+    /**
+     * Pointer to an `Executor` that processes each byte range, see `ProcessSingleEndDataOptions::executor` for details.
+     * If `NULL`, a `DefaultExecutor` with `num_threads` threads is used.
+     */
+    Executor* executor = NULL;
+
+    /**
+     * Token to cancel processing from another thread.
+     * Once cancelled, each byte range stops at its next record and the handler will contain consistent results for the first `ProcessDataStats::num_reads` reads of the file.
+     * If `NULL`, processing cannot be cancelled.
+     */
+    const CancellationToken* cancellation = NULL;
+
+    /**
+     * Pointer to a `ProcessDataStats` object in which to store statistics about the run.
+     * Each byte range is reported as a single chunk, and only `num_chunks`, `num_reads`, `num_bytes`, `reduce_time`, `elapsed`, `stopped`, `thread_busy` and `thread_idle` are filled.
+     * If `NULL`, statistics are not reported.
+     */
+    ProcessDataStats* stats = NULL;
+};
+
+/**
+ * Run a handler for each read in a single-end FASTQ file, by calling `handler.process()` on each read.
+ * Unlike `process_single_end_data()`, both parsing and processing are parallelized by splitting the file into byte ranges that are handled by separate threads.
+ * This requires a seekable input, so the file should not be compressed.
+ *
+ * Each thread searches for the first record in its range by checking that a line starting with `@` is followed by `options.lookahead` valid records.
+ * As multi-line sequences are allowed and `@` may also appear at the start of a quality string, this search may occasionally be fooled.
+ * To guarantee correctness, we check that each range starts at the same position that the previous range ended;
+ * if not, the range is re-parsed from the correct position on the calling thread.
+ * This ensures that the reads (and their order of reduction) are identical to those from a serial parse.
+ *
+ * Some limitations apply compared to `process_single_end_data()`:
+ *
+ * - Only single-end data is supported, as there is no guarantee that the byte ranges of paired files would contain the same reads.
+ * - Each candidate record start is checked by a separate parse from that position, so files with many false candidates (e.g., quality strings that often start with `@`) will spend more time in the search.
+ * - Reads are parsed and processed in a single pass within each range, so there are no chunk-level options like `block_size`, `persistent_state` or `checkpoint`.
+ *
+ * @tparam Handler_ Class that implements a handler for single-end data, see `process_single_end_data()` for requirements.
+ *
+ * @param path Path to an uncompressed FASTQ file.
+ * @param handler Handler instance for single-end data.
+ * The `reduce()` method will be called once for each byte range, in order of their position in the file.
+ * @param options Further options.
+ */
+template<class Handler_>
+void process_single_end_file(const char* path, Handler_& handler, const ProcessSingleEndFileOptions& options) {
+    const Handler_& conhandler = handler; // Safety measure to enforce const-ness within each thread.
+    typedef decltype(handler.initialize()) State;
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto total = file_size(path);
+    std::size_t num_ranges = (options.num_threads > 0 ? options.num_threads : 1);
+    std::vector<unsigned long long> boundaries(num_ranges + 1);
+    for (std::size_t r = 0; r < num_ranges; ++r) {
+        boundaries[r] = (total / num_ranges) * r;
+    }
+    boundaries[num_ranges] = total;
+
+    std::vector<FastqRange> ranges(num_ranges);
+    std::vector<State> states(num_ranges);
+    std::vector<std::exception_ptr> errors(num_ranges);
+
+    std::unique_ptr<DefaultExecutor> own_executor;
+    Executor* executor = options.executor;
+    if (executor == NULL) {
+        own_executor.reset(new DefaultExecutor(num_ranges));
+        executor = own_executor.get();
+    }
+
+    for (std::size_t r = 0; r < num_ranges; ++r) {
+        executor->submit_to(r, [&,r]() -> void {
+            try {
+                auto& range = ranges[r];
+                auto range_end = boundaries[r + 1];
+                range.start = find_fastq_record_start(path, boundaries[r], total, options.buffer_size, options.lookahead);
+                states[r] = conhandler.initialize();
+                if (range.start < range_end) {
+                    process_fastq_range(path, range, range_end, options.buffer_size, options.cancellation, conhandler, states[r]);
+                } else {
+                    range.end = range.start;
+                }
+            } catch (...) {
+                errors[r] = std::current_exception();
+            }
+        });
+    }
+    executor->wait();
+
+    // Validating the range boundaries in order, and re-parsing any range that was started at the wrong position.
+    // The first range always starts at zero, so every subsequent 'expected' is guaranteed to be a true record boundary.
+    ProcessDataStats stats;
+    unsigned long long expected = 0;
+    for (std::size_t r = 0; r < num_ranges; ++r) {
+        auto& range = ranges[r];
+        if (range.start != expected) {
+            states[r] = conhandler.initialize();
+            range.start = expected;
+            auto range_end = boundaries[r + 1];
+            if (expected < range_end) {
+                process_fastq_range(path, range, range_end, options.buffer_size, options.cancellation, conhandler, states[r]);
+            } else {
+                range.end = expected;
+                range.num_reads = 0;
+            }
+        } else if (errors[r]) {
+            std::rethrow_exception(errors[r]);
+        }
+
+        auto reduce_start = std::chrono::steady_clock::now();
+        handler.reduce(states[r]);
+        stats.reduce_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - reduce_start).count();
+        ++stats.num_chunks;
+        stats.num_reads += range.num_reads;
+        stats.num_bytes = range.end;
+        expected = range.end;
+
+        // Later ranges are discarded so that the handler only contains the reads up to the point of cancellation.
+        if (range.stopped) {
+            stats.stopped = true;
+            break;
+        }
+    }
+
+    if (options.stats) {
+        if (own_executor) {
+            stats.thread_busy = own_executor->busy_times();
+            stats.thread_idle = own_executor->idle_times();
+        }
+        stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        *(options.stats) = stats;
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef KAORI_PROCESS_STREAM_HPP
+#define KAORI_PROCESS_STREAM_HPP
+
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+#include <functional>
+
+#include "process_data.hpp"
+#include "Executor.hpp"
+
+/**
+ * @file process_stream.hpp
+ *
+ * @brief Process reads that are pushed by the caller.
+ */
+
+namespace kaori {
+
+/**
+ * @brief Options for `SingleEndStreamProcessor` and `PairedEndStreamProcessor`.
+ */
+struct ProcessStreamOptions {
+    /**
+     * Number of threads to use for processing reads.
+     */
+    int num_threads = 1;
+
+    /**
+     * Maximum number of batches that can be in flight at any given time, i.e., submitted but not yet reduced.
+     * Once this limit is reached, `submit()` blocks until a batch has been processed.
+     * If zero, this defaults to twice `num_threads`; otherwise, values less than `num_threads` are increased to `num_threads`.
+     */
+    std::size_t queue_size = 0;
+
+    /**
+     * Whether each workspace should keep its handler state across batches,
+     * see `ProcessSingleEndDataOptions::persistent_state` for details.
+     */
+    bool persistent_state = false;
+
+    /**
+     * Pointer to an `Executor` that runs the processing of each batch,
+     * see `ProcessSingleEndDataOptions::executor` for details.
+     */
+    Executor* executor = NULL;
+
+    /**
+     * CPUs to which the worker threads should be pinned,
+     * see `ProcessSingleEndDataOptions::cpu_affinity` for details.
+     */
+    std::vector<int> cpu_affinity;
+
+    /**
+     * Function to report progress, see `ProcessSingleEndDataOptions::progress` for details.
+     * This is called during `submit()` and `finish()`.
+     */
+    std::function<void(const ProcessDataStats&)> progress;
+
+    /**
+     * Minimum interval between calls to `progress`, in seconds.
+     */
+    double progress_interval = 10;
+};
+
+/**
+ * @brief Process single-end reads as they are pushed by the caller.
+ *
+ * This is an alternative to `process_single_end_data()` for applications where the reads are already in memory, e.g., received in batches from a message queue.
+ * Each batch passed to `submit()` is copied into a chunk that is processed on a worker thread, while the caller is free to prepare the next batch.
+ * Once a batch is processed, its state is reduced into the handler on the same worker thread, so `submit()` only blocks when the queue is full.
+ * Reductions are never run concurrently, and their order follows the order of submission unless the handler is commutative, see `process_single_end_data()` for details.
+ * Persistent states are instead reduced on the calling thread in `finish()`.
+ *
+ * @tparam Handler_ Class that implements a handler for single-end data, see `process_single_end_data()` for requirements.
+ */
+template<class Handler_>
+class SingleEndStreamProcessor {
+public:
+    /**
+     * @param handler Handler instance for single-end data.
+     * This should not be used by the caller until `finish()` is called.
+     * If `ProcessStreamOptions::persistent_state = false`, its `reduce()` method is called on the worker threads, one at a time.
+     * @param options Further options.
+     */
+    SingleEndStreamProcessor(Handler_& handler, const ProcessStreamOptions& options) :
+        my_handler(handler),
+        my_persistent(options.persistent_state),
+        my_num_threads(options.num_threads),
+        my_pool(
+            [this](Workspace& work) -> void {
+                process_single_end_chunk(static_cast<const Handler_&>(my_handler), work, my_persistent);
+            },
+            options.num_threads,
+            options.queue_size,
+            options.executor,
+            options.cpu_affinity
+        )
+    {
+        if (options.progress) {
+            my_pool.set_progress(options.progress, options.progress_interval);
+        }
+        if (!my_persistent) {
+            my_pool.set_background_merge([this](Workspace& work) -> void {
+                my_handler.reduce(work.state);
+            });
+        }
+        my_pool.start(!handler_is_commutative<Handler_>::value);
+    }
+
+private:
+    typedef SingleEndWorkspace<ChunkOfReads, decltype(std::declval<const Handler_&>().initialize())> Workspace;
+
+    Handler_& my_handler;
+    bool my_persistent;
+    int my_num_threads;
+    ThreadPool<Workspace> my_pool;
+    bool my_finished = false;
+    unsigned long long my_num_bytes = 0;
+
+    static std::size_t span_length(const std::pair<const char*, const char*>& x) {
+        return x.second - x.first;
+    }
+
+    // The state was already reduced on the worker (if not persistent), so we just need to reset the reads.
+    void merge(Workspace& work) {
+        work.reads.clear(Handler_::use_names);
+    }
+
+    void check_finished() const {
+        if (my_finished) {
+            throw std::runtime_error("cannot submit reads after finish() has been called");
+        }
+    }
+
+public:
+    /**
+     * Submit a batch of reads for processing.
+     * This should only be used if `Handler_::use_names = false`.
+     *
+     * @param sequences Vector of read sequences, where each entry contains pointers to the start and one-past-the-end of a sequence.
+     * The pointed-to data is copied so it does not need to be valid after this method returns.
+     */
+    void submit(const std::vector<std::pair<const char*, const char*> >& sequences) {
+        static_assert(!Handler_::use_names, "names must be supplied if Handler_::use_names = true");
+        check_finished();
+        if (sequences.empty()) {
+            return;
+        }
+
+        auto& work = my_pool.acquire([&](Workspace& done) -> void { merge(done); });
+        for (const auto& seq : sequences) {
+            work.reads.add_read_sequence(seq);
+            my_num_bytes += span_length(seq);
+        }
+        my_pool.record_input(sequences.size(), my_num_bytes);
+        my_pool.dispatch();
+    }
+
+    /**
+     * Submit a batch of reads with names for processing.
+     * This should only be used if `Handler_::use_names = true`.
+     *
+     * @param names Vector of read names, where each entry contains pointers to the start and one-past-the-end of a name.
+     * @param sequences Vector of read sequences, where each entry contains pointers to the start and one-past-the-end of a sequence.
+     * This should have the same length as `names`.
+     * The pointed-to data in both vectors is copied so it does not need to be valid after this method returns.
+     */
+    void submit(const std::vector<std::pair<const char*, const char*> >& names, const std::vector<std::pair<const char*, const char*> >& sequences) {
+        static_assert(Handler_::use_names, "names should not be supplied if Handler_::use_names = false");
+        check_finished();
+        if (names.size() != sequences.size()) {
+            throw std::runtime_error("names and sequences should have the same length");
+        }
+        if (sequences.empty()) {
+            return;
+        }
+
+        auto& work = my_pool.acquire([&](Workspace& done) -> void { merge(done); });
+        for (std::size_t i = 0, end = sequences.size(); i < end; ++i) {
+            work.reads.add_read_name(names[i]);
+            work.reads.add_read_sequence(sequences[i]);
+            my_num_bytes += span_length(names[i]) + span_length(sequences[i]);
+        }
+        my_pool.record_input(sequences.size(), my_num_bytes);
+        my_pool.dispatch();
+    }
+
+    /**
+     * Wait for all submitted batches to be processed and reduce their states into the handler.
+     * This should be called once all reads have been submitted, after which the handler's results are available.
+     * Subsequent calls have no effect.
+     */
+    void finish() {
+        if (my_finished) {
+            return;
+        }
+        my_finished = true;
+        my_pool.finish([&](Workspace& done) -> void { merge(done); });
+        if (my_persistent) {
+            my_pool.timed_reduce([&]() -> void {
+                reduce_persistent_states(my_handler, my_pool, my_num_threads);
+            });
+        }
+        my_pool.complete();
+    }
+
+    /**
+     * @return Statistics for the processing, where each batch is counted as a chunk.
+     * This should only be called after `finish()`.
+     */
+    const ProcessDataStats& stats() const {
+        return my_pool.stats();
+    }
+};
+
+/**
+ * @brief Process paired-end reads as they are pushed by the caller.
+ *
+ * This is the paired-end counterpart to `SingleEndStreamProcessor`.
+ *
+ * @tparam Handler_ Class that implements a handler for paired-end data, see `process_paired_end_data()` for requirements.
+ */
+template<class Handler_>
+class PairedEndStreamProcessor {
+public:
+    /**
+     * @param handler Handler instance for paired-end data.
+     * This should not be used by the caller until `finish()` is called.
+     * If `ProcessStreamOptions::persistent_state = false`, its `reduce()` method is called on the worker threads, one at a time.
+     * @param options Further options.
+     */
+    PairedEndStreamProcessor(Handler_& handler, const ProcessStreamOptions& options) :
+        my_handler(handler),
+        my_persistent(options.persistent_state),
+        my_num_threads(options.num_threads),
+        my_pool(
+            [this](Workspace& work) -> void {
+                process_paired_end_chunk(static_cast<const Handler_&>(my_handler), work, my_persistent);
+            },
+            options.num_threads,
+            options.queue_size,
+            options.executor,
+            options.cpu_affinity
+        )
+    {
+        if (options.progress) {
+            my_pool.set_progress(options.progress, options.progress_interval);
+        }
+        if (!my_persistent) {
+            my_pool.set_background_merge([this](Workspace& work) -> void {
+                my_handler.reduce(work.state);
+            });
+        }
+        my_pool.start(!handler_is_commutative<Handler_>::value);
+    }
+
+private:
+    typedef PairedEndWorkspace<ChunkOfReads, decltype(std::declval<const Handler_&>().initialize())> Workspace;
+
+    Handler_& my_handler;
+    bool my_persistent;
+    int my_num_threads;
+    ThreadPool<Workspace> my_pool;
+    bool my_finished = false;
+    unsigned long long my_num_bytes = 0;
+
+    static std::size_t span_length(const std::pair<const char*, const char*>& x) {
+        return x.second - x.first;
+    }
+
+    // The state was already reduced on the worker (if not persistent), so we just need to reset the reads.
+    void merge(Workspace& work) {
+        work.reads1.clear(Handler_::use_names);
+        work.reads2.clear(Handler_::use_names);
+    }
+
+    void check_finished() const {
+        if (my_finished) {
+            throw std::runtime_error("cannot submit reads after finish() has been called");
+        }
+    }
+
+public:
+    /**
+     * Submit a batch of read pairs for processing.
+     * This should only be used if `Handler_::use_names = false`.
+     *
+     * @param sequences1 Vector of sequences for the first read of each pair, where each entry contains pointers to the start and one-past-the-end of a sequence.
+     * @param sequences2 Vector of sequences for the second read of each pair, with the same length as `sequences1`.
+     * The pointed-to data in both vectors is copied so it does not need to be valid after this method returns.
+     */
+    void submit(const std::vector<std::pair<const char*, const char*> >& sequences1, const std::vector<std::pair<const char*, const char*> >& sequences2) {
+        static_assert(!Handler_::use_names, "names must be supplied if Handler_::use_names = true");
+        check_finished();
+        if (sequences1.size() != sequences2.size()) {
+            throw std::runtime_error("different number of reads in paired batches");
+        }
+        if (sequences1.empty()) {
+            return;
+        }
+
+        auto& work = my_pool.acquire([&](Workspace& done) -> void { merge(done); });
+        for (std::size_t i = 0, end = sequences1.size(); i < end; ++i) {
+            work.reads1.add_read_sequence(sequences1[i]);
+            work.reads2.add_read_sequence(sequences2[i]);
+            my_num_bytes += span_length(sequences1[i]) + span_length(sequences2[i]);
+        }
+        my_pool.record_input(sequences1.size(), my_num_bytes);
+        my_pool.dispatch();
+    }
+
+    /**
+     * Submit a batch of read pairs with names for processing.
+     * This should only be used if `Handler_::use_names = true`.
+     *
+     * @param names1 Vector of names for the first read of each pair.
+     * @param sequences1 Vector of sequences for the first read of each pair.
+     * @param names2 Vector of names for the second read of each pair.
+     * @param sequences2 Vector of sequences for the second read of each pair.
+     * All vectors should have the same length, where each entry contains pointers to the start and one-past-the-end of a name or sequence.
+     * The pointed-to data is copied so it does not need to be valid after this method returns.
+     */
+    void submit(
+        const std::vector<std::pair<const char*, const char*> >& names1,
+        const std::vector<std::pair<const char*, const char*> >& sequences1,
+        const std::vector<std::pair<const char*, const char*> >& names2,
+        const std::vector<std::pair<const char*, const char*> >& sequences2)
+    {
+        static_assert(Handler_::use_names, "names should not be supplied if Handler_::use_names = false");
+        check_finished();
+        if (sequences1.size() != sequences2.size()) {
+            throw std::runtime_error("different number of reads in paired batches");
+        }
+        if (names1.size() != sequences1.size() || names2.size() != sequences2.size()) {
+            throw std::runtime_error("names and sequences should have the same length");
+        }
+        if (sequences1.empty()) {
+            return;
+        }
+
+        auto& work = my_pool.acquire([&](Workspace& done) -> void { merge(done); });
+        for (std::size_t i = 0, end = sequences1.size(); i < end; ++i) {
+            work.reads1.add_read_name(names1[i]);
+            work.reads1.add_read_sequence(sequences1[i]);
+            work.reads2.add_read_name(names2[i]);
+            work.reads2.add_read_sequence(sequences2[i]);
+            my_num_bytes += span_length(names1[i]) + span_length(sequences1[i]) + span_length(names2[i]) + span_length(sequences2[i]);
+        }
+        my_pool.record_input(sequences1.size(), my_num_bytes);
+        my_pool.dispatch();
+    }
+
+    /**
+     * Wait for all submitted batches to be processed and reduce their states into the handler.
+     * This should be called once all reads have been submitted, after which the handler's results are available.
+     * Subsequent calls have no effect.
+     */
+    void finish() {
+        if (my_finished) {
+            return;
+        }
+        my_finished = true;
+        my_pool.finish([&](Workspace& done) -> void { merge(done); });
+        if (my_persistent) {
+            my_pool.timed_reduce([&]() -> void {
+                reduce_persistent_states(my_handler, my_pool, my_num_threads);
+            });
+        }
+        my_pool.complete();
+    }
+
+    /**
+     * @return Statistics for the processing, where each batch is counted as a chunk.
+     * This should only be called after `finish()`.
+     */
+    const ProcessDataStats& stats() const {
+        return my_pool.stats();
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef KAORI_SERIALIZE_HPP
+#define KAORI_SERIALIZE_HPP
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+#include "utils.hpp"
+
+/**
+ * @file serialize.hpp
+ *
+ * @brief Save and load the results of a handler.
+ */
+
+namespace kaori {
+
+/**
+ * @cond
+ */
+// Results are written in the native byte order and type sizes, so they are only
+// intended to be loaded by the same build of the application, e.g., when resuming a run.
+template<typename Value_>
+void save_value(std::ostream& output, const Value_& value) {
+    static_assert(std::is_trivially_copyable<Value_>::value);
+    output.write(reinterpret_cast<const char*>(&value), sizeof(Value_));
+    if (!output) {
+        throw std::runtime_error("failed to save handler results to the output stream");
+    }
+}
+
+template<typename Value_>
+void load_value(std::istream& input, Value_& value) {
+    static_assert(std::is_trivially_copyable<Value_>::value);
+    input.read(reinterpret_cast<char*>(&value), sizeof(Value_));
+    if (!input) {
+        throw std::runtime_error("failed to load handler results from the input stream");
+    }
+}
+
+// Minimum number of bytes used to save a value, for validating lengths before allocation.
+template<typename Value_>
+constexpr std::size_t min_saved_size(const Value_*) {
+    return sizeof(Value_);
+}
+
+inline constexpr std::size_t min_saved_size(const std::string*) {
+    return sizeof(std::size_t);
+}
+
+// Checks that the stream has enough bytes left for 'len' elements, so that a
+// corrupted length doesn't cause us to allocate a huge amount of memory.
+// If the stream is not seekable, we can't check, so we just have to trust it.
+inline void check_saved_length(std::istream& input, std::size_t len, std::size_t bytes_per_element) {
+    auto current = input.tellg();
+    if (current == std::istream::pos_type(-1)) {
+        return;
+    }
+    input.seekg(0, std::ios::end);
+    auto end = input.tellg();
+    input.seekg(current);
+    if (end == std::istream::pos_type(-1) || !input) {
+        input.clear();
+        input.seekg(current);
+        return;
+    }
+
+    std::size_t remaining = static_cast<std::size_t>(end - current);
+    if (bytes_per_element && len > remaining / bytes_per_element) {
+        throw std::runtime_error("saved length exceeds the size of the input stream, the handler results may be truncated or corrupted");
+    }
+}
+
+inline void save_value(std::ostream& output, const std::string& value) {
+    save_value(output, value.size());
+    output.write(value.data(), value.size());
+    if (!output) {
+        throw std::runtime_error("failed to save handler results to the output stream");
+    }
+}
+
+inline void load_value(std::istream& input, std::string& value) {
+    std::size_t len = 0;
+    load_value(input, len);
+    check_saved_length(input, len, 1);
+    value.resize(len);
+    input.read(value.data(), len);
+    if (!input) {
+        throw std::runtime_error("failed to load handler results from the input stream");
+    }
+}
+
+// The number of counts is fixed by the barcode pools, so we check that it's the same as the existing vector.
+inline void save_counts(std::ostream& output, const std::vector<Count>& counts) {
+    save_value(output, counts.size());
+    output.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(Count));
+    if (!output) {
+        throw std::runtime_error("failed to save handler results to the output stream");
+    }
+}
+
+inline void load_counts(std::istream& input, std::vector<Count>& counts) {
+    std::size_t len = 0;
+    load_value(input, len);
+    if (len != counts.size()) {
+        throw std::runtime_error("number of saved counts is not consistent with the number of barcodes");
+    }
+
+    // Loading into a temporary so that 'counts' is left untouched if the input is truncated.
+    std::vector<Count> loaded(len);
+    input.read(reinterpret_cast<char*>(loaded.data()), len * sizeof(Count));
+    if (!input) {
+        throw std::runtime_error("failed to load handler results from the input stream");
+    }
+    counts.swap(loaded);
+}
+
+template<class Map_>
+void save_map(std::ostream& output, const Map_& map) {
+    save_value(output, map.size());
+    for (const auto& pair : map) {
+        save_value(output, pair.first);
+        save_value(output, pair.second);
+    }
+}
+
+template<class Map_>
+void load_map(std::istream& input, Map_& map) {
+    std::size_t len = 0;
+    load_value(input, len);
+    check_saved_length(
+        input,
+        len,
+        min_saved_size(static_cast<const typename Map_::key_type*>(NULL)) + min_saved_size(static_cast<const typename Map_::mapped_type*>(NULL))
+    );
+
+    // Loading into a temporary so that 'map' is left untouched if the input is truncated.
+    Map_ loaded;
+    loaded.reserve(len);
+    for (std::size_t i = 0; i < len; ++i) {
+        typename Map_::key_type key;
+        load_value(input, key);
+        load_value(input, loaded[key]);
+    }
+    map.swap(loaded);
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
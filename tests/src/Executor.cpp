@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include "kaori/Executor.hpp"
+
+#include <atomic>
+#include <vector>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+TEST(DefaultExecutor, Basic) {
+    for (int nthreads : { 0, 1, 3 }) {
+        kaori::DefaultExecutor ex(nthreads);
+        EXPECT_EQ(ex.num_threads(), std::max(nthreads, 1));
+
+        std::vector<int> results(100);
+        for (int i = 0; i < 100; ++i) {
+            ex.submit([&,i]() -> void {
+                results[i] = i * 2;
+            });
+        }
+        ex.wait();
+
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_EQ(results[i], i * 2);
+        }
+        EXPECT_GE(ex.idle_time(), 0);
+
+        // Can be re-used after waiting.
+        std::atomic<int> counter = 0;
+        for (int i = 0; i < 20; ++i) {
+            ex.submit([&]() -> void { ++counter; });
+        }
+        ex.wait();
+        EXPECT_EQ(counter, 20);
+    }
+}
+
+TEST(DefaultExecutor, Empty) {
+    kaori::DefaultExecutor ex(2);
+    ex.wait(); // returns immediately.
+}
+
+TEST(DefaultExecutor, Homes) {
+    kaori::DefaultExecutor ex(3);
+    std::vector<int> results(100);
+    for (int i = 0; i < 100; ++i) {
+        ex.submit_to(i * 7, [&,i]() -> void { // homes are taken modulo the number of threads.
+            results[i] = i + 1;
+        });
+    }
+    ex.wait();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(results[i], i + 1);
+    }
+
+    // Idle threads steal from a busy home.
+    std::atomic<int> counter = 0;
+    for (int i = 0; i < 50; ++i) {
+        ex.submit_to(0, [&]() -> void { ++counter; });
+    }
+    ex.wait();
+    EXPECT_EQ(counter, 50);
+}
+
+TEST(DefaultExecutor, HomeWorker) {
+    // Using a long delay so that stealing from an idle worker never happens in this test, regardless of the load on the machine.
+    kaori::DefaultExecutorOptions opt;
+    opt.steal_delay = 100;
+    int nthreads = 4;
+    kaori::DefaultExecutor ex(nthreads, opt);
+
+    // Tasks submitted to an idle home are always run by that home.
+    std::vector<std::vector<std::thread::id> > ids(10, std::vector<std::thread::id>(nthreads));
+    for (int round = 0; round < 10; ++round) {
+        for (int h = 0; h < nthreads; ++h) {
+            ex.submit_to(h, [&,round,h]() -> void {
+                ids[round][h] = std::this_thread::get_id();
+            });
+        }
+        ex.wait();
+    }
+
+    for (int round = 1; round < 10; ++round) {
+        EXPECT_EQ(ids[round], ids[0]);
+    }
+    for (int h = 1; h < nthreads; ++h) {
+        for (int h2 = 0; h2 < h; ++h2) {
+            EXPECT_NE(ids[0][h], ids[0][h2]);
+        }
+    }
+
+    // But if the home is busy, its tasks are stolen immediately.
+    std::atomic<bool> release = false;
+    ex.submit_to(0, [&]() -> void {
+        while (!release) {
+            std::this_thread::yield();
+        }
+    });
+    std::atomic<bool> stolen = false;
+    std::thread::id thief;
+    ex.submit_to(0, [&]() -> void {
+        thief = std::this_thread::get_id();
+        stolen = true;
+    });
+    while (!stolen) {
+        std::this_thread::yield();
+    }
+    release = true;
+    ex.wait();
+    EXPECT_NE(thief, ids[0][0]);
+}
+
+#if defined(__linux__)
+TEST(DefaultExecutor, Affinity) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(cpu_set_t), &allowed), 0);
+    int chosen = -1;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &allowed)) {
+            chosen = c;
+            break;
+        }
+    }
+    ASSERT_NE(chosen, -1);
+
+    kaori::DefaultExecutorOptions opt;
+    opt.cpus.push_back(chosen);
+    kaori::DefaultExecutor ex(2, opt);
+
+    std::vector<int> cpus(20);
+    for (int i = 0; i < 20; ++i) {
+        ex.submit([&,i]() -> void {
+            cpus[i] = sched_getcpu();
+        });
+    }
+    ex.wait();
+    for (auto c : cpus) {
+        EXPECT_EQ(c, chosen);
+    }
+
+    opt.cpus[0] = -1;
+    EXPECT_ANY_THROW(kaori::DefaultExecutor(2, opt));
+}
+#endif
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "kaori/FastaReader.hpp"
+#include "byteme/RawBufferReader.hpp"
+
+TEST(FastaReader, Basic) {
+    std::string buffer = ">FOO and more info\nACGT\n>WHEE\nTG\nCA\n\n>BAR\n>STUFF\nA";
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+    kaori::FastaReader fa(&reader);
+    const auto& name = fa.get_name();
+    const auto& seq = fa.get_sequence();
+
+    EXPECT_TRUE(fa());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "FOO");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGT");
+    EXPECT_EQ(fa.position(), buffer.find(">WHEE"));
+
+    EXPECT_TRUE(fa());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "WHEE");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "TGCA");
+
+    EXPECT_TRUE(fa());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "BAR");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "");
+
+    EXPECT_TRUE(fa());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "STUFF");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "A");
+
+    EXPECT_FALSE(fa());
+    EXPECT_EQ(fa.position(), buffer.size());
+}
+
+TEST(FastaReader, BufferSizes) {
+    std::string buffer;
+    for (int i = 0; i < 100; ++i) {
+        buffer += ">READ" + std::to_string(i) + "\nACGTACGTACGTACGTACGTACGT\nTTTT\n";
+    }
+
+    for (size_t bsize : { 1, 3, 10, 100 }) {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+        kaori::FastaReader fa(&reader, bsize);
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_TRUE(fa());
+            const auto& name = fa.get_name();
+            EXPECT_EQ(std::string(name.begin(), name.end()), "READ" + std::to_string(i));
+            const auto& seq = fa.get_sequence();
+            EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGTACGTACGTACGTACGTACGTTTTT");
+        }
+        EXPECT_FALSE(fa());
+    }
+}
+
+TEST(FastaReader, Errors) {
+    {
+        std::string buffer = ">FOO\nACGT\nFOO";
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+        kaori::FastaReader fa(&reader);
+        EXPECT_TRUE(fa());
+        const auto& seq = fa.get_sequence();
+        EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGTFOO"); // no way to distinguish this from a sequence line.
+    }
+
+    {
+        std::string buffer = "ACGT\n>FOO\nACGT\n";
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+        kaori::FastaReader fa(&reader);
+        EXPECT_ANY_THROW({
+            try {
+                fa();
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("should start with '>'") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+
+}
+
+TEST(FastaReader, NameAtEnd) {
+    // A name line at the end of the file is treated as a record with an empty sequence, regardless of whether there's a description.
+    for (std::string buffer : { ">FOO", ">FOO desc", ">A\nACGT\n>FOO", ">A\nACGT\n>FOO desc" }) {
+        for (std::size_t bufsize : { 2, 3, 100 }) {
+            byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+            kaori::FastaReader fa(&reader, bufsize);
+            if (buffer[1] == 'A') {
+                EXPECT_TRUE(fa());
+            }
+
+            EXPECT_TRUE(fa());
+            const auto& name = fa.get_name();
+            EXPECT_EQ(std::string(name.begin(), name.end()), "FOO");
+            EXPECT_TRUE(fa.get_sequence().empty());
+            EXPECT_EQ(fa.position(), buffer.size());
+            EXPECT_FALSE(fa());
+        }
+    }
+}
@@ -76,6 +76,22 @@ TEST(BasicTests, MultiLineEntries) {
     }
 }
 
+TEST(BasicTests, Position) {
+    std::string buffer = "@FOO and more info\nACGT\n+\n!!!!\n@WHEE\nTG\nCA\n+asdasd\naa\naa\n@BAR\nA\n+\n!";
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+    kaori::FastqReader fq(&reader);
+    EXPECT_EQ(fq.position(), 0);
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(fq.position(), buffer.find("@WHEE"));
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(fq.position(), buffer.find("@BAR"));
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(fq.position(), buffer.size());
+    EXPECT_FALSE(fq());
+    EXPECT_EQ(fq.position(), buffer.size());
+}
+
 TEST(BasicTests, Errors) {
     {
         std::string buffer = "FOO";
@@ -230,3 +246,80 @@ INSTANTIATE_TEST_SUITE_P(
     FastqReaderFileTest, 
     ::testing::Values(5, 10, 50, 1000)
 );
+
+class FastqReaderBufferTest : public testing::TestWithParam<int> {};
+
+TEST_P(FastqReaderBufferTest, Consistency) {
+    // Lines are long enough to cover the vectorized newline search, and records span multiple buffers for small buffer sizes.
+    std::string buffer = "@FOO and more info\nACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT\n+\n!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n"
+        "@WHEE\tstuff\nTG\nCAACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTAC\n+asdasd\naa\naaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\n"
+        "@BAR\n\n+\n\n"
+        "@STUFF\nA\n+\n@";
+
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+    kaori::FastqReader fq(&reader, GetParam());
+    const auto& name = fq.get_name();
+    const auto& seq = fq.get_sequence();
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "FOO");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT");
+    EXPECT_EQ(fq.position(), buffer.find("@WHEE"));
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "WHEE");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "TGCAACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTAC");
+    EXPECT_EQ(fq.position(), buffer.find("@BAR"));
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "BAR");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "");
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(std::string(name.begin(), name.end()), "STUFF");
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "A");
+
+    EXPECT_FALSE(fq());
+    EXPECT_EQ(fq.position(), buffer.size());
+}
+
+TEST_P(FastqReaderBufferTest, Views) {
+    std::string buffer = "@FOO and more info\nACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT\n+\n!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n"
+        "@WHEE\tstuff\nTG\nCAACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTAC\n+asdasd\naa\naaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\n"
+        "@BAR\n\n+\n\n"
+        "@STUFF\nA\n+\n@";
+
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+    kaori::FastqReader fq(&reader, GetParam());
+    auto as_string = [](std::pair<const char*, const char*> x) -> std::string {
+        return std::string(x.first, x.second);
+    };
+
+    // Views should be valid without ever calling get_sequence() or get_name().
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name_view()), "FOO");
+    EXPECT_EQ(as_string(fq.get_sequence_view()), "ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT");
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name_view()), "WHEE");
+    EXPECT_EQ(as_string(fq.get_sequence_view()), "TGCAACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTAC");
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name_view()), "BAR");
+    EXPECT_EQ(as_string(fq.get_sequence_view()), "");
+
+    // Views are still consistent after the vectors are requested.
+    EXPECT_TRUE(fq());
+    const auto& seq = fq.get_sequence();
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "A");
+    EXPECT_EQ(as_string(fq.get_sequence_view()), "A");
+    EXPECT_EQ(as_string(fq.get_name_view()), "STUFF");
+
+    EXPECT_FALSE(fq());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    FastqReader,
+    FastqReaderBufferTest, 
+    ::testing::Values(1, 2, 3, 7, 16, 33, 1000)
+);
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include "kaori/LineSequenceReader.hpp"
+#include "byteme/RawBufferReader.hpp"
+
+TEST(LineSequenceReader, Basic) {
+    for (size_t bsize : { 1, 2, 5, 1000 }) {
+        for (bool terminated : { false, true }) {
+            std::string buffer = "ACGT\nTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTT\n\nGGCC";
+            if (terminated) {
+                buffer += '\n';
+            }
+
+            byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+            kaori::LineSequenceReader lr(&reader, bsize);
+            const auto& name = lr.get_name();
+            const auto& seq = lr.get_sequence();
+
+            EXPECT_TRUE(lr());
+            EXPECT_EQ(std::string(name.begin(), name.end()), "1");
+            EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGT");
+            EXPECT_EQ(lr.position(), 5);
+
+            EXPECT_TRUE(lr());
+            EXPECT_EQ(std::string(name.begin(), name.end()), "2");
+            EXPECT_EQ(std::string(seq.begin(), seq.end()), std::string(44, 'T'));
+
+            EXPECT_TRUE(lr());
+            EXPECT_EQ(std::string(name.begin(), name.end()), "3");
+            EXPECT_EQ(std::string(seq.begin(), seq.end()), "");
+
+            EXPECT_TRUE(lr());
+            EXPECT_EQ(std::string(name.begin(), name.end()), "4");
+            EXPECT_EQ(std::string(seq.begin(), seq.end()), "GGCC");
+
+            EXPECT_FALSE(lr());
+            EXPECT_EQ(lr.position(), buffer.size());
+        }
+    }
+}
+
+TEST(LineSequenceReader, Empty) {
+    std::string buffer = "";
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+    kaori::LineSequenceReader lr(&reader);
+    EXPECT_FALSE(lr());
+}
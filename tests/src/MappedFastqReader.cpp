@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include "kaori/MappedFastqReader.hpp"
+#include "kaori/FastqReader.hpp"
+#include "byteme/RawBufferReader.hpp"
+#include <fstream>
+
+static std::string dump_to_file(const std::string& contents) {
+    std::string path = "TEST_mapped.fastq";
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+    return path;
+}
+
+static std::string as_string(const std::pair<const char*, const char*>& x) {
+    return std::string(x.first, x.second);
+}
+
+TEST(MappedFastqReader, Basic) {
+    auto path = dump_to_file("@FOO and more info\nACGT\n+\n!!!!\n@WHEE\nTGCA\n+asdasd\naaaa\n@BAR\nA\n+\n!"); // check it works without a terminating newline.
+    kaori::MappedFastqReader fq(path.c_str());
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name()), "FOO");
+    EXPECT_EQ(as_string(fq.get_sequence()), "ACGT");
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name()), "WHEE");
+    EXPECT_EQ(as_string(fq.get_sequence()), "TGCA");
+
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name()), "BAR");
+    EXPECT_EQ(as_string(fq.get_sequence()), "A");
+
+    EXPECT_FALSE(fq());
+}
+
+TEST(MappedFastqReader, Seek) {
+    auto path = dump_to_file("@FOO\nACGT\n+\n!!!!\n@WHEE\nTGCA\n+\naaaa\n@BAR\nA\n+\n!\n");
+    kaori::MappedFastqReader fq(path.c_str());
+
+    EXPECT_TRUE(fq());
+    auto after_first = fq.position();
+    EXPECT_TRUE(fq());
+    EXPECT_TRUE(fq());
+    auto end = fq.position();
+    EXPECT_FALSE(fq());
+
+    fq.seek(after_first);
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(as_string(fq.get_name()), "WHEE");
+    EXPECT_EQ(as_string(fq.get_sequence()), "TGCA");
+
+    fq.seek(end);
+    EXPECT_FALSE(fq());
+    EXPECT_ANY_THROW(fq.seek(end + 1));
+}
+
+TEST(MappedFastqReader, Empty) {
+    {
+        auto path = dump_to_file("");
+        kaori::MappedFastqReader fq(path.c_str());
+        EXPECT_FALSE(fq());
+    }
+
+    {
+        auto path = dump_to_file("@FOO\n\n+\n");
+        kaori::MappedFastqReader fq(path.c_str());
+        EXPECT_TRUE(fq());
+        EXPECT_EQ(as_string(fq.get_name()), "FOO");
+        EXPECT_EQ(as_string(fq.get_sequence()), "");
+        EXPECT_FALSE(fq());
+    }
+}
+
+TEST(MappedFastqReader, MultiLine) {
+    std::string contents = "@FOO\nA\nCG\nTGCA\n+\n!!\n!!\n!!!\n@ARG\nACACGGT\nC\n+\n@@@\n@\n@@@@\n";
+    auto path = dump_to_file(contents);
+    kaori::MappedFastqReader fq(path.c_str());
+
+    EXPECT_TRUE(fq());
+    auto seq1 = fq.get_sequence(); // pointers should remain valid after subsequent parsing.
+    EXPECT_EQ(as_string(fq.get_name()), "FOO");
+    EXPECT_TRUE(fq());
+    auto seq2 = fq.get_sequence();
+    EXPECT_EQ(as_string(fq.get_name()), "ARG");
+    EXPECT_FALSE(fq());
+
+    EXPECT_EQ(as_string(seq1), "ACGTGCA");
+    EXPECT_EQ(as_string(seq2), "ACACGGTC");
+
+    // File itself is not modified.
+    std::ifstream in(path, std::ios::binary);
+    std::string reloaded((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(reloaded, contents);
+}
+
+TEST(MappedFastqReader, Consistency) {
+    std::string contents;
+    for (size_t i = 0; i < 200; ++i) {
+        contents += "@READ_" + std::to_string(i) + " blah\n";
+        std::string seq(i % 37, "ACGT"[i % 4]);
+        if (i % 3 == 0 && seq.size() > 2) {
+            contents += seq.substr(0, 2) + "\n" + seq.substr(2) + "\n+\n" + std::string(seq.size(), '@') + "\n";
+        } else {
+            contents += seq + "\n+READ_" + std::to_string(i) + "\n" + std::string(seq.size(), '+') + "\n";
+        }
+    }
+    auto path = dump_to_file(contents);
+
+    kaori::MappedFastqReader mapped(path.c_str());
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(contents.c_str()), contents.size());
+    kaori::FastqReader ref(&reader);
+
+    while (1) {
+        bool ok = ref();
+        EXPECT_EQ(ok, mapped());
+        if (!ok) {
+            break;
+        }
+
+        const auto& refseq = ref.get_sequence();
+        EXPECT_EQ(std::string(refseq.begin(), refseq.end()), as_string(mapped.get_sequence()));
+        const auto& refname = ref.get_name();
+        EXPECT_EQ(std::string(refname.begin(), refname.end()), as_string(mapped.get_name()));
+        EXPECT_EQ(ref.position(), mapped.position());
+    }
+}
+
+static void expect_error(const std::string& contents, int nskip, const std::string& msg, const std::string& line = "") {
+    auto path = dump_to_file(contents);
+    kaori::MappedFastqReader fq(path.c_str());
+    for (int i = 0; i < nskip; ++i) {
+        fq();
+    }
+
+    EXPECT_ANY_THROW({
+        try {
+            fq();
+        } catch (std::exception& e) {
+            std::string what(e.what());
+            EXPECT_TRUE(what.find(msg) != std::string::npos);
+            EXPECT_TRUE(what.find(line) != std::string::npos);
+            throw e;
+        }
+    });
+}
+
+TEST(MappedFastqReader, Errors) {
+    expect_error("FOO", 0, "read name should start");
+    expect_error("@FOO", 0, "premature end");
+    expect_error("@FOO\nAC\n+", 0, "premature end");
+    expect_error("@FOO\nAC\n+\n!!\n@WHEE\nACGT\n+\n!!", 1, "non-equal lengths", "line 5");
+    expect_error("@FOO\nAC\n+\n!!\n@WHEE\nACGT\n+\n!!!@@!!@\n", 1, "non-equal lengths", "line 5");
+    expect_error("@FOO\nAC\n+\n!!\nWHEE", 1, "should start", "line 5");
+    EXPECT_ANY_THROW(kaori::MappedFastqReader("TEST_missing_file.fastq"));
+}
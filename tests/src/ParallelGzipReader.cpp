@@ -0,0 +1,314 @@
+#include <gtest/gtest.h>
+#include "kaori/ParallelGzipReader.hpp"
+#include "kaori/FastqReader.hpp"
+#include "kaori/Executor.hpp"
+#include "zlib.h"
+#include <random>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+
+class ParallelGzipReaderTest : public testing::TestWithParam<std::tuple<int, int> > {
+public:
+    static std::string simulate(size_t n, int seed) {
+        std::mt19937_64 rng(seed);
+        std::string output;
+        const char* bases = "ACGT";
+        for (size_t i = 0; i < n; ++i) {
+            output += (rng() % 50 == 0 ? '\n' : bases[rng() % 4]);
+        }
+        return output;
+    }
+
+    static std::string deflate_raw(const std::string& contents) {
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+        std::string output(deflateBound(&strm, contents.size()), '\0');
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(contents.data()));
+        strm.avail_in = contents.size();
+        strm.next_out = reinterpret_cast<Bytef*>(output.data());
+        strm.avail_out = output.size();
+        deflate(&strm, Z_FINISH);
+        output.resize(strm.total_out);
+        deflateEnd(&strm);
+        return output;
+    }
+
+    static void append_le(std::string& output, unsigned long long value, int bytes) {
+        for (int b = 0; b < bytes; ++b) {
+            output += static_cast<char>((value >> (8 * b)) & 0xff);
+        }
+    }
+
+    static std::string make_member(const std::string& contents, bool bgzf) {
+        auto compressed = deflate_raw(contents);
+        std::string output;
+        output += "\x1f\x8b\x08";
+        output += static_cast<char>(bgzf ? 4 : 0); // FLG
+        output += std::string(4, '\0'); // MTIME
+        output += '\0'; // XFL
+        output += '\xff'; // OS
+        if (bgzf) {
+            append_le(output, 6, 2); // XLEN
+            output += "BC";
+            append_le(output, 2, 2);
+            append_le(output, 18 + compressed.size() + 8 - 1, 2);
+        }
+        output += compressed;
+        auto crc = crc32(0, reinterpret_cast<const Bytef*>(contents.data()), contents.size());
+        append_le(output, crc, 4);
+        append_le(output, contents.size(), 4);
+        return output;
+    }
+
+    // Splitting the contents into members of variable size.
+    static std::string compress(const std::string& contents, bool bgzf, size_t max_member, int seed) {
+        std::mt19937_64 rng(seed);
+        std::string output;
+        size_t pos = 0;
+        do {
+            size_t len = std::min(contents.size() - pos, static_cast<size_t>(rng() % max_member + 1));
+            output += make_member(contents.substr(pos, len), bgzf);
+            pos += len;
+        } while (pos < contents.size());
+
+        if (bgzf) {
+            output += make_member("", true); // EOF marker.
+        }
+        return output;
+    }
+
+    static std::string dump(const std::string& contents) {
+        std::string path = "TEST_parallel_gzip.gz";
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+        return path;
+    }
+
+    static std::string consume(kaori::ParallelGzipReader& reader, size_t request) {
+        std::string collected;
+        std::vector<unsigned char> buffer(request);
+        while (1) {
+            auto filled = reader.read(buffer.data(), buffer.size());
+            collected.insert(collected.end(), buffer.begin(), buffer.begin() + filled);
+            if (filled < buffer.size()) {
+                break;
+            }
+        }
+        return collected;
+    }
+};
+
+TEST_P(ParallelGzipReaderTest, Bgzf) {
+    auto param = GetParam();
+    kaori::ParallelGzipReaderOptions opt;
+    opt.num_threads = std::get<0>(param);
+    opt.window_size = std::get<1>(param);
+
+    auto contents = simulate(20000, opt.num_threads);
+    auto path = dump(compress(contents, true, 1000, 42));
+    kaori::ParallelGzipReader reader(path.c_str(), opt);
+    EXPECT_EQ(consume(reader, 777), contents);
+}
+
+TEST_P(ParallelGzipReaderTest, MultiMember) {
+    auto param = GetParam();
+    kaori::ParallelGzipReaderOptions opt;
+    opt.num_threads = std::get<0>(param);
+    opt.window_size = std::get<1>(param);
+    opt.buffer_size = 100;
+
+    // Some members will be larger than the window, forcing serial decompression.
+    auto contents = simulate(20000, opt.num_threads + 1);
+    auto path = dump(compress(contents, false, 3000, 69));
+    kaori::ParallelGzipReader reader(path.c_str(), opt);
+    EXPECT_EQ(consume(reader, 1001), contents);
+}
+
+TEST_P(ParallelGzipReaderTest, SingleMember) {
+    auto param = GetParam();
+    kaori::ParallelGzipReaderOptions opt;
+    opt.num_threads = std::get<0>(param);
+    opt.window_size = std::get<1>(param);
+
+    auto contents = simulate(10000, opt.num_threads + 2);
+    auto path = dump(make_member(contents, false));
+    kaori::ParallelGzipReader reader(path.c_str(), opt);
+    EXPECT_EQ(consume(reader, 500), contents);
+    EXPECT_EQ(reader.peak_buffered(), 0); // decompressed serially without speculation.
+}
+
+TEST_P(ParallelGzipReaderTest, TrailingBytes) {
+    auto param = GetParam();
+    kaori::ParallelGzipReaderOptions opt;
+    opt.num_threads = std::get<0>(param);
+    opt.window_size = std::get<1>(param);
+
+    auto contents = simulate(5000, opt.num_threads + 3);
+    for (int bgzf = 0; bgzf < 2; ++bgzf) {
+        auto compressed = compress(contents, bgzf, 1000, 99);
+
+        {
+            auto path = dump(compressed + std::string(1000, '\0'));
+            kaori::ParallelGzipReader reader(path.c_str(), opt);
+            EXPECT_EQ(consume(reader, 333), contents);
+        }
+
+        {
+            auto path = dump(compressed + "FOOBAR\x1f\x8b");
+            kaori::ParallelGzipReader reader(path.c_str(), opt);
+            EXPECT_EQ(consume(reader, 333), contents);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ParallelGzipReader,
+    ParallelGzipReaderTest,
+    ::testing::Combine(
+        ::testing::Values(1, 2, 5), // number of threads
+        ::testing::Values(500, 5000, 1000000) // window size
+    )
+);
+
+TEST(ParallelGzipReader, Empty) {
+    std::string path = "TEST_parallel_gzip.gz";
+    {
+        std::ofstream out(path, std::ios::binary);
+    }
+    kaori::ParallelGzipReader reader(path.c_str(), kaori::ParallelGzipReaderOptions());
+    std::vector<unsigned char> buffer(10);
+    EXPECT_EQ(reader.read(buffer.data(), buffer.size()), 0);
+}
+
+TEST(ParallelGzipReader, Errors) {
+    std::string path = "TEST_parallel_gzip.gz";
+    kaori::ParallelGzipReaderOptions opt;
+    opt.num_threads = 2;
+    std::vector<unsigned char> buffer(1000);
+
+    {
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "FOOBAR";
+        }
+        kaori::ParallelGzipReader reader(path.c_str(), opt);
+        EXPECT_ANY_THROW({
+            try {
+                reader.read(buffer.data(), buffer.size());
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("invalid Gzip header") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+
+    // Truncated member.
+    {
+        auto member = ParallelGzipReaderTest::make_member(std::string(5000, 'A'), false);
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << member.substr(0, member.size() - 4);
+        }
+        kaori::ParallelGzipReader reader(path.c_str(), opt);
+        EXPECT_ANY_THROW({
+            try {
+                reader.read(buffer.data(), buffer.size());
+                reader.read(buffer.data(), buffer.size());
+                reader.read(buffer.data(), buffer.size());
+                reader.read(buffer.data(), buffer.size());
+                reader.read(buffer.data(), buffer.size());
+                reader.read(buffer.data(), buffer.size());
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("premature end") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+
+    EXPECT_ANY_THROW(kaori::ParallelGzipReader("TEST_missing_file.gz", opt));
+}
+
+TEST(ParallelGzipReader, Fastq) {
+    std::string contents = "@FOO\nACGT\n+\n!!!!\n@WHEE\nTG\nCA\n+asdasd\naa\naa\n";
+    std::string path = "TEST_parallel_gzip.gz";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << ParallelGzipReaderTest::make_member(contents.substr(0, 20), true);
+        out << ParallelGzipReaderTest::make_member(contents.substr(20), true);
+    }
+
+    kaori::ParallelGzipReaderOptions opt;
+    opt.num_threads = 2;
+    kaori::ParallelGzipReader reader(path.c_str(), opt);
+    kaori::FastqReader fq(&reader, 3);
+
+    EXPECT_TRUE(fq());
+    const auto& seq = fq.get_sequence();
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGT");
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "TGCA");
+    EXPECT_FALSE(fq());
+}
+
+TEST(ParallelGzipReader, ManyMembers) {
+    // Many small members in a single window should not require much more memory than their decompressed contents.
+    auto contents = ParallelGzipReaderTest::simulate(200000, 123);
+    kaori::ParallelGzipReaderOptions opt;
+    opt.window_size = 10000000;
+
+    for (int bgzf = 0; bgzf < 2; ++bgzf) {
+        auto compressed = ParallelGzipReaderTest::compress(contents, bgzf, 200, 321);
+        auto path = ParallelGzipReaderTest::dump(compressed);
+
+        for (int threads : { 1, 4 }) {
+            opt.num_threads = threads;
+            kaori::ParallelGzipReader reader(path.c_str(), opt);
+            EXPECT_EQ(ParallelGzipReaderTest::consume(reader, 9999), contents);
+            EXPECT_GT(reader.peak_buffered(), 0);
+            EXPECT_LT(reader.peak_buffered(), contents.size() * 2);
+        }
+    }
+}
+
+class CountingExecutor final : public kaori::Executor {
+public:
+    CountingExecutor(int num_threads) : my_pool(num_threads) {}
+
+    void submit(std::function<void()> task) {
+        ++submitted;
+        my_pool.submit(std::move(task));
+    }
+
+    void wait() {
+        my_pool.wait();
+    }
+
+    int submitted = 0;
+
+private:
+    kaori::DefaultExecutor my_pool;
+};
+
+TEST(ParallelGzipReader, Executor) {
+    auto contents = ParallelGzipReaderTest::simulate(50000, 456);
+    kaori::ParallelGzipReaderOptions opt;
+    opt.window_size = 5000;
+    opt.num_threads = 3;
+
+    CountingExecutor exec(opt.num_threads);
+    opt.executor = &exec;
+
+    for (int bgzf = 0; bgzf < 2; ++bgzf) {
+        auto compressed = ParallelGzipReaderTest::compress(contents, bgzf, 200, 654);
+        auto path = ParallelGzipReaderTest::dump(compressed);
+        int previous = exec.submitted;
+        kaori::ParallelGzipReader reader(path.c_str(), opt);
+        EXPECT_EQ(ParallelGzipReaderTest::consume(reader, 1234), contents);
+        EXPECT_GT(exec.submitted, previous + 10); // all windows are decompressed on the supplied executor.
+    }
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include "kaori/PrefetchReader.hpp"
+#include "kaori/FastqReader.hpp"
+#include "byteme/RawBufferReader.hpp"
+#include <random>
+#include <string>
+#include <stdexcept>
+
+class PrefetchReaderTest : public testing::TestWithParam<std::tuple<int, int, int> > {
+protected:
+    static std::string simulate(size_t n) {
+        std::mt19937_64 rng(n);
+        std::string output;
+        for (size_t i = 0; i < n; ++i) {
+            output += static_cast<char>(rng() % 256);
+        }
+        return output;
+    }
+};
+
+TEST_P(PrefetchReaderTest, Basic) {
+    auto param = GetParam();
+    size_t block_size = std::get<0>(param);
+    size_t num_blocks = std::get<1>(param);
+    size_t request = std::get<2>(param);
+
+    for (size_t len : { 0, 1, 99, 100, 1000, 5001 }) {
+        auto contents = simulate(len);
+        byteme::RawBufferReader source(reinterpret_cast<const unsigned char*>(contents.data()), contents.size());
+        kaori::PrefetchReader<byteme::RawBufferReader*> reader(&source, block_size, num_blocks);
+
+        std::string collected;
+        std::vector<unsigned char> buffer(request);
+        while (1) {
+            auto filled = reader.read(buffer.data(), buffer.size());
+            collected.insert(collected.end(), buffer.begin(), buffer.begin() + filled);
+            if (filled < buffer.size()) {
+                break;
+            }
+        }
+
+        EXPECT_EQ(collected, contents);
+        EXPECT_EQ(reader.read(buffer.data(), buffer.size()), 0);
+    }
+}
+
+TEST_P(PrefetchReaderTest, EarlyExit) {
+    auto param = GetParam();
+    auto contents = simulate(10000);
+    byteme::RawBufferReader source(reinterpret_cast<const unsigned char*>(contents.data()), contents.size());
+    kaori::PrefetchReader<byteme::RawBufferReader*> reader(&source, std::get<0>(param), std::get<1>(param));
+
+    // Destructor should not hang if we stop consuming halfway.
+    std::vector<unsigned char> buffer(std::get<2>(param));
+    EXPECT_EQ(reader.read(buffer.data(), buffer.size()), buffer.size());
+    EXPECT_EQ(std::string(buffer.begin(), buffer.end()), contents.substr(0, buffer.size()));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    PrefetchReader,
+    PrefetchReaderTest,
+    ::testing::Combine(
+        ::testing::Values(1, 10, 100), // block size
+        ::testing::Values(1, 2, 5), // number of blocks
+        ::testing::Values(1, 7, 100) // size of each request
+    )
+);
+
+class FailingReader final : public byteme::Reader {
+public:
+    FailingReader(size_t limit) : my_limit(limit) {}
+    std::size_t read(unsigned char* buffer, std::size_t n) {
+        if (my_sent >= my_limit) {
+            throw std::runtime_error("I failed");
+        }
+        std::fill_n(buffer, n, 'A');
+        my_sent += n;
+        return n;
+    }
+private:
+    size_t my_limit, my_sent = 0;
+};
+
+TEST(PrefetchReader, Errors) {
+    FailingReader source(100);
+    kaori::PrefetchReader<FailingReader*> reader(&source, 10, 3);
+    std::vector<unsigned char> buffer(1000);
+    EXPECT_ANY_THROW({
+        try {
+            reader.read(buffer.data(), buffer.size());
+        } catch (std::exception& e) {
+            EXPECT_EQ(std::string(e.what()), "I failed");
+            throw e;
+        }
+    });
+}
+
+TEST(PrefetchReader, Fastq) {
+    std::string buffer = "@FOO\nACGT\n+\n!!!!\n@WHEE\nTG\nCA\n+asdasd\naa\naa\n";
+    byteme::RawBufferReader source(reinterpret_cast<const unsigned char*>(buffer.c_str()), buffer.size());
+    kaori::PrefetchReader<byteme::RawBufferReader*> reader(&source, 5, 2);
+    kaori::FastqReader fq(&reader, 3);
+
+    EXPECT_TRUE(fq());
+    const auto& seq = fq.get_sequence();
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "ACGT");
+    EXPECT_TRUE(fq());
+    EXPECT_EQ(std::string(seq.begin(), seq.end()), "TGCA");
+    EXPECT_FALSE(fq());
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "kaori/ScanTemplate.hpp"
 #include <string>
+#include <vector>
+#include <random>
 
 TEST(ScanTemplate, Basic) {
     std::string thing = "ACGT----TTTT"; 
@@ -39,6 +41,36 @@ TEST(ScanTemplate, Basic) {
     }
 }
 
+TEST(ScanTemplate, Start) {
+    std::string thing = "ACGT----TTTT"; 
+    kaori::ScanTemplate<16> stuff(thing.c_str(), thing.size(), kaori::SearchStrand::BOTH);
+    std::string seq = "GACGTAANATTTTAAAAACGTNCCCTTTTAAAA";
+
+    std::vector<kaori::ScanTemplate<16>::State> full;
+    auto out = stuff.initialize(seq.c_str(), seq.size());
+    while (!out.finished) {
+        stuff.next(out);
+        full.push_back(out);
+    }
+
+    // Starting at any position gives the same results as a scan from the start of the read.
+    for (size_t start = 0; start < full.size(); ++start) {
+        auto out = stuff.initialize(seq.c_str(), seq.size(), start);
+        for (size_t i = start; i < full.size(); ++i) {
+            ASSERT_FALSE(out.finished);
+            stuff.next(out);
+            EXPECT_EQ(out.position, i);
+            EXPECT_EQ(out.forward_mismatches, full[i].forward_mismatches);
+            EXPECT_EQ(out.reverse_mismatches, full[i].reverse_mismatches);
+            EXPECT_EQ(out.finished, full[i].finished);
+        }
+    }
+
+    // Too close to the end of the read.
+    EXPECT_TRUE(stuff.initialize(seq.c_str(), seq.size(), full.size()).finished);
+    EXPECT_TRUE(stuff.initialize(seq.c_str(), seq.size(), seq.size() + 10).finished);
+}
+
 TEST(ScanTemplate, TooShort) {
     std::string thing = "ACGT----TTTT"; 
     kaori::ScanTemplate<16> stuff(thing.c_str(), thing.size(), kaori::SearchStrand::FORWARD);
@@ -313,3 +345,366 @@ TEST(ScanTemplate, BadBases) {
         }
     }
 }
+
+template<size_t max_size_>
+void compare_to_naive(const std::string& thing, const std::vector<std::string>& reads) {
+    kaori::ScanTemplate<max_size_> stuff(thing.c_str(), thing.size(), kaori::SearchStrand::BOTH);
+
+    std::string revcomp(thing.rbegin(), thing.rend());
+    for (auto& b : revcomp) {
+        if (b != '-') {
+            b = kaori::complement_base(b);
+        }
+    }
+
+    auto naive = [](const std::string& tmpl, const std::string& read, size_t pos) -> int {
+        int mm = 0;
+        for (size_t i = 0; i < tmpl.size(); ++i) {
+            if (tmpl[i] != '-' && tmpl[i] != read[pos + i]) {
+                ++mm;
+            }
+        }
+        return mm;
+    };
+
+    for (const auto& seq : reads) {
+        auto out = stuff.initialize(seq.c_str(), seq.size());
+        ASSERT_EQ(out.finished, seq.size() < thing.size());
+        while (!out.finished) {
+            stuff.next(out);
+            EXPECT_EQ(out.forward_mismatches, naive(thing, seq, out.position));
+            EXPECT_EQ(out.reverse_mismatches, naive(revcomp, seq, out.position));
+        }
+    }
+}
+
+TEST(ScanTemplate, MultiWord) {
+    // Templates that span multiple 64-bit words, including those where the template is shorter than the maximum size.
+    std::mt19937_64 rng(42);
+    auto random_seq = [&](size_t len, bool with_n) -> std::string {
+        std::string out;
+        for (size_t i = 0; i < len; ++i) {
+            out += (with_n && rng() % 20 == 0 ? 'N' : "ACGT"[rng() % 4]);
+        }
+        return out;
+    };
+
+    std::vector<std::string> templates { 
+        "ACGTACGTAC--------GTTTTACGAGCT", // fits in two words.
+        "ACGTACGTACGTACGTACGTACGTACGTACGTA", // just spills over into a third word.
+        "ACGTACGTAC--------------GTTTTACGACGTACGTAC--------------GTTTTACGAAAACCCC" // five words.
+    };
+
+    for (const auto& thing : templates) {
+        std::vector<std::string> reads;
+        for (int r = 0; r < 20; ++r) {
+            auto read = random_seq(rng() % 100 + 20, r % 2);
+            // Embedding the template in some of the reads.
+            if (read.size() > thing.size() && r % 3 == 0) {
+                auto pos = rng() % (read.size() - thing.size());
+                for (size_t i = 0; i < thing.size(); ++i) {
+                    if (thing[i] != '-') {
+                        read[pos + i] = thing[i];
+                    }
+                }
+            }
+            reads.push_back(std::move(read));
+        }
+
+        compare_to_naive<128>(thing, reads);
+        if (thing.size() <= 32) {
+            compare_to_naive<32>(thing, reads);
+        }
+        if (thing.size() <= 64) {
+            compare_to_naive<64>(thing, reads);
+        }
+    }
+}
+
+template<size_t max_size_>
+void check_spaced_ambiguity(const std::string& thing, const std::vector<std::string>& reads) {
+    compare_to_naive<max_size_>(thing, reads);
+
+    // Each ambiguous base should only be reported while it lies inside the window.
+    kaori::ScanTemplate<max_size_> stuff(thing.c_str(), thing.size(), kaori::SearchStrand::BOTH);
+    for (const auto& seq : reads) {
+        auto out = stuff.initialize(seq.c_str(), seq.size());
+        while (!out.finished) {
+            stuff.next(out);
+            bool expected = false;
+            for (size_t i = 0; i < thing.size(); ++i) {
+                expected = expected || !kaori::is_standard_base(seq[out.position + i]);
+            }
+            EXPECT_EQ(out.any_ambiguous, expected);
+        }
+    }
+}
+
+TEST(ScanTemplate, SpacedAmbiguity) {
+    // Regression test for ambiguous bases that are separated by more than one template length,
+    // which checks that the ambiguity state is cleared once each base leaves the window.
+    std::vector<std::string> templates { "ACGT----TTTT", "ACGT--TTTTTT", "ACGTACGTAC--------GTTTTACGAGCT" };
+    const char* others = "NnRY.-";
+
+    std::mt19937_64 rng(1234);
+    for (const auto& thing : templates) {
+        std::vector<std::string> reads;
+        for (int r = 0; r < 20; ++r) {
+            std::string read;
+            size_t len = rng() % 200 + 100;
+            for (size_t i = 0; i < len; ++i) {
+                read += "ACGT"[rng() % 4];
+            }
+
+            size_t pos = rng() % thing.size();
+            while (pos < read.size()) {
+                read[pos] = others[rng() % 6];
+                pos += thing.size() + 1 + rng() % thing.size();
+            }
+            reads.push_back(std::move(read));
+        }
+
+        check_spaced_ambiguity<32>(thing, reads);
+        check_spaced_ambiguity<64>(thing, reads);
+        check_spaced_ambiguity<0>(thing, reads);
+        if (thing.size() <= 16) {
+            check_spaced_ambiguity<16>(thing, reads);
+        }
+    }
+}
+
+template<size_t max_size_>
+void compare_scan_to_next(const std::string& thing, kaori::SearchStrand strand, int max_mismatches, const std::vector<std::string>& reads) {
+    kaori::ScanTemplate<max_size_> stuff(thing.c_str(), thing.size(), strand);
+    bool use_forward = kaori::search_forward(strand);
+    bool use_reverse = kaori::search_reverse(strand);
+
+    std::vector<typename kaori::ScanTemplate<max_size_>::Candidate> expected;
+    std::vector<std::pair<const char*, const char*> > ptrs;
+    for (size_t r = 0; r < reads.size(); ++r) {
+        const auto& seq = reads[r];
+        ptrs.emplace_back(seq.c_str(), seq.c_str() + seq.size());
+        auto out = stuff.initialize(seq.c_str(), seq.size());
+        while (!out.finished) {
+            stuff.next(out);
+            if ((use_forward && out.forward_mismatches <= max_mismatches) || (use_reverse && out.reverse_mismatches <= max_mismatches)) {
+                expected.push_back({ r, out.position, out.forward_mismatches, out.reverse_mismatches });
+            }
+        }
+    }
+
+    std::vector<typename kaori::ScanTemplate<max_size_>::Candidate> observed;
+    stuff.scan(ptrs.data(), ptrs.size(), max_mismatches, observed);
+    ASSERT_EQ(observed.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(observed[i].read, expected[i].read);
+        EXPECT_EQ(observed[i].position, expected[i].position);
+        if (use_forward) {
+            EXPECT_EQ(observed[i].forward_mismatches, expected[i].forward_mismatches);
+        }
+        if (use_reverse) {
+            EXPECT_EQ(observed[i].reverse_mismatches, expected[i].reverse_mismatches);
+        }
+    }
+}
+
+TEST(ScanTemplate, Batch) {
+    std::mt19937_64 rng(69);
+    std::vector<std::string> templates { 
+        "ACGTACGT----TTTTACGA",
+        "ACGTACGTAC--------GTTTTACGAGCT",
+        "ACGTACGTAC--------------GTTTTACGACGTACGTAC--------------GTTTTACGAAAACCCC"
+    };
+
+    for (const auto& thing : templates) {
+        std::string revcomp(thing.rbegin(), thing.rend());
+        for (auto& b : revcomp) {
+            if (b != '-') {
+                b = kaori::complement_base(b);
+            }
+        }
+
+        // Using more reads than the number of lanes, with varying lengths (including reads shorter than the template).
+        std::vector<std::string> reads;
+        for (int r = 0; r < 50; ++r) {
+            std::string read;
+            size_t len = rng() % 120;
+            for (size_t i = 0; i < len; ++i) {
+                read += (r % 2 && rng() % 20 == 0 ? 'N' : "ACGT"[rng() % 4]);
+            }
+
+            if (read.size() > thing.size() && r % 3 == 0) {
+                const auto& embedded = (r % 2 ? revcomp : thing);
+                auto pos = rng() % (read.size() - thing.size());
+                for (size_t i = 0; i < thing.size(); ++i) {
+                    if (embedded[i] != '-') {
+                        read[pos + i] = (rng() % 10 == 0 ? 'A' : embedded[i]); // adding some mismatches.
+                    }
+                }
+            }
+            reads.push_back(std::move(read));
+        }
+
+        for (auto strand : { kaori::SearchStrand::FORWARD, kaori::SearchStrand::REVERSE, kaori::SearchStrand::BOTH }) {
+            for (int mm = 0; mm <= 3; ++mm) {
+                compare_scan_to_next<128>(thing, strand, mm, reads);
+                if (thing.size() <= 32) {
+                    compare_scan_to_next<32>(thing, strand, mm, reads);
+                }
+            }
+        }
+    }
+
+    // Empty batches are fine.
+    kaori::ScanTemplate<32> stuff(templates[0].c_str(), templates[0].size(), kaori::SearchStrand::BOTH);
+    std::vector<kaori::ScanTemplate<32>::Candidate> observed(10);
+    stuff.scan(NULL, 0, 1, observed);
+    EXPECT_TRUE(observed.empty());
+}
+
+TEST(ScanTemplate, Anchors) {
+    std::mt19937_64 rng(1000);
+    std::vector<std::string> templates { 
+        "ACGTACGTAC--------GTTTTACGAGCT",
+        "ACGTACGTACGTACGTACGTACGTACGTACGTAACGTACGTAC", // longer than the maximum anchor length.
+        "ACGTACGTAC--------------GTTTTACGACGTACGTAC--------------GTTTTACGAAAACCCC"
+    };
+
+    for (const auto& thing : templates) {
+        std::string revcomp(thing.rbegin(), thing.rend());
+        for (auto& b : revcomp) {
+            if (b != '-') {
+                b = kaori::complement_base(b);
+            }
+        }
+
+        std::vector<std::string> reads;
+        for (int r = 0; r < 50; ++r) {
+            std::string read;
+            size_t len = rng() % 150;
+            for (size_t i = 0; i < len; ++i) {
+                read += (r % 2 && rng() % 20 == 0 ? 'N' : "ACGT"[rng() % 4]);
+            }
+
+            if (read.size() > thing.size() && r % 3 != 0) {
+                const auto& embedded = (r % 2 ? revcomp : thing);
+                auto pos = rng() % (read.size() - thing.size());
+                for (size_t i = 0; i < thing.size(); ++i) {
+                    if (embedded[i] != '-') {
+                        read[pos + i] = (rng() % 10 == 0 ? 'A' : embedded[i]);
+                    }
+                }
+            }
+            reads.push_back(std::move(read));
+        }
+
+        size_t total_expected = 0;
+        for (auto strand : { kaori::SearchStrand::FORWARD, kaori::SearchStrand::REVERSE, kaori::SearchStrand::BOTH }) {
+            kaori::ScanTemplate<128> stuff(thing.c_str(), thing.size(), strand);
+            bool use_forward = kaori::search_forward(strand);
+            bool use_reverse = kaori::search_reverse(strand);
+
+            for (int mm = 0; mm <= 2; ++mm) {
+                ASSERT_TRUE(stuff.build_anchors(mm));
+                EXPECT_GE(stuff.anchor_length(), 6);
+
+                std::vector<kaori::SeqLength> positions;
+                for (const auto& seq : reads) {
+                    stuff.anchor_positions(seq.c_str(), seq.size(), positions);
+                    EXPECT_TRUE(std::is_sorted(positions.begin(), positions.end()));
+
+                    auto out = stuff.initialize(seq.c_str(), seq.size());
+                    while (!out.finished) {
+                        stuff.next(out);
+                        if ((use_forward && out.forward_mismatches <= mm) || (use_reverse && out.reverse_mismatches <= mm)) {
+                            EXPECT_TRUE(std::binary_search(positions.begin(), positions.end(), out.position));
+                            ++total_expected;
+                        }
+                    }
+
+                    for (auto p : positions) {
+                        EXPECT_LE(p + thing.size(), seq.size());
+                    }
+                }
+            }
+        }
+
+        EXPECT_GT(total_expected, 0);
+    }
+
+    // No anchors if the constant regions are too short.
+    std::string thing = "ACGT----TTTT";
+    kaori::ScanTemplate<16> stuff(thing.c_str(), thing.size(), kaori::SearchStrand::FORWARD);
+    EXPECT_TRUE(stuff.build_anchors(0, 4));
+    EXPECT_EQ(stuff.anchor_length(), 4);
+    EXPECT_FALSE(stuff.build_anchors(1));
+    EXPECT_EQ(stuff.anchor_length(), 0);
+    EXPECT_FALSE(stuff.build_anchors(-1));
+
+    std::vector<kaori::SeqLength> positions{ 1, 2, 3 };
+    std::string seq = "ACGTAAAATTTT";
+    stuff.anchor_positions(seq.c_str(), seq.size(), positions);
+    EXPECT_TRUE(positions.empty());
+}
+
+TEST(ScanTemplate, RuntimeSize) {
+    std::mt19937_64 rng(2024);
+    auto random_seq = [&](size_t len, bool with_n) -> std::string {
+        std::string out;
+        for (size_t i = 0; i < len; ++i) {
+            out += (with_n && rng() % 20 == 0 ? 'N' : "ACGT"[rng() % 4]);
+        }
+        return out;
+    };
+
+    std::vector<std::string> templates { 
+        "ACGT----TTTT", // one word.
+        "ACGTACGTAC--------GTTTTACGAGCT", // two words.
+        "ACGTACGTACGTACGTACGTACGTACGTACGTA", // three words.
+        "ACGTACGTAC--------------GTTTTACGACGTACGTAC--------------GTTTTACGAAAACCCC",
+        random_seq(150, false) + "--------" + random_seq(150, false) // larger than any of the compile-time sizes used elsewhere.
+    };
+
+    for (const auto& thing : templates) {
+        std::vector<std::string> reads;
+        for (int r = 0; r < 30; ++r) {
+            auto read = random_seq(rng() % 400 + 5, r % 2);
+            if (read.size() > thing.size() && r % 3 == 0) {
+                auto pos = rng() % (read.size() - thing.size());
+                for (size_t i = 0; i < thing.size(); ++i) {
+                    if (thing[i] != '-') {
+                        read[pos + i] = (rng() % 10 == 0 ? 'A' : thing[i]);
+                    }
+                }
+            }
+            reads.push_back(std::move(read));
+        }
+
+        compare_to_naive<0>(thing, reads);
+        for (auto strand : { kaori::SearchStrand::FORWARD, kaori::SearchStrand::BOTH }) {
+            compare_scan_to_next<0>(thing, strand, 2, reads);
+        }
+
+        // Same results as a compile-time size, including the handling of ambiguous bases.
+        if (thing.size() <= 128) {
+            kaori::ScanTemplate<0> dynamic(thing.c_str(), thing.size(), kaori::SearchStrand::BOTH);
+            kaori::ScanTemplate<128> fixed(thing.c_str(), thing.size(), kaori::SearchStrand::BOTH);
+            kaori::ScanTemplate<0>::State dout; // reused across reads, along with the specialized next().
+            for (const auto& seq : reads) {
+                dynamic.initialize(seq.c_str(), seq.size(), dout);
+                auto fout = fixed.initialize(seq.c_str(), seq.size());
+                ASSERT_EQ(dout.finished, fout.finished);
+                dynamic.with_next([&](auto next) -> void {
+                    while (!fout.finished) {
+                        next(dout);
+                        fixed.next(fout);
+                        EXPECT_EQ(dout.position, fout.position);
+                        EXPECT_EQ(dout.forward_mismatches, fout.forward_mismatches);
+                        EXPECT_EQ(dout.reverse_mismatches, fout.reverse_mismatches);
+                        EXPECT_EQ(dout.finished, fout.finished);
+                    }
+                });
+            }
+        }
+    }
+}
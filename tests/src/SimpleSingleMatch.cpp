@@ -2,6 +2,7 @@
 #include "kaori/SimpleSingleMatch.hpp"
 #include <string>
 #include <vector>
+#include <random>
 #include "utils.h"
 
 class SimpleSingleMatchTest : public ::testing::Test {
@@ -374,6 +375,208 @@ TEST_F(SimpleSingleMatchTest, Caching) {
     stuff.reduce(state);
 }
 
+TEST_F(SimpleSingleMatchTest, Batch) {
+    std::string constant = "ACGT----TGCA";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    kaori::BarcodePool ptrs(variables);
+
+    kaori::SimpleSingleMatch<16> stuff(constant.c_str(), constant.size(), ptrs, [&]{
+        Options<16> opt;
+        opt.strand = kaori::SearchStrand::BOTH;
+        opt.max_mismatches = 1;
+        return opt;
+    }());
+
+    std::vector<std::string> reads {
+        "cagcatcgatcgtgaACGTAAAATGCAcacggaggaga", // forward match.
+        "tcgatcgtgaTGCACCTCACGTcacACGTTATTTGCA", // multiple partial matches.
+        "acacacacacTGCATTTTACGT", // reverse match.
+        "ACG", // too short.
+        "ACGTAAAATGCAaaACGTCCCATGCA", // multiple matches with different mismatches.
+        "ACGTAAAATGCAaaACGTCCCCTGCA", // tied matches.
+        "acgtNNNNacgtacgtTTTTtgcannnn", // lower case and ambiguous bases.
+        ""
+    };
+    for (int i = 0; i < 20; ++i) {
+        reads.push_back(reads[i % 8] + "ACGTGGGGTGCA"); // more reads than the number of lanes in a batch.
+    }
+
+    std::vector<std::pair<const char*, const char*> > batch;
+    for (const auto& r : reads) {
+        batch.emplace_back(r.c_str(), r.c_str() + r.size());
+    }
+
+    for (bool best : { false, true }) {
+        auto ref = stuff.initialize();
+        auto state = stuff.initialize();
+        std::size_t counter = 0;
+
+        stuff.search_batch(batch.data(), batch.size(), best, state, [&](std::size_t i, bool found) -> void {
+            EXPECT_EQ(i, counter);
+            ++counter;
+
+            const auto& seq = reads[i];
+            bool expected = (best ? stuff.search_best(seq.c_str(), seq.size(), ref) : stuff.search_first(seq.c_str(), seq.size(), ref));
+            EXPECT_EQ(found, expected);
+            EXPECT_EQ(state.index, ref.index);
+            if (found) {
+                EXPECT_EQ(state.position, ref.position);
+                EXPECT_EQ(state.mismatches, ref.mismatches);
+                EXPECT_EQ(state.variable_mismatches, ref.variable_mismatches);
+                EXPECT_EQ(state.reverse, ref.reverse);
+            }
+        });
+
+        EXPECT_EQ(counter, reads.size());
+    }
+}
+
+TEST_F(SimpleSingleMatchTest, LikelyOffsets) {
+    std::string constant = "ACGT----TGCA";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    kaori::BarcodePool ptrs(variables);
+
+    kaori::SimpleSingleMatch<16> stuff(constant.c_str(), constant.size(), ptrs, [&]{
+        Options<16> opt;
+        opt.likely_offsets = std::vector<kaori::SeqLength>{ 100, 16 };
+        return opt;
+    }());
+
+    // Match at the likely offset takes priority over an earlier match.
+    {
+        std::string seq = "acACGTCCCCTGCAacACGTAAAATGCAcacggaggaga";
+        auto state = stuff.initialize();
+        EXPECT_TRUE(stuff.search_first(seq.c_str(), seq.size(), state));
+        EXPECT_EQ(state.position, 16);
+        EXPECT_EQ(state.index, 0);
+    }
+
+    // Falls back to a full scan if there's no match at the likely offsets.
+    {
+        std::string seq = "acACGTCCCCTGCAacacacacacacacacacaca";
+        auto state = stuff.initialize();
+        EXPECT_TRUE(stuff.search_first(seq.c_str(), seq.size(), state));
+        EXPECT_EQ(state.position, 2);
+        EXPECT_EQ(state.index, 1);
+    }
+
+    {
+        std::string seq = "acacacacacacacacaca";
+        auto state = stuff.initialize();
+        EXPECT_FALSE(stuff.search_first(seq.c_str(), seq.size(), state));
+    }
+}
+
+TEST_F(SimpleSingleMatchTest, LearnOffsets) {
+    std::string constant = "ACGT----TGCA";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    kaori::BarcodePool ptrs(variables);
+
+    kaori::SimpleSingleMatch<16> stuff(constant.c_str(), constant.size(), ptrs, [&]{
+        Options<16> opt;
+        opt.learn_offsets = 5;
+        return opt;
+    }());
+
+    auto state = stuff.initialize();
+    std::vector<std::string> learning {
+        "acacacACGTAAAATGCA",
+        "acacacACGTCCCCTGCAaa",
+        "ACGTGGGGTGCAacacac", // different position.
+        "acacacACGTTTTTTGCAacacac",
+        "acacacACGTAAAATGCA",
+    };
+    for (const auto& seq : learning) {
+        EXPECT_TRUE(stuff.search_first(seq.c_str(), seq.size(), state));
+    }
+    EXPECT_EQ(state.likely_offsets, std::vector<kaori::SeqLength>({ 6, 0 }));
+
+    // Matches at the learned offsets are reported first.
+    std::string seq = "ACGTGGGGTGCAACGTAAAATGCA";
+    EXPECT_TRUE(stuff.search_first(seq.c_str(), seq.size(), state));
+    EXPECT_EQ(state.position, 0);
+    EXPECT_EQ(state.index, 2);
+
+    // Otherwise we fall back to a full scan.
+    seq = "acacacacacacacACGTAAAATGCA";
+    EXPECT_TRUE(stuff.search_first(seq.c_str(), seq.size(), state));
+    EXPECT_EQ(state.position, 14);
+    EXPECT_EQ(state.index, 0);
+
+    // Batch searches give the same results.
+    std::vector<std::pair<const char*, const char*> > batch;
+    batch.emplace_back(seq.c_str(), seq.c_str() + seq.size());
+    stuff.search_batch(batch.data(), batch.size(), false, state, [&](std::size_t, bool found) -> void {
+        EXPECT_TRUE(found);
+        EXPECT_EQ(state.position, 14);
+    });
+}
+
+TEST_F(SimpleSingleMatchTest, Anchors) {
+    std::string constant = "ACGTACGTAC----TGCATGCATG";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    kaori::BarcodePool ptrs(variables);
+
+    std::mt19937_64 rng(123);
+    std::vector<std::string> reads;
+    for (int r = 0; r < 100; ++r) {
+        std::string read;
+        size_t len = rng() % 150;
+        for (size_t i = 0; i < len; ++i) {
+            read += "ACGT"[rng() % 4];
+        }
+        if (read.size() > constant.size()) {
+            for (int copies = 0; copies < r % 3; ++copies) {
+                auto pos = rng() % (read.size() - constant.size());
+                const auto& var = variables[rng() % variables.size()];
+                for (size_t i = 0; i < constant.size(); ++i) {
+                    char b = (constant[i] == '-' ? var[i - 10] : constant[i]);
+                    read[pos + i] = (rng() % 15 == 0 ? 'A' : b);
+                }
+            }
+        }
+        reads.push_back(std::move(read));
+    }
+
+    for (auto strand : { kaori::SearchStrand::FORWARD, kaori::SearchStrand::BOTH }) {
+        for (int mm = 0; mm <= 2; ++mm) {
+            Options<32> opt;
+            opt.strand = strand;
+            opt.max_mismatches = mm;
+            kaori::SimpleSingleMatch<32> ref(constant.c_str(), constant.size(), ptrs, opt);
+            opt.use_anchors = true;
+            kaori::SimpleSingleMatch<32> stuff(constant.c_str(), constant.size(), ptrs, opt);
+
+            auto rstate = ref.initialize();
+            auto state = stuff.initialize();
+            int nfound = 0;
+
+            for (const auto& seq : reads) {
+                bool found = ref.search_first(seq.c_str(), seq.size(), rstate);
+                EXPECT_EQ(found, stuff.search_first(seq.c_str(), seq.size(), state));
+                EXPECT_EQ(state.index, rstate.index);
+                if (found) {
+                    EXPECT_EQ(state.position, rstate.position);
+                    EXPECT_EQ(state.mismatches, rstate.mismatches);
+                    EXPECT_EQ(state.reverse, rstate.reverse);
+                    ++nfound;
+                }
+
+                found = ref.search_best(seq.c_str(), seq.size(), rstate);
+                EXPECT_EQ(found, stuff.search_best(seq.c_str(), seq.size(), state));
+                EXPECT_EQ(state.index, rstate.index);
+                if (found) {
+                    EXPECT_EQ(state.position, rstate.position);
+                    EXPECT_EQ(state.mismatches, rstate.mismatches);
+                    EXPECT_EQ(state.reverse, rstate.reverse);
+                }
+            }
+
+            EXPECT_GT(nfound, 0);
+        }
+    }
+}
+
 TEST_F(SimpleSingleMatchTest, Error) {
     std::string constant = "ACGT------TGCA";
     std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
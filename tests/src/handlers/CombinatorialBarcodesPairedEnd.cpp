@@ -5,6 +5,7 @@
 #include "../utils.h"
 
 #include <string>
+#include <sstream>
 #include <vector>
 
 class CombinatorialBarcodesPairedEndTest : public testing::Test {
@@ -551,3 +552,42 @@ TEST_F(CombinatorialBarcodesPairedEndTest, DiagnosticsBest) {
     }
 }
 
+
+TEST_F(CombinatorialBarcodesPairedEndTest, SaveLoad) {
+    kaori::CombinatorialBarcodesPairedEnd<32> stuff(
+        constant1.c_str(), constant1.size(), kaori::BarcodePool(variables1),
+        constant2.c_str(), constant2.size(), kaori::BarcodePool(variables2),
+        Options<32>()
+    );
+
+    std::vector<std::string> seq1 { "AAAATTTTCGGC", "AAAAGGGGCGGC", "AAAATTTTCGGC", "cacacacaca" };
+    std::vector<std::string> seq2 { "AGCTACACACTTTT", "AGCTAGAGAGTTTT", "AGCTACACACTTTT", "AGCTAGAGAGTTTT" };
+    auto state = stuff.initialize();
+    for (size_t i = 0; i < seq1.size(); ++i) {
+        stuff.process(state, bounds(seq1[i]), bounds(seq2[i]));
+    }
+    stuff.reduce(state);
+
+    std::stringstream buffer;
+    stuff.save(buffer);
+
+    kaori::CombinatorialBarcodesPairedEnd<32> loaded(
+        constant1.c_str(), constant1.size(), kaori::BarcodePool(variables1),
+        constant2.c_str(), constant2.size(), kaori::BarcodePool(variables2),
+        Options<32>()
+    );
+    loaded.load(buffer);
+    EXPECT_EQ(flatten_results<2>(loaded.get_combinations()), flatten_results<2>(stuff.get_combinations()));
+    EXPECT_EQ(loaded.get_combinations().size(), 2);
+    EXPECT_EQ(loaded.get_total(), 4);
+    EXPECT_EQ(loaded.get_barcode1_only(), 0);
+    EXPECT_EQ(loaded.get_barcode2_only(), 1);
+
+    // Truncating the trailing counts leaves the existing results untouched.
+    std::string truncated = buffer.str();
+    std::stringstream input(truncated.substr(0, truncated.size() - 1));
+    EXPECT_ANY_THROW(stuff.load(input));
+    EXPECT_EQ(flatten_results<2>(loaded.get_combinations()), flatten_results<2>(stuff.get_combinations()));
+    EXPECT_EQ(stuff.get_total(), 4);
+    EXPECT_EQ(stuff.get_barcode2_only(), 1);
+}
@@ -433,3 +433,32 @@ TEST_F(CombinatorialBarcodesSingleEndTest, Error) {
         }
     });
 }
+
+TEST_F(CombinatorialBarcodesSingleEndTest, PersistentState) {
+    std::vector<std::string> seq;
+    for (int i = 0; i < 100; ++i) {
+        seq.push_back("cag" + constant.substr(0, 4) + variables1[i % 4] + "CGGC" + variables2[(i / 4) % 4] + "TTTTacac");
+        seq.push_back("acacacacacacacacacacacacacacaca");
+    }
+    std::string fq = convert_to_fastq(seq);
+
+    kaori::CombinatorialBarcodesSingleEnd<128, 2> ref(constant.c_str(), constant.size(), make_pointers(), Options<128, 2>());
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::process_single_end_data(&reader, ref, {});
+    }
+
+    kaori::CombinatorialBarcodesSingleEnd<128, 2> stuff(constant.c_str(), constant.size(), make_pointers(), Options<128, 2>());
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = 3;
+        popt.block_size = 9;
+        popt.persistent_state = true;
+        kaori::process_single_end_data(&reader, stuff, popt);
+    }
+
+    EXPECT_EQ(flatten_results<2>(stuff.get_combinations()), flatten_results<2>(ref.get_combinations()));
+    EXPECT_EQ(stuff.get_combinations().size(), 16);
+    EXPECT_EQ(stuff.get_total(), 200);
+}
@@ -4,6 +4,7 @@
 #include "byteme/RawBufferReader.hpp"
 #include "../utils.h"
 #include <string>
+#include <sstream>
 
 class DualBarcodesSingleEndWithDiagnosticsTest : public testing::Test {
 protected:
@@ -92,3 +93,46 @@ TEST_F(DualBarcodesSingleEndWithDiagnosticsTest, WithDuplicates) {
     EXPECT_EQ(combos[0].first[1], 1);
     EXPECT_EQ(combos[0].second, 1);
 }
+
+TEST_F(DualBarcodesSingleEndWithDiagnosticsTest, SaveLoad) {
+    std::vector<std::string> seq { 
+        "AAAACCCCCGGCAGCTTGTGTGTTTT", // index 1
+        "AAAAGGGGCGGCAGCTAGAGAGTTTT", // index 2
+        "AAAAGGGGCGGCAGCTTGTGTGTTTT" // invalid: (2, 1)
+    };
+    std::string fq = convert_to_fastq(seq);
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+
+    kaori::DualBarcodesSingleEndWithDiagnostics<32, 2> stuff(
+        constant.c_str(), constant.size(), 
+        { kaori::BarcodePool(variables1), kaori::BarcodePool(variables2) },
+        Options<32>()
+    );
+    kaori::process_single_end_data(&reader, stuff, {});
+
+    std::stringstream buffer;
+    stuff.save(buffer);
+
+    kaori::DualBarcodesSingleEndWithDiagnostics<32, 2> loaded(
+        constant.c_str(), constant.size(), 
+        { kaori::BarcodePool(variables1), kaori::BarcodePool(variables2) },
+        Options<32>()
+    );
+    loaded.load(buffer);
+    EXPECT_EQ(loaded.get_counts(), stuff.get_counts());
+    EXPECT_EQ(loaded.get_total(), 3);
+    EXPECT_EQ(flatten_results<2>(loaded.get_combinations()), flatten_results<2>(stuff.get_combinations()));
+
+    // Truncating the combinatorial results also leaves the dual results untouched.
+    kaori::DualBarcodesSingleEndWithDiagnostics<32, 2> partial(
+        constant.c_str(), constant.size(), 
+        { kaori::BarcodePool(variables1), kaori::BarcodePool(variables2) },
+        Options<32>()
+    );
+    std::string truncated = buffer.str();
+    std::stringstream input(truncated.substr(0, truncated.size() - 1));
+    EXPECT_ANY_THROW(partial.load(input));
+    EXPECT_EQ(partial.get_counts(), std::vector<kaori::Count>(variables1.size()));
+    EXPECT_EQ(partial.get_total(), 0);
+    EXPECT_TRUE(partial.get_combinations().empty());
+}
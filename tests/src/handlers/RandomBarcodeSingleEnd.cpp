@@ -1,9 +1,11 @@
 #include <gtest/gtest.h>
+#include <limits>
 #include "kaori/handlers/RandomBarcodeSingleEnd.hpp"
 #include "kaori/process_data.hpp"
 #include "byteme/RawBufferReader.hpp"
 #include "../utils.h"
 #include <string>
+#include <sstream>
 
 class RandomBarcodeSingleEndTest : public ::testing::Test {
 protected:
@@ -248,3 +250,86 @@ TEST_F(RandomBarcodeSingleEndTest, BadBases) {
         EXPECT_TRUE(failed.find("X") != std::string::npos);
     }
 }
+
+TEST_F(RandomBarcodeSingleEndTest, PersistentState) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT", "ACGT", "TGCA" };
+
+    std::vector<std::string> seq;
+    for (int i = 0; i < 120; ++i) {
+        seq.push_back("cagcatcg" + std::string("ACGT") + variables[i % variables.size()] + "TTTTacgg");
+        seq.push_back("acacacacacacacacacacacacacacaca");
+    }
+    std::string fq = convert_to_fastq(seq);
+
+    kaori::RandomBarcodeSingleEnd<16> ref(thing.c_str(), thing.size(), Options<16>());
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::process_single_end_data(&reader, ref, {});
+    }
+
+    // States are merged in parallel before a single reduction.
+    kaori::RandomBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), Options<16>());
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = 3;
+        popt.block_size = 7;
+        popt.persistent_state = true;
+        kaori::process_single_end_data(&reader, handler, popt);
+    }
+
+    EXPECT_EQ(handler.get_counts(), ref.get_counts());
+    EXPECT_EQ(handler.get_counts().size(), variables.size());
+    EXPECT_EQ(handler.get_counts().at("ACGT"), 20);
+    EXPECT_EQ(handler.get_total(), 240);
+}
+
+TEST_F(RandomBarcodeSingleEndTest, SaveLoad) {
+    std::string thing = "ACGT----TTTT";
+    kaori::RandomBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), Options<16>());
+    auto state = handler.initialize();
+    handler.process(state, bounds(std::string("cagcatcgatcgtgaACGTGGGGTTTTacggaggaga")));
+    handler.process(state, bounds(std::string("ACGTAAAATTTT")));
+    handler.process(state, bounds(std::string("ACGTAAAATTTT")));
+    handler.process(state, bounds(std::string("acacacacacaca")));
+    handler.reduce(state);
+
+    std::stringstream buffer;
+    handler.save(buffer);
+
+    kaori::RandomBarcodeSingleEnd<16> loaded(thing.c_str(), thing.size(), Options<16>());
+    loaded.load(buffer);
+    EXPECT_EQ(loaded.get_counts(), handler.get_counts());
+    EXPECT_EQ(loaded.get_counts().size(), 2);
+    EXPECT_EQ(loaded.get_counts().at("AAAA"), 2);
+    EXPECT_EQ(loaded.get_total(), 4);
+
+    // Truncated input is an error, and the existing results are left untouched.
+    std::string truncated = buffer.str();
+    for (std::size_t len : { static_cast<std::size_t>(5), truncated.size() / 2, truncated.size() - 1 }) {
+        kaori::RandomBarcodeSingleEnd<16> partial(thing.c_str(), thing.size(), Options<16>());
+        std::stringstream input(truncated.substr(0, len));
+        EXPECT_ANY_THROW(partial.load(input));
+        EXPECT_TRUE(partial.get_counts().empty());
+        EXPECT_EQ(partial.get_total(), 0);
+    }
+
+    // Corrupted lengths are caught before any allocation.
+    auto check_corrupted = [&](std::size_t offset) -> void {
+        std::string corrupted = buffer.str();
+        std::size_t huge = std::numeric_limits<std::size_t>::max() / 2;
+        std::copy_n(reinterpret_cast<const char*>(&huge), sizeof(huge), corrupted.begin() + offset);
+        std::stringstream input(corrupted);
+        EXPECT_ANY_THROW({
+            try {
+                loaded.load(input);
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("truncated or corrupted") != std::string::npos);
+                throw;
+            }
+        });
+    };
+    check_corrupted(0); // number of entries in the map.
+    check_corrupted(sizeof(std::size_t)); // length of the first key.
+}
@@ -4,6 +4,9 @@
 #include "byteme/RawBufferReader.hpp"
 #include "../utils.h"
 #include <string>
+#include <sstream>
+#include <set>
+#include <atomic>
 
 class SingleBarcodeSingleEndTest : public ::testing::Test {
 protected:
@@ -211,3 +214,288 @@ TEST_F(SingleBarcodeSingleEndTest, Iupac) {
     EXPECT_EQ(counts[2], 1);
     EXPECT_EQ(counts[3], 2);
 }
+
+TEST_F(SingleBarcodeSingleEndTest, FastPaths) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+
+    std::vector<std::string> seq;
+    for (int i = 0; i < 100; ++i) {
+        std::string prefix = (i % 10 == 0 ? "cc" : "ccacacacaaaaa");
+        seq.push_back(prefix + "ACGT" + variables[i % variables.size()] + "TTTTacggaggaga");
+    }
+    std::string fq = convert_to_fastq(seq);
+
+    for (int mode = 0; mode < 3; ++mode) {
+        kaori::SingleBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), [&]{
+            Options<16> opt;
+            if (mode == 0) {
+                opt.likely_offsets = std::vector<kaori::SeqLength>{ 13 };
+            } else if (mode == 1) {
+                opt.learn_offsets = 10;
+            } else {
+                opt.use_anchors = true;
+                opt.use_first = false;
+            }
+            return opt;
+        }());
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::process_single_end_data(&reader, handler, {});
+
+        const auto& counts = handler.get_counts();
+        EXPECT_EQ(counts, std::vector<kaori::Count>(4, 25));
+        EXPECT_EQ(handler.get_total(), 100);
+    }
+}
+
+TEST_F(SingleBarcodeSingleEndTest, RuntimeSize) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+
+    std::vector<std::string> seq{ 
+        "cagcatcgatcgtgaACGTAAAATTTTacggaggaga", 
+        "ACGTCCCCTTTTaaaaccccggg",
+        "ccacacacaaaaaACGTAATATTTT", // 1 mismatch
+        "cAGGTAATATTTTtttttt", // 2 mismatches
+        "aaaaAAAAGGGGACGTnnnnnnnnnnnnnnnnnn" // reverse complement
+    };
+    std::string fq = convert_to_fastq(seq);
+
+    for (bool use_first : { true, false }) {
+        Options<0> opt;
+        opt.max_mismatches = 2;
+        opt.use_first = use_first;
+        opt.strand = kaori::SearchStrand::BOTH;
+        kaori::SingleBarcodeSingleEnd<0> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), opt);
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::process_single_end_data(&reader, handler, {});
+
+        Options<16> ref_opt;
+        ref_opt.max_mismatches = 2;
+        ref_opt.use_first = use_first;
+        ref_opt.strand = kaori::SearchStrand::BOTH;
+        kaori::SingleBarcodeSingleEnd<16> ref(thing.c_str(), thing.size(), kaori::BarcodePool(variables), ref_opt);
+        byteme::RawBufferReader ref_reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::process_single_end_data(&ref_reader, ref, {});
+
+        EXPECT_EQ(handler.get_counts(), ref.get_counts());
+        EXPECT_EQ(handler.get_counts()[0], 2);
+        EXPECT_EQ(handler.get_counts()[1], 2); // includes the reverse complement.
+        EXPECT_EQ(handler.get_total(), 5);
+    }
+
+    // No limit on the template size.
+    std::string long_thing = std::string(200, 'A') + "----" + std::string(200, 'C');
+    kaori::SingleBarcodeSingleEnd<0> handler(long_thing.c_str(), long_thing.size(), kaori::BarcodePool(variables), Options<0>());
+    std::string long_fq = convert_to_fastq(std::vector<std::string>{ "GG" + std::string(200, 'A') + "GGGG" + std::string(200, 'C') + "TT" });
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(long_fq.c_str()), long_fq.size());
+    kaori::process_single_end_data(&reader, handler, {});
+    EXPECT_EQ(handler.get_counts()[2], 1);
+}
+
+TEST_F(SingleBarcodeSingleEndTest, PersistentState) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+
+    std::vector<std::string> seq;
+    for (int i = 0; i < 100; ++i) {
+        seq.push_back("cagcatcg" + std::string("ACGT") + variables[i % variables.size()] + "TTTTacgg");
+        seq.push_back("acacacacacacacacacacacacacacaca");
+    }
+    std::string fq = convert_to_fastq(seq);
+
+    kaori::SingleBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+    kaori::ProcessSingleEndDataOptions popt;
+    popt.num_threads = 3;
+    popt.block_size = 7;
+    popt.persistent_state = true;
+    kaori::process_single_end_data(&reader, handler, popt);
+
+    const auto& counts = handler.get_counts();
+    EXPECT_EQ(counts[0], 25);
+    EXPECT_EQ(counts[1], 25);
+    EXPECT_EQ(counts[2], 25);
+    EXPECT_EQ(counts[3], 25);
+    EXPECT_EQ(handler.get_total(), 200);
+}
+
+TEST_F(SingleBarcodeSingleEndTest, SparseReduce) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    kaori::SingleBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+
+    auto state = handler.initialize();
+    std::string seq = "cagcatcgatcgtgaACGTGGGGTTTTacggaggaga";
+    handler.process(state, bounds(seq));
+    handler.process(state, bounds(seq));
+    EXPECT_EQ(state.counts[2], 2);
+    EXPECT_EQ(state.counts.num_touched(), 1);
+
+    // Reduction resets the state, so it can be reused without double-counting.
+    handler.reduce(state);
+    EXPECT_EQ(state.counts[2], 0);
+    EXPECT_EQ(state.counts.num_touched(), 0);
+    handler.process(state, bounds(seq));
+    handler.reduce(state);
+
+    std::vector<kaori::Count> expected { 0, 0, 3, 0 };
+    EXPECT_EQ(handler.get_counts(), expected);
+    EXPECT_EQ(handler.get_total(), 3);
+}
+
+// Wrapping the handler to track the allocation of each state's counts.
+struct ReuseTracker {
+    typedef kaori::SingleBarcodeSingleEnd<16> Base;
+
+    ReuseTracker(Base& base) : base(base) {}
+    Base& base;
+    mutable std::atomic<int> initialized = 0;
+    std::set<const kaori::Count*> dense;
+    int reduced = 0;
+
+    Base::State initialize() const {
+        ++initialized;
+        return base.initialize();
+    }
+
+    void process(Base::State& state, const std::pair<const char*, const char*>& x) const {
+        base.process(state, x);
+    }
+
+    void reduce(Base::State& state) {
+        dense.insert(state.counts.data());
+        base.reduce(state);
+        ++reduced;
+    }
+
+    static constexpr bool use_names = false;
+    static constexpr bool commutative = Base::commutative;
+    static constexpr bool reusable_state = Base::reusable_state;
+};
+
+TEST_F(SingleBarcodeSingleEndTest, ReusableState) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+
+    std::vector<std::string> seq;
+    for (int i = 0; i < 100; ++i) {
+        seq.push_back("cagcatcg" + std::string("ACGT") + variables[i % variables.size()] + "TTTTacgg");
+        seq.push_back("acacacacacacacacacacacacacacaca");
+    }
+    std::string fq = convert_to_fastq(seq);
+
+    ReuseTracker::Base handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+    ReuseTracker tracker(handler);
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+    kaori::ProcessSingleEndDataOptions popt;
+    popt.num_threads = 2;
+    popt.queue_size = 3;
+    popt.block_size = 7;
+    kaori::process_single_end_data(&reader, tracker, popt);
+
+    // The state and its dense array are created once per workspace, not once per chunk.
+    EXPECT_EQ(tracker.reduced, (200 + 6) / 7);
+    EXPECT_LE(tracker.initialized, 3);
+    EXPECT_LE(tracker.dense.size(), 3);
+
+    const auto& counts = handler.get_counts();
+    EXPECT_EQ(counts[0], 25);
+    EXPECT_EQ(counts[1], 25);
+    EXPECT_EQ(counts[2], 25);
+    EXPECT_EQ(counts[3], 25);
+    EXPECT_EQ(handler.get_total(), 200);
+}
+
+TEST_F(SingleBarcodeSingleEndTest, Merge) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    kaori::SingleBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+
+    auto state1 = handler.initialize();
+    auto state2 = handler.initialize();
+    std::string seq1 = "cagcatcgatcgtgaACGTGGGGTTTTacggaggaga";
+    std::string seq2 = "ACGTAAAATTTT";
+    handler.process(state1, bounds(seq1));
+    handler.process(state2, bounds(seq1));
+    handler.process(state2, bounds(seq2));
+
+    handler.merge(state1, state2);
+    EXPECT_EQ(state2.counts.num_touched(), 0);
+    EXPECT_EQ(state2.total, 0);
+    EXPECT_EQ(state1.counts[0], 1);
+    EXPECT_EQ(state1.counts[2], 2);
+    EXPECT_EQ(state1.total, 3);
+
+    // Merging into an empty state also works.
+    auto state3 = handler.initialize();
+    handler.merge(state3, state1);
+    handler.reduce(state3);
+    handler.reduce(state1);
+
+    std::vector<kaori::Count> expected { 1, 0, 2, 0 };
+    EXPECT_EQ(handler.get_counts(), expected);
+    EXPECT_EQ(handler.get_total(), 3);
+}
+
+TEST_F(SingleBarcodeSingleEndTest, Checkpoint) {
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+
+    std::vector<std::string> seq;
+    for (int i = 0; i < 100; ++i) {
+        seq.push_back("cagcatcg" + std::string("ACGT") + variables[(i * i) % variables.size()] + "TTTTacgg");
+        seq.push_back("acacacacacacacacacacacacacacaca");
+    }
+    std::string fq = convert_to_fastq(seq);
+
+    kaori::SingleBarcodeSingleEnd<16> ref(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::process_single_end_data(&reader, ref, {});
+    }
+
+    // Saving the results at every checkpoint, and using one from the middle of the run.
+    std::vector<std::string> saved;
+    std::vector<kaori::ProcessDataCheckpoint> checkpoints;
+    {
+        kaori::SingleBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = 3;
+        popt.block_size = 7;
+        popt.persistent_state = true;
+        popt.checkpoint_interval = 0;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            std::stringstream out;
+            handler.save(out);
+            saved.push_back(out.str());
+            checkpoints.push_back(checkpoint);
+            EXPECT_EQ(handler.get_total(), checkpoint.num_reads);
+        };
+        kaori::process_single_end_data(&reader, handler, popt);
+        EXPECT_EQ(handler.get_counts(), ref.get_counts());
+    }
+    ASSERT_GT(saved.size(), 2);
+
+    kaori::SingleBarcodeSingleEnd<16> resumed(thing.c_str(), thing.size(), kaori::BarcodePool(variables), Options<16>());
+    {
+        std::stringstream in(saved[saved.size() / 2]);
+        resumed.load(in);
+        EXPECT_EQ(resumed.get_total(), checkpoints[saved.size() / 2].num_reads);
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fq.c_str()), fq.size());
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = 2;
+        popt.resume = &(checkpoints[saved.size() / 2]);
+        kaori::process_single_end_data(&reader, resumed, popt);
+    }
+    EXPECT_EQ(resumed.get_counts(), ref.get_counts());
+    EXPECT_EQ(resumed.get_total(), ref.get_total());
+
+    // Checking that the number of barcodes is consistent.
+    std::vector<std::string> fewer { "AAAA", "CCCC" };
+    kaori::SingleBarcodeSingleEnd<16> wrong(thing.c_str(), thing.size(), kaori::BarcodePool(fewer), Options<16>());
+    std::stringstream in(saved.front());
+    EXPECT_ANY_THROW(wrong.load(in));
+}
@@ -1,8 +1,17 @@
 #include <gtest/gtest.h>
 #include "kaori/process_data.hpp"
+#include "kaori/MappedFastqReader.hpp"
+#include "kaori/FastaReader.hpp"
+#include "kaori/LineSequenceReader.hpp"
 #include <random>
 #include "byteme/RawBufferReader.hpp"
 #include "utils.h"
+#include <fstream>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 class ProcessDataTester : public testing::TestWithParam<std::tuple<int, int> > {
 protected:
@@ -303,6 +312,827 @@ TEST_P(ProcessDataTester, PairedEndErrors) {
     }
 }
 
+TEST_P(ProcessDataTester, ConcurrentMates) {
+    auto param = GetParam();
+    kaori::ProcessPairedEndDataOptions popt;
+    popt.num_threads = std::get<0>(param);
+    popt.block_size = std::get<1>(param);
+    popt.concurrent_mates = true;
+
+    auto reads1 = simulate_reads(1000, popt.num_threads + popt.block_size);
+    auto reads2 = simulate_reads(1000, (popt.num_threads + popt.block_size) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    {
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+
+        PairedEndCollector<true> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+        EXPECT_EQ(task.first_names().back(), "FOO1000");
+        EXPECT_EQ(task.second_names().back(), "BAR1000");
+    }
+
+    // Still errors out correctly due to the read number.
+    {
+        auto reads3 = reads2;
+        reads3.resize(popt.block_size);
+        auto fastq_str3 = convert_to_fastq(reads3, "BAR");
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader3(reinterpret_cast<const unsigned char*>(fastq_str3.c_str()), fastq_str3.size());
+
+        PairedEndCollector<false> task;
+        EXPECT_ANY_THROW({
+            try {
+                kaori::process_paired_end_data(&reader1, &reader3, task, popt);
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("different number of reads") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+
+    // Parsing errors in the helper thread are propagated.
+    {
+        auto fastq_str3 = fastq_str2 + "FOO";
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader3(reinterpret_cast<const unsigned char*>(fastq_str3.c_str()), fastq_str3.size());
+
+        PairedEndCollector<false> task;
+        EXPECT_ANY_THROW({
+            try {
+                kaori::process_paired_end_data(&reader1, &reader3, task, popt);
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("read name should start") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+}
+
+TEST_P(ProcessDataTester, Interleaved) {
+    auto param = GetParam();
+    kaori::ProcessPairedEndDataOptions popt;
+    popt.num_threads = std::get<0>(param);
+    popt.block_size = std::get<1>(param);
+
+    auto reads1 = simulate_reads(1000, popt.num_threads + popt.block_size);
+    auto reads2 = simulate_reads(1000, (popt.num_threads + popt.block_size) * 2);
+
+    std::string fastq_str;
+    for (size_t i = 0; i < reads1.size(); ++i) {
+        auto name = "READ" + std::to_string(i + 1);
+        fastq_str += "@" + name + "/1\n" + reads1[i] + "\n+\n" + std::string(reads1[i].size(), '!') + "\n";
+        fastq_str += "@" + name + "/2 extra\n" + reads2[i] + "\n+\n" + std::string(reads2[i].size(), '!') + "\n";
+    }
+
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str.c_str()), fastq_str.size());
+        PairedEndCollector<false> task;
+        kaori::process_interleaved_paired_end_data(&reader, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+    }
+
+    {
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str.c_str()), fastq_str.size());
+        PairedEndCollector<true> task;
+        kaori::process_interleaved_paired_end_data(&reader, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+        EXPECT_EQ(task.first_names().front(), "READ1/1");
+        EXPECT_EQ(task.second_names().back(), "READ1000/2");
+    }
+
+    // Errors out with an odd number of records.
+    {
+        auto fastq_str2 = fastq_str + "@READ1001/1\nACGT\n+\n!!!!\n";
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        EXPECT_ANY_THROW({
+            try {
+                kaori::process_interleaved_paired_end_data(&reader, task, popt);
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("odd number") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+
+    // Errors out with mismatched names, but only if names are used.
+    {
+        auto fastq_str2 = fastq_str + "@READ1001/1\nACGT\n+\n!!!!\n@READ1002/2\nACGT\n+\n!!!!\n";
+        {
+            byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+            PairedEndCollector<false> task;
+            kaori::process_interleaved_paired_end_data(&reader, task, popt);
+            EXPECT_EQ(task.first_reads().size(), 1001);
+        }
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<true> task;
+        EXPECT_ANY_THROW({
+            try {
+                kaori::process_interleaved_paired_end_data(&reader, task, popt);
+            } catch (std::exception& e) {
+                EXPECT_TRUE(std::string(e.what()).find("mismatched names") != std::string::npos);
+                EXPECT_TRUE(std::string(e.what()).find("pair 1001") != std::string::npos);
+                throw e;
+            }
+        });
+    }
+}
+
+TEST_P(ProcessDataTester, OtherReaders) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+
+    std::string fasta_str1, fasta_str2, line_str1, line_str2;
+    for (size_t i = 0; i < reads1.size(); ++i) {
+        fasta_str1 += ">FOO" + std::to_string(i + 1) + "\n" + reads1[i] + "\n";
+        fasta_str2 += ">BAR" + std::to_string(i + 1) + "\n" + reads2[i] + "\n";
+        line_str1 += reads1[i] + "\n";
+        line_str2 += reads2[i] + "\n";
+    }
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fasta_str1.c_str()), fasta_str1.size());
+        SingleEndCollector<true> task;
+        kaori::process_single_end_data<kaori::FastaReader>(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_EQ(task.names().back(), "FOO1000");
+
+        byteme::RawBufferReader lreader(reinterpret_cast<const unsigned char*>(line_str1.c_str()), line_str1.size());
+        SingleEndCollector<true> ltask;
+        kaori::process_single_end_data<kaori::LineSequenceReader>(&lreader, ltask, popt);
+        EXPECT_EQ(ltask.reads(), reads1);
+        EXPECT_EQ(ltask.names().back(), "1000");
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fasta_str1.c_str()), fasta_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fasta_str2.c_str()), fasta_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data<kaori::FastaReader>(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+
+        byteme::RawBufferReader lreader1(reinterpret_cast<const unsigned char*>(line_str1.c_str()), line_str1.size());
+        byteme::RawBufferReader lreader2(reinterpret_cast<const unsigned char*>(line_str2.c_str()), line_str2.size());
+        PairedEndCollector<false> ltask;
+        kaori::process_paired_end_data<kaori::LineSequenceReader>(&lreader1, &lreader2, ltask, popt);
+        EXPECT_EQ(ltask.first_reads(), reads1);
+        EXPECT_EQ(ltask.second_reads(), reads2);
+    }
+}
+
+TEST_P(ProcessDataTester, PersistentState) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    // Order of reduction is no longer guaranteed, so we sort everything.
+    auto sorted = [](std::vector<std::string> x) -> std::vector<std::string> {
+        std::sort(x.begin(), x.end());
+        return x;
+    };
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.persistent_state = true;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(sorted(task.reads()), sorted(reads1));
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.persistent_state = true;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(sorted(task.first_reads()), sorted(reads1));
+        EXPECT_EQ(sorted(task.second_reads()), sorted(reads2));
+    }
+
+    // Works with empty inputs where some threads never get a chunk.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.persistent_state = true;
+
+        std::string empty;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(empty.c_str()), empty.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_TRUE(task.reads().empty());
+    }
+}
+
+TEST_P(ProcessDataTester, QueueSize) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    for (size_t queue_size : { 0, 1, 5, 20 }) {
+        {
+            kaori::ProcessSingleEndDataOptions popt;
+            popt.num_threads = std::get<0>(param);
+            popt.block_size = std::get<1>(param);
+            popt.queue_size = queue_size;
+            kaori::ProcessDataStats stats;
+            popt.stats = &stats;
+
+            byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+            SingleEndCollector<true> task;
+            kaori::process_single_end_data(&reader, task, popt);
+            EXPECT_EQ(task.reads(), reads1);
+            EXPECT_EQ(task.names().size(), reads1.size());
+
+            EXPECT_EQ(stats.num_chunks, reads1.size() / popt.block_size + 1); // last chunk is always partial or empty.
+            EXPECT_GE(stats.parse_wait, 0);
+            EXPECT_GE(stats.process_wait, 0);
+            EXPECT_GE(stats.drain_wait, 0);
+        }
+
+        {
+            kaori::ProcessPairedEndDataOptions popt;
+            popt.num_threads = std::get<0>(param);
+            popt.block_size = std::get<1>(param);
+            popt.queue_size = queue_size;
+            kaori::ProcessDataStats stats;
+            popt.stats = &stats;
+
+            byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+            byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+            PairedEndCollector<false> task;
+            kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+            EXPECT_EQ(task.first_reads(), reads1);
+            EXPECT_EQ(task.second_reads(), reads2);
+            EXPECT_EQ(stats.num_chunks, reads1.size() / popt.block_size + 1);
+        }
+    }
+}
+
+TEST_P(ProcessDataTester, Statistics) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        std::vector<kaori::ProcessDataStats> progress;
+        popt.progress = [&](const kaori::ProcessDataStats& current) -> void {
+            progress.push_back(current);
+        };
+        popt.progress_interval = 0;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+
+        EXPECT_EQ(stats.num_reads, reads1.size());
+        EXPECT_EQ(stats.num_bytes, fastq_str1.size());
+        EXPECT_EQ(stats.thread_busy.size(), popt.num_threads);
+        EXPECT_EQ(stats.thread_idle.size(), popt.num_threads);
+        EXPECT_GE(stats.parse_time, 0);
+        EXPECT_GE(stats.reduce_time, 0);
+        EXPECT_GE(stats.elapsed, stats.parse_time);
+
+        // Called after every chunk with a zero interval, plus once more upon completion.
+        ASSERT_EQ(progress.size(), stats.num_chunks + 1);
+        EXPECT_EQ(progress.front().num_chunks, 1);
+        EXPECT_EQ(progress.front().num_reads, std::min(reads1.size(), popt.block_size));
+        EXPECT_EQ(progress.back().num_reads, reads1.size());
+        EXPECT_EQ(progress.back().thread_busy.size(), popt.num_threads);
+        for (size_t i = 1; i < progress.size(); ++i) {
+            EXPECT_GE(progress[i].num_bytes, progress[i - 1].num_bytes);
+        }
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        // With a large interval, we only get the final report.
+        int nprogress = 0;
+        popt.progress = [&](const kaori::ProcessDataStats&) -> void {
+            ++nprogress;
+        };
+        popt.progress_interval = 1000;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+
+        EXPECT_EQ(stats.num_reads, reads1.size());
+        EXPECT_EQ(stats.num_bytes, fastq_str1.size() + fastq_str2.size());
+        EXPECT_EQ(nprogress, 1);
+    }
+}
+
+TEST_P(ProcessDataTester, AdaptiveBlockSize) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.adaptive_block_size = true;
+        popt.min_block_size = 5;
+        popt.max_block_size = 200;
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<true> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_GE(stats.block_size, popt.min_block_size);
+        EXPECT_LE(stats.block_size, popt.max_block_size);
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.adaptive_block_size = true;
+        popt.min_block_size = 5;
+        popt.max_block_size = 200;
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+        EXPECT_GE(stats.block_size, popt.min_block_size);
+        EXPECT_LE(stats.block_size, popt.max_block_size);
+    }
+
+    // Fixed block size is reported as-is.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(stats.block_size, popt.block_size);
+    }
+}
+
+class CancellingCollector : public SingleEndCollector<false> {
+public:
+    CancellingCollector(kaori::CancellationToken& token) : my_token(token) {}
+
+    void process(State& state, const std::pair<const char*, const char*>& x) const {
+        SingleEndCollector<false>::process(state, x);
+        my_token.cancel();
+    }
+
+private:
+    kaori::CancellationToken& my_token;
+};
+
+TEST_P(ProcessDataTester, Limits) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    kaori::ProcessSingleEndDataOptions popt;
+    popt.num_threads = std::get<0>(param);
+    popt.block_size = std::get<1>(param);
+    kaori::ProcessDataStats stats;
+    popt.stats = &stats;
+
+    // Maximum number of reads.
+    {
+        popt.max_reads = 123;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), std::vector<std::string>(reads1.begin(), reads1.begin() + 123));
+        EXPECT_EQ(stats.num_reads, 123);
+        EXPECT_TRUE(stats.stopped);
+        popt.max_reads = std::numeric_limits<unsigned long long>::max();
+    }
+
+    // Limits larger than the input have no effect.
+    {
+        popt.max_reads = 5000;
+        popt.time_limit = 1000;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_EQ(stats.num_reads, reads1.size());
+        EXPECT_FALSE(stats.stopped);
+        popt.max_reads = std::numeric_limits<unsigned long long>::max();
+        popt.time_limit = std::numeric_limits<double>::infinity();
+    }
+
+    // Zero time limit.
+    {
+        popt.time_limit = 0;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_TRUE(task.reads().empty());
+        EXPECT_EQ(stats.num_reads, 0);
+        EXPECT_EQ(stats.num_chunks, 0);
+        EXPECT_TRUE(stats.stopped);
+        popt.time_limit = std::numeric_limits<double>::infinity();
+    }
+
+    // Cancelled before starting.
+    {
+        kaori::CancellationToken token;
+        token.cancel();
+        popt.cancellation = &token;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_TRUE(task.reads().empty());
+        EXPECT_TRUE(stats.stopped);
+    }
+
+    // Cancelled during processing; all chunks that were parsed are still processed and reduced in order.
+    {
+        kaori::CancellationToken token;
+        popt.cancellation = &token;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        CancellingCollector task(token);
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_TRUE(token.cancelled());
+        EXPECT_GT(stats.num_reads, 0);
+        EXPECT_EQ(task.reads(), std::vector<std::string>(reads1.begin(), reads1.begin() + stats.num_reads));
+        popt.cancellation = NULL;
+    }
+
+    // Paired-end data.
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.stats = &stats;
+        popt.max_reads = 77;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), std::vector<std::string>(reads1.begin(), reads1.begin() + 77));
+        EXPECT_EQ(task.second_reads(), std::vector<std::string>(reads2.begin(), reads2.begin() + 77));
+        EXPECT_EQ(stats.num_reads, 77);
+        EXPECT_TRUE(stats.stopped);
+    }
+}
+
+TEST(BlockSizer, Basic) {
+    kaori::BlockSizer fixed(100);
+    EXPECT_FALSE(fixed.adaptive());
+    EXPECT_EQ(fixed.get(), 100);
+
+    // Initial size is clamped to the bounds.
+    kaori::BlockSizer clamped(5, 10, 1000, 4);
+    EXPECT_TRUE(clamped.adaptive());
+    EXPECT_EQ(clamped.get(), 10);
+
+    kaori::BlockSizer sizer(100, 10, 1000, 4);
+
+    // Workers are faster than the parser, so the chunks grow up to the maximum.
+    sizer.update(1, 0.1);
+    EXPECT_EQ(sizer.get(), 200);
+    sizer.update(1, 0.1);
+    sizer.update(1, 0.1);
+    EXPECT_EQ(sizer.get(), 800);
+    sizer.update(1, 0.1);
+    EXPECT_EQ(sizer.get(), 1000);
+
+    // Balanced, so nothing changes.
+    sizer.update(1, 3);
+    EXPECT_EQ(sizer.get(), 1000);
+
+    // Workers are slower than the parser, so the chunks shrink down to the minimum.
+    for (int i = 0; i < 10; ++i) {
+        sizer.update(1, 10);
+    }
+    EXPECT_EQ(sizer.get(), 10);
+
+    // Chunks that are too quick to process are not shrunk further, even if the parser is faster.
+    kaori::BlockSizer quick(100, 10, 1000, 1);
+    quick.update(0.001, 0.005);
+    EXPECT_EQ(quick.get(), 100);
+
+    // Zero parse times are ignored.
+    quick.update(0, 1);
+    EXPECT_EQ(quick.get(), 100);
+}
+
+template<class Collector_>
+class CommutativeCollector : public Collector_ {
+public:
+    static constexpr bool commutative = true;
+};
+
+TEST_P(ProcessDataTester, Unordered) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    EXPECT_FALSE(kaori::handler_is_commutative<SingleEndCollector<false> >::value);
+    EXPECT_TRUE(kaori::handler_is_commutative<CommutativeCollector<SingleEndCollector<false> > >::value);
+
+    // Order of reduction is no longer guaranteed, so we sort everything.
+    auto sorted = [](std::vector<std::string> x) -> std::vector<std::string> {
+        std::sort(x.begin(), x.end());
+        return x;
+    };
+
+    for (int persistent = 0; persistent < 2; ++persistent) {
+        {
+            kaori::ProcessSingleEndDataOptions popt;
+            popt.num_threads = std::get<0>(param);
+            popt.block_size = std::get<1>(param);
+            popt.persistent_state = persistent;
+
+            byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+            CommutativeCollector<SingleEndCollector<false> > task;
+            kaori::process_single_end_data(&reader, task, popt);
+            EXPECT_EQ(sorted(task.reads()), sorted(reads1));
+        }
+
+        {
+            kaori::ProcessPairedEndDataOptions popt;
+            popt.num_threads = std::get<0>(param);
+            popt.block_size = std::get<1>(param);
+            popt.persistent_state = persistent;
+
+            byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+            byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+            CommutativeCollector<PairedEndCollector<false> > task;
+            kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+            EXPECT_EQ(sorted(task.first_reads()), sorted(reads1));
+            EXPECT_EQ(sorted(task.second_reads()), sorted(reads2));
+        }
+    }
+
+    // Errors are still propagated.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        CommutativeCollector<SingleEndCollector<false, true> > task;
+        EXPECT_ANY_THROW({
+            try {
+                kaori::process_single_end_data(&reader, task, popt);
+            } catch (std::exception& e) {
+                EXPECT_EQ(std::string(e.what()), "I want a burger");
+                throw;
+            }
+        });
+    }
+}
+
+class MergingCollector : public SingleEndCollector<false> {
+public:
+    void merge(State& dest, State& src) const {
+        dest.reads.insert(dest.reads.end(), src.reads.begin(), src.reads.end());
+        src.reads.clear();
+    }
+
+    void reduce(State& x) {
+        ++num_reduced;
+        SingleEndCollector<false>::reduce(x);
+    }
+
+    int num_reduced = 0;
+};
+
+TEST_P(ProcessDataTester, TreeMerge) {
+    auto param = GetParam();
+    auto reads = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto fastq_str = convert_to_fastq(reads);
+
+    EXPECT_FALSE(kaori::handler_has_merge<SingleEndCollector<false> >::value);
+    EXPECT_TRUE(kaori::handler_has_merge<MergingCollector>::value);
+
+    auto sorted = [](std::vector<std::string> x) -> std::vector<std::string> {
+        std::sort(x.begin(), x.end());
+        return x;
+    };
+
+    for (size_t queue_size : { 0, 1, 7 }) {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.persistent_state = true;
+        popt.queue_size = queue_size;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str.c_str()), fastq_str.size());
+        MergingCollector task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(sorted(task.reads()), sorted(reads));
+        EXPECT_EQ(task.num_reduced, 1);
+    }
+
+    // Merges are not used if the states are not persistent.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str.c_str()), fastq_str.size());
+        MergingCollector task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads);
+        EXPECT_EQ(task.num_reduced, reads.size() / popt.block_size + 1);
+    }
+}
+
+// Runs each task on its own thread, to mimic an external scheduler.
+class SpawningExecutor final : public kaori::Executor {
+public:
+    void submit(std::function<void()> task) {
+        ++num_submitted;
+        threads.emplace_back(std::move(task));
+    }
+
+    void wait() {
+        for (auto& t : threads) {
+            t.join();
+        }
+        threads.clear();
+    }
+
+    ~SpawningExecutor() {
+        wait();
+    }
+
+    std::vector<std::thread> threads;
+    std::size_t num_submitted = 0;
+};
+
+TEST_P(ProcessDataTester, CustomExecutor) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        SpawningExecutor ex;
+        popt.executor = &ex;
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<true> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_EQ(ex.num_submitted, stats.num_chunks + 2 * popt.num_threads); // plus one task per workspace for its allocation.
+        EXPECT_EQ(stats.process_wait, 0);
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        SpawningExecutor ex;
+        popt.executor = &ex;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+        EXPECT_GT(ex.num_submitted, 0);
+    }
+
+    // Also used for tree merges.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.persistent_state = true;
+        SpawningExecutor ex;
+        popt.executor = &ex;
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        MergingCollector task;
+        kaori::process_single_end_data(&reader, task, popt);
+        auto sorted = task.reads();
+        std::sort(sorted.begin(), sorted.end());
+        auto expected = reads1;
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(sorted, expected);
+        EXPECT_EQ(task.num_reduced, 1);
+        EXPECT_GE(ex.num_submitted, stats.num_chunks);
+    }
+
+    // Errors are still propagated.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        SpawningExecutor ex;
+        popt.executor = &ex;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false, true> task;
+        EXPECT_ANY_THROW(kaori::process_single_end_data(&reader, task, popt));
+    }
+}
+
+TEST_P(ProcessDataTester, CpuAffinity) {
+    auto param = GetParam();
+    auto reads = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto fastq_str = convert_to_fastq(reads);
+
+    // Pinning all threads to the first available CPU, which should always succeed.
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(cpu_set_t), &allowed), 0);
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &allowed)) {
+            cpus.push_back(c);
+            break;
+        }
+    }
+#endif
+
+    kaori::ProcessSingleEndDataOptions popt;
+    popt.num_threads = std::get<0>(param);
+    popt.block_size = std::get<1>(param);
+    popt.cpu_affinity = cpus;
+
+    byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str.c_str()), fastq_str.size());
+    SingleEndCollector<false> task;
+    kaori::process_single_end_data(&reader, task, popt);
+    EXPECT_EQ(task.reads(), reads);
+}
+
 TEST_P(ProcessDataTester, EmptyOrShort) {
     auto param = GetParam();
     kaori::ProcessSingleEndDataOptions popt;
@@ -331,6 +1161,351 @@ TEST_P(ProcessDataTester, EmptyOrShort) {
     }
 }
 
+TEST_P(ProcessDataTester, Prefetch) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.buffer_size = 100;
+        popt.prefetch_blocks = 3;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<true> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_EQ(task.names().back(), "FOO1000");
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.buffer_size = 100;
+        popt.prefetch_blocks = 2;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+    }
+}
+
+TEST_P(ProcessDataTester, Mapped) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    std::string path1 = "TEST_process_data1.fastq", path2 = "TEST_process_data2.fastq";
+    {
+        std::ofstream out1(path1, std::ios::binary);
+        out1 << convert_to_fastq(reads1, "FOO");
+        std::ofstream out2(path2, std::ios::binary);
+        out2 << convert_to_fastq(reads2, "BAR");
+    }
+
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+
+        kaori::MappedFastqReader reader(path1.c_str());
+        SingleEndCollector<true> task;
+        kaori::process_single_end_data(reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_EQ(task.names().size(), reads1.size());
+        EXPECT_EQ(task.names().back(), "FOO1000");
+    }
+
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+
+        kaori::MappedFastqReader reader1(path1.c_str()), reader2(path2.c_str());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(reader1, reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), reads1);
+        EXPECT_EQ(task.second_reads(), reads2);
+    }
+}
+
+TEST_P(ProcessDataTester, Checkpoint) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    // Checkpoints occur after each chunk, where all previous chunks have been reduced.
+    std::vector<unsigned long long> positions;
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.checkpoint_interval = 0;
+
+        SingleEndCollector<false> task;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            EXPECT_EQ(task.reads().size(), checkpoint.num_reads);
+            EXPECT_GT(checkpoint.num_bytes, 0);
+            positions.push_back(checkpoint.num_reads);
+        };
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), reads1);
+        EXPECT_EQ(positions.size(), reads1.size() / popt.block_size); // no checkpoint after the last chunk, i.e., the one that hits the end of the input.
+    }
+
+    // Resuming from the checkpoints.
+    for (auto pos : positions) {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.skip_reads = pos;
+        kaori::ProcessDataStats stats;
+        popt.stats = &stats;
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        EXPECT_EQ(task.reads(), std::vector<std::string>(reads1.begin() + pos, reads1.end()));
+        EXPECT_EQ(stats.num_reads, reads1.size() - pos);
+    }
+
+    // A final checkpoint is reported when stopping early.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.skip_reads = 10;
+        popt.max_reads = 150;
+
+        std::vector<unsigned long long> last;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            last.push_back(checkpoint.num_reads);
+        };
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        CommutativeCollector<SingleEndCollector<false> > task;
+        kaori::process_single_end_data(&reader, task, popt);
+        ASSERT_EQ(last.size(), 1);
+        EXPECT_EQ(last.front(), 160);
+    }
+
+    // Skipping too many reads is an error.
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.skip_reads = 1001;
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        EXPECT_ANY_THROW(kaori::process_single_end_data(&reader, task, popt));
+    }
+
+    // Paired-end data, with both separate and interleaved files.
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.skip_reads = 123;
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(task.first_reads(), std::vector<std::string>(reads1.begin() + 123, reads1.end()));
+        EXPECT_EQ(task.second_reads(), std::vector<std::string>(reads2.begin() + 123, reads2.end()));
+    }
+}
+
+// Seekable version of byteme::RawBufferReader, to check that checkpoints are resumed without re-parsing.
+class SeekableBufferReader final : public byteme::Reader {
+public:
+    SeekableBufferReader(const std::string& contents) : contents(contents) {}
+
+    std::size_t read(unsigned char* buffer, std::size_t n) {
+        std::size_t k = std::min(n, contents.size() - position);
+        std::copy_n(contents.data() + position, k, buffer);
+        position += k;
+        return k;
+    }
+
+    void seek(unsigned long long offset) {
+        position = offset;
+        ++num_seeks;
+    }
+
+    const std::string& contents;
+    std::size_t position = 0;
+    int num_seeks = 0;
+};
+
+TEST_P(ProcessDataTester, CheckpointOffsets) {
+    auto param = GetParam();
+    auto reads1 = simulate_reads(1000, std::get<0>(param) + std::get<1>(param));
+    auto reads2 = simulate_reads(1000, (std::get<0>(param) + std::get<1>(param)) * 2);
+    auto fastq_str1 = convert_to_fastq(reads1, "FOO");
+    auto fastq_str2 = convert_to_fastq(reads2, "BAR");
+
+    // Offsets refer to the start of the next unprocessed record.
+    auto offset_of = [](const std::vector<std::string>& reads, const std::string& prefix, unsigned long long num_reads) -> unsigned long long {
+        return convert_to_fastq(std::vector<std::string>(reads.begin(), reads.begin() + num_reads), prefix).size();
+    };
+
+    std::vector<kaori::ProcessDataCheckpoint> checkpoints;
+    {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.checkpoint_interval = 0;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            ASSERT_EQ(checkpoint.offsets.size(), 1);
+            EXPECT_EQ(checkpoint.offsets[0], offset_of(reads1, "FOO", checkpoint.num_reads));
+            checkpoints.push_back(checkpoint);
+        };
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(&reader, task, popt);
+        ASSERT_GT(checkpoints.size(), 1);
+    }
+
+    for (const auto& resume : checkpoints) {
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.resume = &resume;
+
+        // Subsequent checkpoints are still reported relative to the start of the input.
+        popt.checkpoint_interval = 0;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            EXPECT_GT(checkpoint.num_reads, resume.num_reads);
+            ASSERT_EQ(checkpoint.offsets.size(), 1);
+            EXPECT_EQ(checkpoint.offsets[0], offset_of(reads1, "FOO", checkpoint.num_reads));
+        };
+
+        std::vector<std::string> expected(reads1.begin() + resume.num_reads, reads1.end());
+        {
+            SeekableBufferReader reader(fastq_str1);
+            SingleEndCollector<false> task;
+            kaori::process_single_end_data(&reader, task, popt);
+            EXPECT_EQ(reader.num_seeks, 1);
+            EXPECT_EQ(task.reads(), expected);
+        }
+
+        // Falling back to skipping reads if the source can't seek.
+        {
+            byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+            SingleEndCollector<false> task;
+            kaori::process_single_end_data(&reader, task, popt);
+            EXPECT_EQ(task.reads(), expected);
+        }
+    }
+
+    // Same for memory-mapped files.
+    {
+        std::string path = "TEST_process_data_checkpoint.fastq";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << fastq_str1;
+        }
+
+        const auto& resume = checkpoints[checkpoints.size() / 2];
+        kaori::ProcessSingleEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.resume = &resume;
+
+        kaori::MappedFastqReader reader(path.c_str());
+        SingleEndCollector<false> task;
+        kaori::process_single_end_data(reader, task, popt);
+        EXPECT_EQ(task.reads(), std::vector<std::string>(reads1.begin() + resume.num_reads, reads1.end()));
+    }
+
+    // Paired-end data reports a separate offset for each file.
+    {
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.max_reads = 500;
+
+        kaori::ProcessDataCheckpoint last;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            last = checkpoint;
+        };
+
+        byteme::RawBufferReader reader1(reinterpret_cast<const unsigned char*>(fastq_str1.c_str()), fastq_str1.size());
+        byteme::RawBufferReader reader2(reinterpret_cast<const unsigned char*>(fastq_str2.c_str()), fastq_str2.size());
+        PairedEndCollector<false> task;
+        kaori::process_paired_end_data(&reader1, &reader2, task, popt);
+        EXPECT_EQ(last.num_reads, 500);
+        ASSERT_EQ(last.offsets.size(), 2);
+        EXPECT_EQ(last.offsets[0], offset_of(reads1, "FOO", 500));
+        EXPECT_EQ(last.offsets[1], offset_of(reads2, "BAR", 500));
+
+        popt.max_reads = std::numeric_limits<unsigned long long>::max();
+        popt.checkpoint = nullptr;
+        popt.resume = &last;
+        SeekableBufferReader sreader1(fastq_str1), sreader2(fastq_str2);
+        PairedEndCollector<false> resumed;
+        kaori::process_paired_end_data(&sreader1, &sreader2, resumed, popt);
+        EXPECT_EQ(sreader1.num_seeks, 1);
+        EXPECT_EQ(sreader2.num_seeks, 1);
+        EXPECT_EQ(resumed.first_reads(), std::vector<std::string>(reads1.begin() + 500, reads1.end()));
+        EXPECT_EQ(resumed.second_reads(), std::vector<std::string>(reads2.begin() + 500, reads2.end()));
+
+        // Single-end checkpoints can't be used for paired-end data on seekable sources.
+        popt.resume = &(checkpoints.front());
+        SeekableBufferReader wrong1(fastq_str1), wrong2(fastq_str2);
+        PairedEndCollector<false> failed;
+        EXPECT_ANY_THROW(kaori::process_paired_end_data(&wrong1, &wrong2, failed, popt));
+    }
+
+    // Interleaved data reports a single offset.
+    {
+        std::vector<std::string> interleaved;
+        for (std::size_t r = 0; r < reads1.size(); ++r) {
+            interleaved.push_back(reads1[r]);
+            interleaved.push_back(reads2[r]);
+        }
+        auto fastq_interleaved = convert_to_fastq(interleaved);
+
+        kaori::ProcessPairedEndDataOptions popt;
+        popt.num_threads = std::get<0>(param);
+        popt.block_size = std::get<1>(param);
+        popt.max_reads = 300;
+
+        kaori::ProcessDataCheckpoint last;
+        popt.checkpoint = [&](const kaori::ProcessDataCheckpoint& checkpoint) -> void {
+            last = checkpoint;
+        };
+
+        byteme::RawBufferReader reader(reinterpret_cast<const unsigned char*>(fastq_interleaved.c_str()), fastq_interleaved.size());
+        PairedEndCollector<false> task;
+        kaori::process_interleaved_paired_end_data(&reader, task, popt);
+        EXPECT_EQ(last.num_reads, 300);
+        ASSERT_EQ(last.offsets.size(), 1);
+        EXPECT_EQ(last.offsets[0], offset_of(interleaved, "READ", 600));
+
+        popt.max_reads = std::numeric_limits<unsigned long long>::max();
+        popt.checkpoint = nullptr;
+        popt.resume = &last;
+        SeekableBufferReader sreader(fastq_interleaved);
+        PairedEndCollector<false> resumed;
+        kaori::process_interleaved_paired_end_data(&sreader, resumed, popt);
+        EXPECT_EQ(sreader.num_seeks, 1);
+        EXPECT_EQ(resumed.first_reads(), std::vector<std::string>(reads1.begin() + 300, reads1.end()));
+        EXPECT_EQ(resumed.second_reads(), std::vector<std::string>(reads2.begin() + 300, reads2.end()));
+    }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     ProcessData,
     ProcessDataTester, 
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include "kaori/process_file.hpp"
+#include <random>
+#include <fstream>
+
+template<bool unames_>
+class RangeCollector {
+public:
+    struct State {
+        std::vector<std::string> reads, names;
+    };
+
+    void process(State& state, const std::pair<const char*, const char*>& x) const {
+        state.reads.emplace_back(x.first, x.second);
+    }
+
+    void process(State& state, const std::pair<const char*, const char*>& x, const std::pair<const char*, const char*>& y) const {
+        state.names.emplace_back(x.first, x.second);
+        state.reads.emplace_back(y.first, y.second);
+    };
+
+    State initialize() const {
+        return State();
+    }
+
+    void reduce(State& x) {
+        my_collected_reads.insert(my_collected_reads.end(), x.reads.begin(), x.reads.end());
+        my_collected_names.insert(my_collected_names.end(), x.names.begin(), x.names.end());
+    }
+
+    static constexpr bool use_names = unames_;
+
+private:
+    std::vector<std::string> my_collected_reads, my_collected_names;
+
+public:
+    const auto& reads() const {
+        return my_collected_reads;
+    }
+
+    const auto& names() const {
+        return my_collected_names;
+    }
+};
+
+class ProcessFileTester : public testing::TestWithParam<std::tuple<int, bool> > {
+protected:
+    // Creating a nasty FASTQ file with multi-line records and quality strings that start with '@' or '+'.
+    static std::string simulate_fastq(int n, int seed, bool multiline, std::vector<std::string>& reads) {
+        std::mt19937_64 rng(seed);
+        std::string output;
+        const char* bases = "ACGT";
+        const char* quals = "@+!#";
+
+        for (int i = 0; i < n; ++i) {
+            std::string current;
+            size_t len = rng() % 20 + 10;
+            for (size_t j = 0; j < len; ++j) {
+                current += bases[rng() % 4];
+            }
+            reads.push_back(current);
+
+            output += "@READ" + std::to_string(i + 1) + " extra\n";
+            std::string qual;
+            for (size_t j = 0; j < len; ++j) {
+                qual += quals[rng() % 4];
+            }
+
+            if (multiline) {
+                size_t split = rng() % len;
+                output += current.substr(0, split) + "\n" + current.substr(split) + "\n+\n";
+                output += qual.substr(0, split) + "\n" + qual.substr(split) + "\n";
+            } else {
+                output += current + "\n+\n" + qual + "\n";
+            }
+        }
+
+        return output;
+    }
+};
+
+TEST_P(ProcessFileTester, Basic) {
+    auto param = GetParam();
+    kaori::ProcessSingleEndFileOptions opt;
+    opt.num_threads = std::get<0>(param);
+    bool multiline = std::get<1>(param);
+
+    std::vector<std::string> reads;
+    auto contents = simulate_fastq(1000, opt.num_threads * 10 + multiline, multiline, reads);
+    std::string path = "TEST_process_file.fastq";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+    }
+
+    {
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt);
+        EXPECT_EQ(task.reads(), reads);
+    }
+
+    {
+        RangeCollector<true> task;
+        kaori::process_single_end_file(path.c_str(), task, opt);
+        EXPECT_EQ(task.reads(), reads);
+
+        const auto& names = task.names();
+        ASSERT_EQ(names.size(), reads.size());
+        for (size_t i = 0; i < names.size(); ++i) {
+            EXPECT_EQ(names[i], "READ" + std::to_string(i + 1));
+        }
+    }
+
+    // Forcing a single-record lookahead to increase the chance of false starts.
+    {
+        auto opt2 = opt;
+        opt2.lookahead = 1;
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt2);
+        EXPECT_EQ(task.reads(), reads);
+    }
+}
+
+TEST_P(ProcessFileTester, Small) {
+    auto param = GetParam();
+    kaori::ProcessSingleEndFileOptions opt;
+    opt.num_threads = std::get<0>(param);
+    std::string path = "TEST_process_file.fastq";
+
+    // Empty file.
+    {
+        {
+            std::ofstream out(path, std::ios::binary);
+        }
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt);
+        EXPECT_TRUE(task.reads().empty());
+    }
+
+    // Fewer records than threads.
+    {
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "@A\nACGT\n+\n@@@@\n@B\nTTTT\n+\n++++";
+        }
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt);
+        std::vector<std::string> expected{ "ACGT", "TTTT" };
+        EXPECT_EQ(task.reads(), expected);
+    }
+}
+
+TEST_P(ProcessFileTester, Errors) {
+    auto param = GetParam();
+    kaori::ProcessSingleEndFileOptions opt;
+    opt.num_threads = std::get<0>(param);
+
+    std::vector<std::string> reads;
+    auto contents = simulate_fastq(100, 42, false, reads);
+    contents += "@FOO\nACGT\n+\n!!\n";
+    std::string path = "TEST_process_file.fastq";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+    }
+
+    RangeCollector<false> task;
+    EXPECT_ANY_THROW({
+        try {
+            kaori::process_single_end_file(path.c_str(), task, opt);
+        } catch (std::exception& e) {
+            EXPECT_TRUE(std::string(e.what()).find("non-equal lengths") != std::string::npos);
+            throw e;
+        }
+    });
+
+    EXPECT_ANY_THROW(kaori::process_single_end_file("TEST_missing_file.fastq", task, opt));
+}
+
+TEST_P(ProcessFileTester, Options) {
+    auto param = GetParam();
+    kaori::ProcessSingleEndFileOptions opt;
+    opt.num_threads = std::get<0>(param);
+    bool multiline = std::get<1>(param);
+
+    std::vector<std::string> reads;
+    auto contents = simulate_fastq(500, opt.num_threads * 100 + multiline, multiline, reads);
+    std::string path = "TEST_process_file.fastq";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+    }
+
+    // Using a custom executor with statistics.
+    {
+        kaori::DefaultExecutor exec(2);
+        auto opt2 = opt;
+        opt2.executor = &exec;
+        kaori::ProcessDataStats stats;
+        opt2.stats = &stats;
+
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt2);
+        EXPECT_EQ(task.reads(), reads);
+        EXPECT_EQ(stats.num_reads, reads.size());
+        EXPECT_EQ(stats.num_bytes, contents.size());
+        EXPECT_EQ(stats.num_chunks, static_cast<std::size_t>(opt.num_threads));
+        EXPECT_FALSE(stats.stopped);
+        EXPECT_TRUE(stats.thread_busy.empty());
+    }
+
+    {
+        kaori::ProcessDataStats stats;
+        auto opt2 = opt;
+        opt2.stats = &stats;
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt2);
+        EXPECT_EQ(stats.num_reads, reads.size());
+        EXPECT_EQ(stats.thread_busy.size(), static_cast<std::size_t>(opt.num_threads));
+    }
+
+    // Cancelling before the start, so nothing should be processed.
+    {
+        kaori::CancellationToken token;
+        token.cancel();
+        auto opt2 = opt;
+        opt2.cancellation = &token;
+        kaori::ProcessDataStats stats;
+        opt2.stats = &stats;
+
+        RangeCollector<false> task;
+        kaori::process_single_end_file(path.c_str(), task, opt2);
+        EXPECT_TRUE(task.reads().empty());
+        EXPECT_EQ(stats.num_reads, 0);
+        EXPECT_TRUE(stats.stopped);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ProcessFile,
+    ProcessFileTester,
+    ::testing::Combine(
+        ::testing::Values(1, 2, 3, 7), // number of threads
+        ::testing::Values(false, true) // multi-line records
+    )
+);
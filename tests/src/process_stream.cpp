@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+#include "kaori/process_stream.hpp"
+#include "kaori/handlers/SingleBarcodeSingleEnd.hpp"
+#include "utils.h"
+
+#include <random>
+#include <string>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+
+class ProcessStreamTester : public testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    static std::vector<std::string> simulate_reads(int n, int seed) {
+        std::mt19937_64 rng(seed);
+        std::vector<std::string> output;
+        output.reserve(n);
+        const char* bases = "ACGT";
+        for (int i = 0; i < n; ++i) {
+            std::string current;
+            size_t len = rng() % 20 + 10;
+            for (size_t j = 0; j < len; ++j) {
+                current += bases[rng() % 4];
+            }
+            output.push_back(current);
+        }
+        return output;
+    }
+
+    static std::vector<std::pair<const char*, const char*> > spans(const std::vector<std::string>& x, size_t start, size_t end) {
+        std::vector<std::pair<const char*, const char*> > output;
+        for (size_t i = start; i < end; ++i) {
+            output.push_back(bounds(x[i]));
+        }
+        return output;
+    }
+};
+
+template<bool unames_>
+class StreamCollector {
+public:
+    struct State {
+        std::vector<std::string> reads1, reads2, names;
+    };
+
+    State initialize() const {
+        return State();
+    }
+
+    void process(State& state, const std::pair<const char*, const char*>& x) const {
+        state.reads1.emplace_back(x.first, x.second);
+    }
+
+    // Either single-end with names, or paired-end without names.
+    void process(State& state, const std::pair<const char*, const char*>& x, const std::pair<const char*, const char*>& y) const {
+        if constexpr(use_names) {
+            state.names.emplace_back(x.first, x.second);
+            state.reads1.emplace_back(y.first, y.second);
+        } else {
+            state.reads1.emplace_back(x.first, x.second);
+            state.reads2.emplace_back(y.first, y.second);
+        }
+    }
+
+    void reduce(State& s) {
+        reads1.insert(reads1.end(), s.reads1.begin(), s.reads1.end());
+        reads2.insert(reads2.end(), s.reads2.begin(), s.reads2.end());
+        names.insert(names.end(), s.names.begin(), s.names.end());
+    }
+
+    static constexpr bool use_names = unames_;
+
+    std::vector<std::string> reads1, reads2, names;
+};
+
+TEST_P(ProcessStreamTester, SingleEnd) {
+    auto param = GetParam();
+    kaori::ProcessStreamOptions opt;
+    opt.num_threads = std::get<0>(param);
+    size_t batch_size = std::get<1>(param);
+
+    auto reads = simulate_reads(500, opt.num_threads + batch_size);
+
+    {
+        StreamCollector<false> handler;
+        kaori::SingleEndStreamProcessor<StreamCollector<false> > stream(handler, opt);
+        for (size_t start = 0; start < reads.size(); start += batch_size) {
+            auto batch = spans(reads, start, std::min(reads.size(), start + batch_size));
+            stream.submit(batch);
+        }
+        stream.submit({}); // empty batches are ignored.
+        stream.finish();
+        stream.finish(); // no-op.
+
+        EXPECT_EQ(handler.reads1, reads);
+        EXPECT_EQ(stream.stats().num_chunks, (reads.size() + batch_size - 1) / batch_size);
+        EXPECT_EQ(stream.stats().num_reads, reads.size());
+        size_t total = 0;
+        for (const auto& r : reads) {
+            total += r.size();
+        }
+        EXPECT_EQ(stream.stats().num_bytes, total);
+        EXPECT_ANY_THROW(stream.submit(spans(reads, 0, 1)));
+    }
+
+    // Same for names.
+    {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < reads.size(); ++i) {
+            names.push_back("READ" + std::to_string(i));
+        }
+
+        StreamCollector<true> handler;
+        kaori::SingleEndStreamProcessor<StreamCollector<true> > stream(handler, opt);
+        for (size_t start = 0; start < reads.size(); start += batch_size) {
+            auto end = std::min(reads.size(), start + batch_size);
+            stream.submit(spans(names, start, end), spans(reads, start, end));
+        }
+        stream.finish();
+
+        EXPECT_EQ(handler.reads1, reads);
+        EXPECT_EQ(handler.names, names);
+        EXPECT_ANY_THROW(stream.submit(spans(names, 0, 2), spans(reads, 0, 1)));
+    }
+}
+
+TEST_P(ProcessStreamTester, PairedEnd) {
+    auto param = GetParam();
+    kaori::ProcessStreamOptions opt;
+    opt.num_threads = std::get<0>(param);
+    size_t batch_size = std::get<1>(param);
+
+    auto reads1 = simulate_reads(500, opt.num_threads + batch_size);
+    auto reads2 = simulate_reads(500, (opt.num_threads + batch_size) * 2);
+
+    StreamCollector<false> handler;
+    kaori::PairedEndStreamProcessor<StreamCollector<false> > stream(handler, opt);
+    for (size_t start = 0; start < reads1.size(); start += batch_size) {
+        auto end = std::min(reads1.size(), start + batch_size);
+        stream.submit(spans(reads1, start, end), spans(reads2, start, end));
+    }
+    EXPECT_ANY_THROW(stream.submit(spans(reads1, 0, 2), spans(reads2, 0, 1)));
+    stream.finish();
+
+    EXPECT_EQ(handler.reads1, reads1);
+    EXPECT_EQ(handler.reads2, reads2);
+}
+
+TEST_P(ProcessStreamTester, Handler) {
+    auto param = GetParam();
+    kaori::ProcessStreamOptions opt;
+    opt.num_threads = std::get<0>(param);
+    size_t batch_size = std::get<1>(param);
+
+    std::string thing = "ACGT----TTTT";
+    std::vector<std::string> variables { "AAAA", "CCCC", "GGGG", "TTTT" };
+    std::vector<std::string> seq;
+    for (int i = 0; i < 100; ++i) {
+        seq.push_back("cagcatcg" + std::string("ACGT") + variables[i % variables.size()] + "TTTTacgg");
+        seq.push_back("acacacacacacacacacacacacacacaca");
+    }
+
+    for (int persistent = 0; persistent < 2; ++persistent) {
+        opt.persistent_state = persistent;
+        kaori::SingleBarcodeSingleEnd<16> handler(thing.c_str(), thing.size(), kaori::BarcodePool(variables), {});
+        kaori::SingleEndStreamProcessor<kaori::SingleBarcodeSingleEnd<16> > stream(handler, opt);
+        for (size_t start = 0; start < seq.size(); start += batch_size) {
+            stream.submit(spans(seq, start, std::min(seq.size(), start + batch_size)));
+        }
+        stream.finish();
+
+        std::vector<kaori::Count> expected(4, 25);
+        EXPECT_EQ(handler.get_counts(), expected);
+        EXPECT_EQ(handler.get_total(), 200);
+    }
+}
+
+class ThreadTrackingCollector : public StreamCollector<false> {
+public:
+    void reduce(State& s) {
+        StreamCollector<false>::reduce(s);
+        threads.push_back(std::this_thread::get_id());
+        if (throw_on_reduce) {
+            throw std::runtime_error("failed reduction");
+        }
+    }
+
+    std::vector<std::thread::id> threads;
+    bool throw_on_reduce = false;
+};
+
+TEST_P(ProcessStreamTester, BackgroundReduce) {
+    auto param = GetParam();
+    kaori::ProcessStreamOptions opt;
+    opt.num_threads = std::get<0>(param);
+    size_t batch_size = std::get<1>(param);
+    auto reads = simulate_reads(500, opt.num_threads * 3 + batch_size);
+
+    // Reductions are performed on the workers but still in order of submission.
+    {
+        ThreadTrackingCollector handler;
+        kaori::SingleEndStreamProcessor<ThreadTrackingCollector> stream(handler, opt);
+        for (size_t start = 0; start < reads.size(); start += batch_size) {
+            stream.submit(spans(reads, start, std::min(reads.size(), start + batch_size)));
+        }
+        stream.finish();
+
+        EXPECT_EQ(handler.reads1, reads);
+        EXPECT_EQ(handler.threads.size(), (reads.size() + batch_size - 1) / batch_size);
+        for (auto id : handler.threads) {
+            EXPECT_NE(id, std::this_thread::get_id());
+        }
+    }
+
+    // Errors in the reduction are propagated to the caller.
+    {
+        ThreadTrackingCollector handler;
+        handler.throw_on_reduce = true;
+        kaori::SingleEndStreamProcessor<ThreadTrackingCollector> stream(handler, opt);
+        EXPECT_ANY_THROW({
+            try {
+                for (size_t start = 0; start < reads.size(); start += batch_size) {
+                    stream.submit(spans(reads, start, std::min(reads.size(), start + batch_size)));
+                }
+                stream.finish();
+            } catch (std::exception& e) {
+                EXPECT_EQ(std::string(e.what()), "failed reduction");
+                throw;
+            }
+        });
+        EXPECT_EQ(handler.threads.size(), 1);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ProcessStream,
+    ProcessStreamTester,
+    ::testing::Combine(
+        ::testing::Values(1, 2, 3), // number of threads
+        ::testing::Values(7, 50, 1000) // batch size
+    )
+);